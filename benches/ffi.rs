@@ -0,0 +1,260 @@
+/*
+ * Copyright 2020-present, Nike, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the Apache-2.0 license found in
+ * the LICENSE file in the root of this source tree.
+ */
+
+//! Benchmarks every path from the clients through the FFI into the Greengrass C SDK.
+//!
+//! These are run against the stubbed SDK, which isolates the cost of the Rust wrappers. The shadows, secrets and
+//! handler messages they read are seeded in its in-memory simulator. The seeding is only compiled in when the build
+//! script builds the stubs, so the benchmarks still link against the real SDK, where the handler read benchmark is skipped:
+//! ```text
+//! AWS_GREENGRASS_STUBS=yes cargo bench --bench ffi -- --save-baseline main
+//! AWS_GREENGRASS_STUBS=yes cargo bench --bench ffi -- --baseline main
+//! ```
+use aws_greengrass_core_rust::iotdata::{IOTDataClient, PublishOptions, QueueFullPolicy};
+use aws_greengrass_core_rust::lambda::{InvokeOptions, LambdaClient, PreparedInvokeOptions};
+use aws_greengrass_core_rust::log::init_log;
+#[cfg(gg_stubs)]
+use aws_greengrass_core_rust::runtime::bench_handler_read_message;
+use aws_greengrass_core_rust::secret::SecretClient;
+use aws_greengrass_core_rust::shadow::ShadowClient;
+use criterion::{
+    black_box, criterion_group, criterion_main, BatchSize, BenchmarkId, Criterion, Throughput,
+};
+use log::{info, LevelFilter};
+use serde::Serialize;
+use serde_json::Value;
+#[cfg(gg_stubs)]
+use std::ffi::CString;
+#[cfg(gg_stubs)]
+use std::os::raw::c_void;
+
+/// Payload sizes from a small sensor reading up to the 128 KB MQTT message limit
+const PAYLOAD_SIZES: &[usize] = &[64, 1024, 16 * 1024, 128 * 1024];
+
+#[derive(Clone, Serialize)]
+struct Reading {
+    sensor: &'static str,
+    temperature: f64,
+    humidity: f64,
+}
+
+const READING: Reading = Reading {
+    sensor: "bench-sensor",
+    temperature: 21.5,
+    humidity: 40.0,
+};
+
+const SHADOW_DOCUMENT: &str = r#"{"state": {"reported": {"temperature": 21.5, "humidity": 40.0}}}"#;
+
+fn payload(size: usize) -> Vec<u8> {
+    vec![b'x'; size]
+}
+
+/// The simulator controls from stubs/include/shared/greengrasssdk_sim.h
+#[cfg(gg_stubs)]
+mod sim {
+    use std::os::raw::{c_char, c_int, c_void};
+
+    #[link(name = "aws-greengrass-core-sdk-c")]
+    extern "C" {
+        pub fn gg_sim_set_shadow(thing_name: *const c_char, document: *const c_char) -> c_int;
+        pub fn gg_sim_set_secret(
+            secret_id: *const c_char,
+            version_id: *const c_char,
+            version_stage: *const c_char,
+            secret_string: *const c_char,
+        ) -> c_int;
+        pub fn gg_sim_set_handler_message(payload: *const c_void, payload_size: usize);
+    }
+}
+
+#[cfg(gg_stubs)]
+fn seed_shadow(thing_name: &str) {
+    let thing_name = CString::new(thing_name).unwrap();
+    let document = CString::new(SHADOW_DOCUMENT).unwrap();
+    let res = unsafe { sim::gg_sim_set_shadow(thing_name.as_ptr(), document.as_ptr()) };
+    assert_eq!(res, 0, "unable to seed shadow");
+}
+
+#[cfg(gg_stubs)]
+fn seed_secret(secret_id: &str, secret_string: &str) {
+    let secret_id = CString::new(secret_id).unwrap();
+    let secret_string = CString::new(secret_string).unwrap();
+    let res = unsafe {
+        sim::gg_sim_set_secret(
+            secret_id.as_ptr(),
+            std::ptr::null(),
+            std::ptr::null(),
+            secret_string.as_ptr(),
+        )
+    };
+    assert_eq!(res, 0, "unable to seed secret");
+}
+
+/// The real SDK reads the shadow from the core, which must already have it
+#[cfg(not(gg_stubs))]
+fn seed_shadow(_thing_name: &str) {}
+
+/// The real SDK reads the secret from the core, which must already have it
+#[cfg(not(gg_stubs))]
+fn seed_secret(_secret_id: &str, _secret_string: &str) {}
+
+fn publish(c: &mut Criterion) {
+    let mut group = c.benchmark_group("publish");
+    let client = IOTDataClient::default();
+    let with_options = IOTDataClient::default().with_publish_options(Some(
+        PublishOptions::default().with_queue_full_policy(QueueFullPolicy::AllOrError),
+    ));
+    let topic = client.topic("bench/topic").unwrap();
+    for &size in PAYLOAD_SIZES {
+        let message = payload(size);
+        group.throughput(Throughput::Bytes(size as u64));
+        group.bench_with_input(BenchmarkId::new("publish", size), &message, |b, message| {
+            b.iter(|| client.publish("bench/topic", black_box(message)))
+        });
+        group.bench_with_input(
+            BenchmarkId::new("publish_with_options", size),
+            &message,
+            |b, message| b.iter(|| with_options.publish("bench/topic", black_box(message))),
+        );
+        group.bench_with_input(
+            BenchmarkId::new("publish_to", size),
+            &message,
+            |b, message| b.iter(|| client.publish_to(&topic, black_box(message))),
+        );
+    }
+    group.throughput(Throughput::Elements(1));
+    group.bench_function("publish_json", |b| {
+        b.iter(|| client.publish_json("bench/topic", black_box(&READING)))
+    });
+    group.finish();
+}
+
+fn invoke(c: &mut Criterion) {
+    let mut group = c.benchmark_group("invoke");
+    let client = LambdaClient::default();
+    let options = InvokeOptions::new(
+        "arn:aws:lambda:us-west-2:123456789012:function:bench".to_owned(),
+        READING,
+        "1".to_owned(),
+    );
+    let prepared = PreparedInvokeOptions::new(&options).unwrap();
+    for &size in PAYLOAD_SIZES {
+        let message = payload(size);
+        group.throughput(Throughput::Bytes(size as u64));
+        // InvokeOptions is taken by value, so these include the clone a caller would make
+        group.bench_with_input(
+            BenchmarkId::new("invoke_sync", size),
+            &message,
+            |b, message| b.iter(|| client.invoke_sync(options.clone(), Some(black_box(message)))),
+        );
+        group.bench_with_input(
+            BenchmarkId::new("invoke_async", size),
+            &message,
+            |b, message| b.iter(|| client.invoke_async(options.clone(), Some(black_box(message)))),
+        );
+        group.bench_with_input(
+            BenchmarkId::new("invoke_sync_prepared", size),
+            &message,
+            |b, message| {
+                b.iter(|| client.invoke_sync_prepared(&prepared, Some(black_box(message))))
+            },
+        );
+    }
+    group.finish();
+}
+
+fn shadow(c: &mut Criterion) {
+    let mut group = c.benchmark_group("shadow");
+    let client = ShadowClient::default();
+    let document = serde_json::from_str::<Value>(SHADOW_DOCUMENT).unwrap();
+    seed_shadow("bench_thing");
+    group.throughput(Throughput::Elements(1));
+    group.bench_function("get_thing_shadow", |b| {
+        b.iter(|| client.get_thing_shadow::<Value>(black_box("bench_thing")))
+    });
+    group.bench_function("update_thing_shadow", |b| {
+        b.iter(|| client.update_thing_shadow("bench_thing", black_box(&document)))
+    });
+    group.bench_function("delete_thing_shadow", |b| {
+        b.iter_batched(
+            || seed_shadow("bench_thing"),
+            |_| client.delete_thing_shadow(black_box("bench_thing")),
+            BatchSize::SmallInput,
+        )
+    });
+    group.finish();
+}
+
+fn secret(c: &mut Criterion) {
+    let mut group = c.benchmark_group("secret");
+    let client = SecretClient::default();
+    seed_secret("bench_secret", "bench_secret_string");
+    group.throughput(Throughput::Elements(1));
+    group.bench_function("get_secret_value", |b| {
+        b.iter(|| client.for_secret_id(black_box("bench_secret")).request())
+    });
+    group.finish();
+}
+
+#[cfg(gg_stubs)]
+fn handler_read(c: &mut Criterion) {
+    let mut group = c.benchmark_group("handler_read");
+    for &size in PAYLOAD_SIZES {
+        let message = payload(size);
+        group.throughput(Throughput::Bytes(size as u64));
+        group.bench_with_input(
+            BenchmarkId::new("handler_read_message", size),
+            &message,
+            |b, message| {
+                b.iter(|| unsafe {
+                    sim::gg_sim_set_handler_message(
+                        message.as_ptr() as *const c_void,
+                        message.len(),
+                    );
+                    bench_handler_read_message()
+                })
+            },
+        );
+    }
+    group.finish();
+}
+
+/// The real SDK only has a message to read from within a handler
+#[cfg(not(gg_stubs))]
+fn handler_read(_c: &mut Criterion) {}
+
+fn logging(c: &mut Criterion) {
+    init_log(LevelFilter::Info);
+    let mut group = c.benchmark_group("log");
+    group.throughput(Throughput::Elements(1));
+    group.bench_function("info", |b| {
+        b.iter(|| {
+            info!(
+                "temperature {} humidity {}%",
+                black_box(21.5),
+                black_box(40.0)
+            )
+        })
+    });
+    group.bench_function("filtered", |b| {
+        b.iter(|| log::debug!("temperature {}", black_box(21.5)))
+    });
+    group.finish();
+}
+
+criterion_group!(
+    benches,
+    publish,
+    invoke,
+    shadow,
+    secret,
+    handler_read,
+    logging
+);
+criterion_main!(benches);
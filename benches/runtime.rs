@@ -0,0 +1,160 @@
+/*
+ * Copyright 2020-present, Nike, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the Apache-2.0 license found in
+ * the LICENSE file in the root of this source tree.
+ */
+
+//! Benchmarks the runtime dispatching events to its handler workers.
+//!
+//! The events are generated by the stubbed SDK, see "Generating events" in stubs/README.md. Each iteration generates
+//! a batch of events and ends once the workers have handled all of them, so it covers the C callback, the channel and
+//! the dispatch to the workers. The rate, bursts, payload sizes, topics and function arns are taken from the
+//! GG_SIM_EVENTS_* settings, the count is set by the benchmark:
+//! ```text
+//! GG_SIM_EVENTS_PAYLOAD_SIZE=exponential:2k AWS_GREENGRASS_STUBS=yes cargo bench --bench runtime
+//! ```
+//! The real SDK doesn't generate events, so against it nothing is benchmarked.
+#[cfg(gg_stubs)]
+use aws_greengrass_core_rust::handler::{Handler, LambdaContext};
+#[cfg(gg_stubs)]
+use aws_greengrass_core_rust::runtime::{DispatchOrdering, Runtime, RuntimeOption};
+#[cfg(gg_stubs)]
+use aws_greengrass_core_rust::Initializer;
+#[cfg(gg_stubs)]
+use criterion::{black_box, BenchmarkId, Throughput};
+use criterion::{criterion_group, criterion_main, Criterion};
+#[cfg(gg_stubs)]
+use std::env;
+#[cfg(gg_stubs)]
+use std::sync::atomic::{AtomicU64, Ordering};
+#[cfg(gg_stubs)]
+use std::sync::{Arc, Condvar, Mutex};
+
+/// The events generated by each iteration
+#[cfg(gg_stubs)]
+const EVENTS: u64 = 10_000;
+
+#[cfg(gg_stubs)]
+const WORKERS: &[usize] = &[1, 2, 4, 8];
+
+/// Used when GG_SIM_EVENTS_TOPICS isn't set, so that ordering by topic spreads the events over the workers
+#[cfg(gg_stubs)]
+const TOPICS: &str = "bench/0,bench/1,bench/2,bench/3,bench/4,bench/5,bench/6,bench/7";
+
+/// The simulator controls from stubs/include/shared/greengrasssdk_sim.h
+#[cfg(gg_stubs)]
+mod sim {
+    use std::os::raw::c_int;
+
+    #[link(name = "aws-greengrass-core-sdk-c")]
+    extern "C" {
+        pub fn gg_sim_start_events() -> c_int;
+        pub fn gg_sim_wait_events() -> c_int;
+    }
+}
+
+/// Counts the events the workers have handled
+#[cfg(gg_stubs)]
+#[derive(Default)]
+struct Handled {
+    count: AtomicU64,
+    lock: Mutex<()>,
+    all_handled: Condvar,
+}
+
+#[cfg(gg_stubs)]
+impl Handled {
+    /// Waits for the workers to have handled every event of the batch
+    fn wait(&self) {
+        let mut guard = self.lock.lock().unwrap();
+        while self.count.load(Ordering::SeqCst) < EVENTS {
+            guard = self.all_handled.wait(guard).unwrap();
+        }
+        self.count.store(0, Ordering::SeqCst);
+    }
+}
+
+#[cfg(gg_stubs)]
+struct CountingHandler(Arc<Handled>);
+
+#[cfg(gg_stubs)]
+impl Handler for CountingHandler {
+    fn handle(&self, ctx: LambdaContext) {
+        black_box(ctx.message);
+        // only the last event of the batch takes the lock, so the workers don't contend on it
+        if self.0.count.fetch_add(1, Ordering::SeqCst) + 1 == EVENTS {
+            let _guard = self.0.lock.lock().unwrap();
+            self.0.all_handled.notify_one();
+        }
+    }
+}
+
+#[cfg(gg_stubs)]
+fn ordering(name: &str) -> DispatchOrdering {
+    match name {
+        "by_topic" => DispatchOrdering::ByTopic,
+        _ => DispatchOrdering::Unordered,
+    }
+}
+
+/// Starts a runtime, which handles a first batch of events as the generator starts with it
+#[cfg(gg_stubs)]
+fn start_runtime(workers: usize, ordering: DispatchOrdering) -> Arc<Handled> {
+    let handled = Arc::new(Handled::default());
+    let runtime = Runtime::default()
+        .with_runtime_option(RuntimeOption::Async)
+        .with_workers(workers)
+        .with_ordering(ordering)
+        .with_handler(Some(Box::new(CountingHandler(Arc::clone(&handled)))));
+    Initializer::default()
+        .with_runtime(runtime)
+        .init()
+        .expect("unable to start the runtime");
+    unsafe {
+        assert_eq!(sim::gg_sim_wait_events(), 0, "unable to wait for events");
+    }
+    handled.wait();
+    handled
+}
+
+#[cfg(gg_stubs)]
+fn handle_events(handled: &Handled) {
+    unsafe {
+        assert_eq!(sim::gg_sim_start_events(), 0, "unable to generate events");
+        assert_eq!(sim::gg_sim_wait_events(), 0, "unable to wait for events");
+    }
+    handled.wait();
+}
+
+#[cfg(gg_stubs)]
+fn dispatch(c: &mut Criterion) {
+    // the settings are read from the environment when each runtime starts
+    env::set_var("GG_SIM_EVENTS_COUNT", EVENTS.to_string());
+    env::set_var("GG_SIM_EVENTS_DURATION", "0");
+    if env::var_os("GG_SIM_EVENTS_TOPICS").is_none() {
+        env::set_var("GG_SIM_EVENTS_TOPICS", TOPICS);
+    }
+
+    let mut group = c.benchmark_group("runtime");
+    group.sample_size(10);
+    group.throughput(Throughput::Elements(EVENTS));
+    for &workers in WORKERS {
+        for &name in &["unordered", "by_topic"] {
+            // the workers of earlier runtimes stay blocked on their channels, so one runtime is started for each
+            let handled = start_runtime(workers, ordering(name));
+            group.bench_with_input(BenchmarkId::new(name, workers), &handled, |b, handled| {
+                b.iter(|| handle_events(handled))
+            });
+        }
+    }
+    group.finish();
+}
+
+/// The real SDK only calls the handler for events from the core
+#[cfg(not(gg_stubs))]
+fn dispatch(_c: &mut Criterion) {}
+
+criterion_group!(benches, dispatch);
+criterion_main!(benches);
@@ -10,6 +10,7 @@ use std::env;
 use std::path::PathBuf;
 
 fn main() {
+    println!("cargo:rustc-check-cfg=cfg(gg_stubs)");
     if cfg!(feature = "coverage") {
         return ();
     };
@@ -20,6 +21,8 @@ fn main() {
         let dst = cmake::build("stubs");
         println!("cargo:rustc-link-search=native={}/lib", dst.display());
         builder = builder.clang_arg(format!("-I{}/include", dst.display()));
+        // lets the benchmarks seed the stub's simulator
+        println!("cargo:rustc-cfg=gg_stubs");
     }
 
     println!("cargo:rustc-link-lib=aws-greengrass-core-sdk-c");
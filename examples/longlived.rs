@@ -20,6 +20,7 @@ use aws_greengrass_core_rust::iotdata::IOTDataClient;
 use aws_greengrass_core_rust::log as gglog;
 use aws_greengrass_core_rust::runtime::{Runtime, RuntimeOption};
 use aws_greengrass_core_rust::{GGResult, Initializer};
+use hyper::body::Bytes;
 use hyper::service::{make_service_fn, service_fn};
 use hyper::{Body, Method, Request, Response, Server, StatusCode};
 use log::{error, info, LevelFilter};
@@ -31,7 +32,7 @@ async fn serve(req: Request<Body>) -> Result<Response<Body>, hyper::Error> {
         // Simply echo the body back to the client.
         (&Method::POST, "/") => {
             let body = hyper::body::to_bytes(req.into_body()).await?;
-            match publish(&body).await {
+            match publish(body).await {
                 Ok(_) => {
                     let mut accepted = Response::default();
                     *accepted.status_mut() = StatusCode::ACCEPTED;
@@ -55,16 +56,20 @@ async fn serve(req: Request<Body>) -> Result<Response<Body>, hyper::Error> {
     }
 }
 
-async fn publish(bytes: &[u8]) -> GGResult<()> {
+async fn publish(bytes: Bytes) -> GGResult<()> {
     // convert to a string for logging purposes
-    info!("publishing message of {}", String::from_utf8_lossy(bytes));
-    IOTDataClient::default().publish(SEND_TOPIC, bytes)
+    info!("publishing message of {}", String::from_utf8_lossy(&bytes));
+    // publish from the blocking pool so the tokio worker threads are never blocked by the C SDK
+    IOTDataClient::default()
+        .publish_async(SEND_TOPIC, bytes)
+        .await
 }
 
 #[tokio::main]
 async fn main() -> Result<(), Box<dyn std::error::Error + Send + Sync>> {
-    // Initialize logging
-    gglog::init_log(LevelFilter::Debug);
+    // Initialize logging, records are written to greengrass from a background thread
+    // so logging doesn't block the request handlers
+    gglog::init_async_log(LevelFilter::Debug, 4096);
 
     // Initialize Greengrass, long lived functions need to be configured with RuntimeOption::Async
     let runtime = Runtime::default().with_runtime_option(RuntimeOption::Async);
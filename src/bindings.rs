@@ -53,9 +53,14 @@ pub mod test {
         pub(crate) static GG_REQUEST_READ_BUFFER: RefCell<Vec<u8>> = RefCell::new(vec![]);
         pub(crate) static GG_REQUEST: RefCell<_gg_request> = RefCell::new(_gg_request::default());
         pub(crate) static GG_LAMBDA_HANDLER_READ_BUFFER: RefCell<Vec<u8>> = RefCell::new(vec![]);
+        /// the number of times gg_lambda_handler_read was called
+        pub(crate) static GG_LAMBDA_HANDLER_READ_COUNT: RefCell<usize> = RefCell::new(0);
         /// used to store the arguments passed to gg_publish
         pub(crate) static GG_PUBLISH_ARGS: RefCell<GGPublishPayloadArgs> = RefCell::new(GGPublishPayloadArgs::default());
         pub(crate) static GG_PUBLISH_WITH_OPTIONS_ARGS: RefCell<GGPublishPayloadArgs> = RefCell::new(GGPublishPayloadArgs::default());
+        /// request statuses and response bodies that gg_publish will return, popped from the end
+        pub(crate) static GG_PUBLISH_RESPONSES: RefCell<Vec<(gg_request_status, Vec<u8>)>> = RefCell::new(vec![]);
+        pub(crate) static GG_PUBLISH_COUNT: RefCell<usize> = RefCell::new(0);
         pub(crate) static GG_GET_SECRET_VALUE_ARGS: RefCell<GGGetSecretValueArgs> = RefCell::new(GGGetSecretValueArgs::default());
         pub(crate) static GG_GET_SECRET_VALUE_RETURN: RefCell<gg_error> = RefCell::new(gg_error_GGE_SUCCESS);
         pub(crate) static GG_CLOSE_REQUEST_COUNT: RefCell<u8> = RefCell::new(0);
@@ -74,8 +79,11 @@ pub mod test {
         GG_REQUEST_READ_BUFFER.with(|rc| rc.replace(vec![]));
         GG_REQUEST.with(|rc| rc.replace(_gg_request::default()));
         GG_LAMBDA_HANDLER_READ_BUFFER.with(|rc| rc.replace(vec![]));
+        GG_LAMBDA_HANDLER_READ_COUNT.with(|rc| rc.replace(0));
         GG_PUBLISH_ARGS.with(|rc| rc.replace(GGPublishPayloadArgs::default()));
         GG_PUBLISH_WITH_OPTIONS_ARGS.with(|rc| rc.replace(GGPublishPayloadArgs::default()));
+        GG_PUBLISH_RESPONSES.with(|rc| rc.replace(vec![]));
+        GG_PUBLISH_COUNT.with(|rc| rc.replace(0));
         GG_GET_SECRET_VALUE_ARGS.with(|rc| rc.replace(GGGetSecretValueArgs::default()));
         GG_CLOSE_REQUEST_COUNT.with(|rc| rc.replace(0));
         GG_PUBLISH_OPTION_INIT_COUNT.with(|rc| rc.replace(0));
@@ -285,6 +293,10 @@ pub mod test {
         buffer_size: usize,
         amount_read: *mut usize,
     ) -> gg_error {
+        GG_LAMBDA_HANDLER_READ_COUNT.with(|rc| {
+            let new_value = *rc.borrow() + 1;
+            rc.replace(new_value);
+        });
         unsafe {
             GG_LAMBDA_HANDLER_READ_BUFFER.with(|b| {
                 let mut borrowed = b.borrow().clone();
@@ -536,6 +548,11 @@ pub mod test {
 
                 args.replace(gg_args);
             });
+            GG_PUBLISH_COUNT.with(|rc| *rc.borrow_mut() += 1);
+            if let Some((status, body)) = GG_PUBLISH_RESPONSES.with(|rc| rc.borrow_mut().pop()) {
+                (*result).request_status = status;
+                GG_REQUEST_READ_BUFFER.with(|rc| rc.replace(body));
+            }
         }
         gg_error_GGE_SUCCESS
     }
@@ -0,0 +1,231 @@
+/*
+ * Copyright 2020-present, Nike, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the Apache-2.0 license found in
+ * the LICENSE file in the root of this source tree.
+ */
+
+//! Provides the thread pool that the async client methods use to call the blocking C SDK.
+//!
+//! Every call into the Greengrass C SDK blocks the calling thread until the core responds.
+//! The `*_async` methods on the clients run those calls on a dedicated pool of threads and return a
+//! [`BlockingFuture`], so that async executors (e.g. tokio) are never blocked by the C SDK.
+//! The number of pool threads bounds the number of concurrent calls to the C SDK.
+//!
+//! # Examples
+//! ```rust
+//! use aws_greengrass_core_rust::iotdata::IOTDataClient;
+//!
+//! async fn forward(body: Vec<u8>) {
+//!     if let Err(e) = IOTDataClient::default().publish_async("some/topic", body).await {
+//!         eprintln!("An error occurred publishing: {}", e);
+//!     }
+//! }
+//! ```
+use crate::error::GGError;
+use crate::GGResult;
+use crossbeam_channel::{unbounded, Sender};
+use lazy_static::lazy_static;
+use log::error;
+use std::future::Future;
+use std::panic::{self, AssertUnwindSafe};
+use std::pin::Pin;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::{Arc, Mutex};
+use std::task::{Context, Poll, Waker};
+use std::thread;
+
+/// The number of pool threads used when none has been specified
+const DEFAULT_MAX_THREADS: usize = 4;
+
+static MAX_THREADS: AtomicUsize = AtomicUsize::new(DEFAULT_MAX_THREADS);
+
+lazy_static! {
+    static ref POOL: BlockingPool = BlockingPool::new(MAX_THREADS.load(Ordering::SeqCst));
+}
+
+/// Sets the number of threads in the pool, which is the maximum number of concurrent calls to the C SDK.
+/// The pool is started by the first async call, so this has no effect after that.
+/// See [`crate::Initializer::with_blocking_threads`]
+pub fn set_max_threads(threads: usize) {
+    MAX_THREADS.store(threads.max(1), Ordering::SeqCst);
+}
+
+/// Runs the function on the blocking pool. The returned future completes with the result of the function.
+pub(crate) fn spawn<T, F>(f: F) -> BlockingFuture<T>
+where
+    T: Send + 'static,
+    F: FnOnce() -> GGResult<T> + Send + 'static,
+{
+    POOL.spawn(f)
+}
+
+/// The pool that [`spawn`] runs functions on
+pub(crate) fn pool() -> &'static BlockingPool {
+    &POOL
+}
+
+/// Runs the function on a thread of its own rather than the pool. This is for functions that wait on
+/// calls running on the pool, which would otherwise take up a pool thread, or never complete with a single thread.
+pub(crate) fn spawn_thread<T, F>(name: &str, f: F) -> BlockingFuture<T>
+where
+    T: Send + 'static,
+    F: FnOnce() -> GGResult<T> + Send + 'static,
+{
+    let future = BlockingFuture::new();
+    let state = Arc::clone(&future.state);
+    let spawned = thread::Builder::new()
+        .name(name.to_owned())
+        .spawn(move || complete(&state, catch_panic(f)));
+    if let Err(e) = spawned {
+        error!("Unable to start the {} thread: {}", name, e);
+        complete(&future.state, Err(GGError::InvalidState));
+    }
+    future
+}
+
+type Job = Box<dyn FnOnce() + Send>;
+
+/// A fixed number of threads that run jobs in the order they were submitted
+pub(crate) struct BlockingPool {
+    sender: Sender<Job>,
+}
+
+impl BlockingPool {
+    pub(crate) fn new(threads: usize) -> Self {
+        let (sender, receiver) = unbounded::<Job>();
+        for _ in 0..threads {
+            let receiver = receiver.clone();
+            thread::spawn(move || {
+                for job in receiver.iter() {
+                    job();
+                }
+            });
+        }
+        BlockingPool { sender }
+    }
+
+    pub(crate) fn spawn<T, F>(&self, f: F) -> BlockingFuture<T>
+    where
+        T: Send + 'static,
+        F: FnOnce() -> GGResult<T> + Send + 'static,
+    {
+        let future = BlockingFuture::new();
+        let state = Arc::clone(&future.state);
+        let job: Job = Box::new(move || complete(&state, catch_panic(f)));
+        if self.sender.send(job).is_err() {
+            error!("Blocking pool has shut down");
+            complete(&future.state, Err(GGError::InvalidState));
+        }
+        future
+    }
+}
+
+fn catch_panic<T, F: FnOnce() -> GGResult<T>>(f: F) -> GGResult<T> {
+    panic::catch_unwind(AssertUnwindSafe(f)).unwrap_or_else(|_| {
+        Err(GGError::Unknown(
+            "Blocking greengrass call panicked".to_owned(),
+        ))
+    })
+}
+
+struct State<T> {
+    result: Option<GGResult<T>>,
+    waker: Option<Waker>,
+}
+
+fn complete<T>(state: &Mutex<State<T>>, result: GGResult<T>) {
+    let waker = {
+        let mut state = state.lock().expect("blocking future lock poisoned");
+        state.result = Some(result);
+        state.waker.take()
+    };
+    if let Some(waker) = waker {
+        waker.wake();
+    }
+}
+
+/// A future that resolves once a call to the C SDK running on the blocking pool completes
+pub struct BlockingFuture<T> {
+    state: Arc<Mutex<State<T>>>,
+}
+
+impl<T> BlockingFuture<T> {
+    fn new() -> Self {
+        BlockingFuture {
+            state: Arc::new(Mutex::new(State {
+                result: None,
+                waker: None,
+            })),
+        }
+    }
+}
+
+impl<T> Future for BlockingFuture<T> {
+    type Output = GGResult<T>;
+
+    fn poll(self: Pin<&mut Self>, cx: &mut Context<'_>) -> Poll<Self::Output> {
+        let mut state = self.state.lock().expect("blocking future lock poisoned");
+        if let Some(result) = state.result.take() {
+            Poll::Ready(result)
+        } else {
+            state.waker = Some(cx.waker().clone());
+            Poll::Pending
+        }
+    }
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+    use futures::executor::block_on;
+    use futures::future::join_all;
+    use std::time::Duration;
+
+    #[test]
+    fn test_spawn() {
+        let result = block_on(spawn(|| Ok(42)));
+        assert_eq!(result.unwrap(), 42);
+    }
+
+    #[test]
+    fn test_spawn_panic() {
+        let result: GGResult<()> = block_on(spawn(|| panic!("boom")));
+        assert!(result.is_err());
+    }
+
+    #[test]
+    fn test_spawn_thread() {
+        // waiting on the only pool thread from a pool job would never complete
+        let pool = Arc::new(BlockingPool::new(1));
+        let inner = Arc::clone(&pool);
+        let result = block_on(spawn_thread("test", move || {
+            block_on(inner.spawn(|| Ok(42)))
+        }));
+        assert_eq!(result.unwrap(), 42);
+        assert!(block_on(spawn_thread::<(), _>("test", || panic!("boom"))).is_err());
+    }
+
+    #[test]
+    fn test_concurrency_is_bounded() {
+        let threads = 2;
+        let pool = BlockingPool::new(threads);
+        let running = Arc::new(AtomicUsize::new(0));
+        let max_running = Arc::new(AtomicUsize::new(0));
+        let futures = (0..8).map(|_| {
+            let running = Arc::clone(&running);
+            let max_running = Arc::clone(&max_running);
+            pool.spawn(move || {
+                let now = running.fetch_add(1, Ordering::SeqCst) + 1;
+                max_running.fetch_max(now, Ordering::SeqCst);
+                thread::sleep(Duration::from_millis(10));
+                running.fetch_sub(1, Ordering::SeqCst);
+                Ok(())
+            })
+        });
+        let results = block_on(join_all(futures));
+        assert!(results.iter().all(|r| r.is_ok()));
+        assert_eq!(max_running.load(Ordering::SeqCst), threads);
+    }
+}
@@ -0,0 +1,113 @@
+/*
+ * Copyright 2020-present, Nike, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the Apache-2.0 license found in
+ * the LICENSE file in the root of this source tree.
+ */
+
+//! Provides a reusable per thread buffer for serializing JSON payloads, so that steady state
+//! publishing and shadow updates do not allocate.
+use crate::error::GGError;
+use crate::GGResult;
+use serde::Serialize;
+use std::cell::RefCell;
+use std::ffi::CStr;
+
+/// The initial capacity of the buffer
+const INITIAL_CAPACITY: usize = 1024;
+
+/// Buffers that grew larger than this are released after use instead of being retained,
+/// so one large document doesn't pin memory on the thread forever
+const MAX_RETAINED_CAPACITY: usize = 256 * 1024;
+
+thread_local! {
+    static JSON_BUFFER: RefCell<Vec<u8>> = RefCell::new(Vec::with_capacity(INITIAL_CAPACITY));
+}
+
+/// Serializes the value to JSON in the thread's buffer and provides the bytes to the specified function
+pub(crate) fn with_json<T, R, F>(value: &T, f: F) -> GGResult<R>
+where
+    T: Serialize + ?Sized,
+    F: FnOnce(&[u8]) -> GGResult<R>,
+{
+    with_buffer(|buffer| {
+        serde_json::to_writer(&mut *buffer, value).map_err(GGError::from)?;
+        f(buffer)
+    })
+}
+
+/// Serializes the value to NUL terminated JSON in the thread's buffer and provides it to the specified function
+pub(crate) fn with_json_c<T, R, F>(value: &T, f: F) -> GGResult<R>
+where
+    T: Serialize + ?Sized,
+    F: FnOnce(&CStr) -> GGResult<R>,
+{
+    with_buffer(|buffer| {
+        serde_json::to_writer(&mut *buffer, value).map_err(GGError::from)?;
+        buffer.push(0);
+        // serde_json escapes control characters so there should never be an interior NUL
+        let json_c = CStr::from_bytes_with_nul(buffer)
+            .map_err(|e| GGError::InvalidString(format!("{}", e)))?;
+        f(json_c)
+    })
+}
+
+/// Provides the cleared thread buffer to the function.
+/// If the buffer is already in use further up the stack a new buffer is used.
+fn with_buffer<R, F>(f: F) -> GGResult<R>
+where
+    F: FnOnce(&mut Vec<u8>) -> GGResult<R>,
+{
+    JSON_BUFFER.with(|rc| match rc.try_borrow_mut() {
+        Ok(mut buffer) => {
+            buffer.clear();
+            let result = f(&mut buffer);
+            if buffer.capacity() > MAX_RETAINED_CAPACITY {
+                *buffer = Vec::with_capacity(INITIAL_CAPACITY);
+            }
+            result
+        }
+        Err(_) => f(&mut Vec::with_capacity(INITIAL_CAPACITY)),
+    })
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+    use serde_json::json;
+
+    #[test]
+    fn test_with_json() {
+        let doc = json!({"foo": "bar"});
+        let json = with_json(&doc, |bytes| Ok(bytes.to_vec())).unwrap();
+        assert_eq!(json, br#"{"foo":"bar"}"#);
+    }
+
+    #[test]
+    fn test_with_json_c() {
+        let doc = json!({"foo": "bar\u{0}baz"});
+        let json = with_json_c(&doc, |json_c| Ok(json_c.to_str().unwrap().to_owned())).unwrap();
+        assert_eq!(json, r#"{"foo":"bar\u0000baz"}"#);
+    }
+
+    #[test]
+    fn test_buffer_is_reused() {
+        let first = with_json(&json!({"foo": 1}), |bytes| Ok(bytes.as_ptr() as usize)).unwrap();
+        let second = with_json(&json!({"bar": 2}), |bytes| Ok(bytes.as_ptr() as usize)).unwrap();
+        assert_eq!(first, second);
+    }
+
+    #[test]
+    fn test_nested_use() {
+        let outer = json!({"outer": true});
+        let inner = json!({"inner": true});
+        let (outer_json, inner_json) = with_json(&outer, |outer_bytes| {
+            let inner_json = with_json(&inner, |inner_bytes| Ok(inner_bytes.to_vec()))?;
+            Ok((outer_bytes.to_vec(), inner_json))
+        })
+        .unwrap();
+        assert_eq!(outer_json, br#"{"outer":true}"#);
+        assert_eq!(inner_json, br#"{"inner":true}"#);
+    }
+}
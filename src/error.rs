@@ -54,6 +54,8 @@ pub enum GGError {
     /// If the error is a 404, it should be handled as an Option instead. Otherwise
     /// this error type can be returned.
     ErrorResponse(GGRequestResponse),
+    /// When a call did not complete before its deadline
+    Timeout,
 }
 
 impl GGError {
@@ -102,6 +104,7 @@ impl fmt::Display for GGError {
             Self::InvalidString(ref e) => write!(f, "Invalid String: {}", e),
             Self::Unauthorized(ref s) => write!(f, "{}", s),
             Self::ErrorResponse(ref r) => write!(f, "Green responded with error: {:?}", r),
+            Self::Timeout => write!(f, "Deadline passed before greengrass responded"),
         }
     }
 }
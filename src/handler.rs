@@ -25,6 +25,7 @@
 //! let runtime = Runtime::default().with_handler(Some(Box::new(MyHandler)));
 //! Initializer::default().with_runtime(runtime).init();
 //! ```
+use serde_json::Value;
 
 /// Provides information around the the event that was received
 #[derive(Debug, Clone, PartialEq)]
@@ -45,6 +46,23 @@ impl LambdaContext {
             message,
         }
     }
+
+    /// The MQTT topic the event was published to, if greengrass provided one.
+    ///
+    /// Greengrass places the subject of a subscription event in the `custom.subject`
+    /// field of the client context. The client context may or may not be base64 encoded.
+    pub fn topic(&self) -> Option<String> {
+        let json = serde_json::from_str::<Value>(&self.client_context)
+            .ok()
+            .or_else(|| {
+                base64::decode(&self.client_context)
+                    .ok()
+                    .and_then(|bytes| serde_json::from_slice::<Value>(&bytes).ok())
+            })?;
+        json.pointer("/custom/subject")
+            .and_then(Value::as_str)
+            .map(|s| s.to_owned())
+    }
 }
 
 /// Trait to implement for specifying a handler to the greengrass runtime.
@@ -74,4 +92,18 @@ mod test {
         let cloned = ctx.message.to_owned();
         assert_eq!(cloned, message.clone());
     }
+
+    #[test]
+    fn test_topic() {
+        let client_context = r#"{"custom":{"subject":"my/topic"}}"#;
+        let ctx = LambdaContext::new("arn".to_owned(), client_context.to_owned(), vec![]);
+        assert_eq!(ctx.topic(), Some("my/topic".to_owned()));
+
+        let encoded = base64::encode(client_context);
+        let ctx = LambdaContext::new("arn".to_owned(), encoded, vec![]);
+        assert_eq!(ctx.topic(), Some("my/topic".to_owned()));
+
+        let ctx = LambdaContext::new("arn".to_owned(), "not json".to_owned(), vec![]);
+        assert_eq!(ctx.topic(), None);
+    }
 }
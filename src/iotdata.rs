@@ -7,20 +7,29 @@
  */
 
 //! Provides the ability to publish MQTT topics
-use log::info;
+use log::{error, info};
 use serde::ser::Serialize;
+#[cfg(not(all(test, feature = "mock")))]
+use std::collections::HashMap;
 use std::convert::TryFrom;
 use std::default::Default;
-use std::ffi::CString;
+use std::ffi::{CStr, CString};
+use std::fmt;
 use std::os::raw::c_void;
 use std::ptr;
+use std::sync::{Arc, Mutex};
 
 #[cfg(all(test, feature = "mock"))]
 use self::mock::*;
 
 use crate::bindings::*;
+#[cfg(not(all(test, feature = "mock")))]
+use crate::blocking::{self, BlockingFuture};
+use crate::buffer;
 use crate::error::GGError;
+use crate::ratelimit::RateLimiter;
 use crate::request::GGRequestResponse;
+use crate::retry::{retry, RetryPolicy};
 use crate::with_request;
 use crate::GGResult;
 
@@ -65,6 +74,56 @@ impl Default for PublishOptions {
     }
 }
 
+/// A topic that has been validated and converted to a C string once, so it can be
+/// published to repeatedly without allocating. See [`IOTDataClient::topic`]
+///
+/// # Examples
+/// ```rust
+/// use aws_greengrass_core_rust::iotdata::{IOTDataClient, Topic};
+/// let client = IOTDataClient::default();
+/// let topic = Topic::new("telemetry/temp").unwrap();
+/// for reading in &["21.5", "21.6", "21.4"] {
+///     if let Err(e) = client.publish_to(&topic, reading) {
+///         eprintln!("An error occurred publishing to {}: {}", topic, e);
+///     }
+/// }
+/// ```
+#[derive(Clone, Debug, PartialEq)]
+pub struct Topic {
+    name: String,
+    name_c: CString,
+}
+
+impl Topic {
+    /// Creates the topic. An error is returned if the name contains a NUL byte
+    pub fn new(name: &str) -> GGResult<Self> {
+        let name_c = CString::new(name).map_err(GGError::from)?;
+        Ok(Topic {
+            name: name.to_owned(),
+            name_c,
+        })
+    }
+
+    /// The name of the topic
+    pub fn as_str(&self) -> &str {
+        &self.name
+    }
+}
+
+impl TryFrom<&str> for Topic {
+    type Error = GGError;
+
+    fn try_from(name: &str) -> Result<Self, Self::Error> {
+        Topic::new(name)
+    }
+}
+
+impl fmt::Display for Topic {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        f.write_str(&self.name)
+    }
+}
+
 /// Provides MQTT publishing to Greengrass lambda functions
 ///
 /// # Examples
@@ -92,10 +151,16 @@ pub struct IOTDataClient {
     /// The policy that this client will use when publishing
     /// if one has been defined
     pub publish_options: Option<PublishOptions>,
+    /// The policy used to retry publishes that greengrass throttled, if one has been defined
+    pub retry_policy: Option<RetryPolicy>,
+    /// The limiter publishes wait on before being sent, if one has been defined
+    pub rate_limiter: Option<RateLimiter>,
     /// When the mock feature is turned on this field will contain captured input
     /// and values to be returned
     #[cfg(all(test, feature = "mock"))]
     pub mocks: MockHolder,
+    /// The C publish options, shared with clones of this client
+    native_options: Arc<NativePublishOptions>,
 }
 
 impl IOTDataClient {
@@ -106,10 +171,35 @@ impl IOTDataClient {
         self.publish_raw(topic, as_bytes, size)
     }
 
+    /// Creates a [`Topic`] that can be reused to publish to without converting the topic name each time
+    pub fn topic(&self, name: &str) -> GGResult<Topic> {
+        Topic::new(name)
+    }
+
+    /// Publishes a message to a prepared topic. Unlike publish, no allocation is made for the topic name.
+    #[cfg(not(all(test, feature = "mock")))]
+    pub fn publish_to<T: AsRef<[u8]>>(&self, topic: &Topic, message: T) -> GGResult<()> {
+        let buffer = message.as_ref();
+        self.with_options_c(|options_c| unsafe {
+            self.publish_internal(&topic.name, &topic.name_c, buffer, buffer.len(), options_c)
+        })
+    }
+
     /// Publish anything that is a deserializable serde object
     pub fn publish_json<T: Serialize>(&self, topic: &str, message: T) -> GGResult<()> {
-        let bytes = serde_json::to_vec(&message).map_err(GGError::from)?;
-        self.publish(topic, &bytes)
+        buffer::with_json(&message, |bytes| self.publish(topic, bytes))
+    }
+
+    /// Publishes the message from the blocking pool, so it can be awaited without blocking the
+    /// executor. See [`crate::blocking`]
+    #[cfg(not(all(test, feature = "mock")))]
+    pub fn publish_async<T>(&self, topic: &str, message: T) -> BlockingFuture<()>
+    where
+        T: AsRef<[u8]> + Send + 'static,
+    {
+        let client = self.clone();
+        let topic = topic.to_owned();
+        blocking::spawn(move || client.publish(&topic, message))
     }
 
     /// Raw publish method that wraps gg_request_init, gg_publish
@@ -118,40 +208,83 @@ impl IOTDataClient {
         self.publish_with_options(topic, buffer, read)
     }
 
+    /// Publishes a batch of messages, returning the result of each publish in the order of the messages.
+    ///
+    /// Each distinct topic is only converted to a C string once. An error is only returned if the batch could not be started,
+    /// errors publishing individual messages are returned in their slot of the result vec.
+    ///
+    /// ```rust
+    /// use aws_greengrass_core_rust::iotdata::IOTDataClient;
+    /// let messages = vec![("telemetry/temp", "21.5"), ("telemetry/humidity", "40")];
+    /// let results = IOTDataClient::default().publish_batch(&messages).unwrap();
+    /// for (result, (topic, _)) in results.iter().zip(messages.iter()) {
+    ///     if let Err(e) = result {
+    ///         eprintln!("An error occurred publishing to {}: {}", topic, e);
+    ///     }
+    /// }
+    /// ```
+    #[cfg(not(all(test, feature = "mock")))]
+    pub fn publish_batch<S, T>(&self, messages: &[(S, T)]) -> GGResult<Vec<GGResult<()>>>
+    where
+        S: AsRef<str>,
+        T: AsRef<[u8]>,
+    {
+        let mut topics: HashMap<&str, CString> = HashMap::new();
+        self.with_options_c(|options_c| {
+            let results = messages
+                .iter()
+                .map(|(topic, message)| {
+                    let topic = topic.as_ref();
+                    if !topics.contains_key(topic) {
+                        topics.insert(topic, CString::new(topic).map_err(GGError::from)?);
+                    }
+                    let buffer = message.as_ref();
+                    unsafe {
+                        self.publish_internal(
+                            topic,
+                            &topics[topic],
+                            buffer,
+                            buffer.len(),
+                            options_c,
+                        )
+                    }
+                })
+                .collect();
+            Ok(results)
+        })
+    }
+
     /// This wraps publish_internal and will set any publish options if publish options were specified
-    /// The primary reason this is a separate function from publish_internal is to ensure that if
-    /// options is specified we clean up the pointer we create on error
     fn publish_with_options(&self, topic: &str, buffer: &[u8], read: usize) -> GGResult<()> {
-        unsafe {
-            // If options were defined, initialize the options pointer and
-            // set queue policy
-            let options_c: Option<gg_publish_options> = if let Some(po) = &self.publish_options {
-                let mut opts_c: gg_publish_options = ptr::null_mut();
-                let init_resp = gg_publish_options_init(&mut opts_c);
-                GGError::from_code(init_resp)?;
-
-                let queue_policy_c = po.queue_full_policy.to_queue_full_c();
-                let policy_resp = gg_publish_options_set_queue_full_policy(opts_c, queue_policy_c);
-                if let Err(e) = GGError::from_code(policy_resp) {
-                    // make sure that we free the options pointer
-                    let free_resp = gg_publish_options_free(opts_c);
-                    GGError::from_code(free_resp)?;
-                    return Err(e);
-                }
-
-                Some(opts_c)
-            } else {
-                None
-            };
+        let topic_c = CString::new(topic).map_err(GGError::from)?;
+        self.with_options_c(|options_c| unsafe {
+            self.publish_internal(topic, &topic_c, buffer, read, options_c)
+        })
+    }
 
-            let publish_result = self.publish_internal(topic, buffer, read, options_c);
+    /// Provides the C publish options pointer to the specified function if publish options were specified.
+    /// The pointer is created on the first publish and shared by the client and its clones.
+    fn with_options_c<R, F>(&self, f: F) -> GGResult<R>
+    where
+        F: FnOnce(Option<gg_publish_options>) -> GGResult<R>,
+    {
+        let queue_policy_c = match &self.publish_options {
+            Some(po) => po.queue_full_policy.to_queue_full_c(),
+            None => return f(None),
+        };
+
+        if let Some(opts) = self.native_options.get_or_init(queue_policy_c)? {
+            return f(Some(opts));
+        }
 
-            // Clean up the options pointer if we created one
-            if let Some(opts) = options_c {
-                let free_resp = gg_publish_options_free(opts);
-                GGError::from_code(free_resp)?;
-            }
-            publish_result
+        // publish_options was modified after the shared options were created,
+        // so fall back to options that only live for this call
+        unsafe {
+            let opts = new_publish_options(queue_policy_c)?;
+            let result = f(Some(opts));
+            let free_resp = gg_publish_options_free(opts);
+            GGError::from_code(free_resp)?;
+            result
         }
     }
 
@@ -159,45 +292,68 @@ impl IOTDataClient {
     unsafe fn publish_internal(
         &self,
         topic: &str,
+        topic_c: &CStr,
         buffer: &[u8],
         read: usize,
         options_tuple: Option<gg_publish_options>,
     ) -> GGResult<()> {
         info!("Publishing message of length {} to topic {}", read, topic);
-        let topic_c = CString::new(topic).map_err(GGError::from)?;
-        let mut req: gg_request = ptr::null_mut();
-        with_request!(req, {
-            let mut res = gg_request_result {
-                request_status: gg_request_status_GG_REQUEST_SUCCESS,
-            };
-            let pub_res = if let Some(options_c) = options_tuple {
-                gg_publish_with_options(
-                    req,
-                    topic_c.as_ptr(),
-                    buffer as *const _ as *const c_void,
-                    read,
-                    options_c,
-                    &mut res,
-                )
-            } else {
-                gg_publish(
-                    req,
-                    topic_c.as_ptr(),
-                    buffer as *const _ as *const c_void,
-                    read,
-                    &mut res,
-                )
-            };
-            GGError::from_code(pub_res)?;
-            GGRequestResponse::try_from(&res)?.to_error_result(req)
+        retry(&self.retry_policy, || {
+            // retries take a token too, so they don't add to the burst that was throttled
+            if let Some(rate_limiter) = &self.rate_limiter {
+                rate_limiter.acquire(topic);
+            }
+            let mut req: gg_request = ptr::null_mut();
+            with_request!(req, {
+                let mut res = gg_request_result {
+                    request_status: gg_request_status_GG_REQUEST_SUCCESS,
+                };
+                let pub_res = if let Some(options_c) = options_tuple {
+                    gg_publish_with_options(
+                        req,
+                        topic_c.as_ptr(),
+                        buffer as *const _ as *const c_void,
+                        read,
+                        options_c,
+                        &mut res,
+                    )
+                } else {
+                    gg_publish(
+                        req,
+                        topic_c.as_ptr(),
+                        buffer as *const _ as *const c_void,
+                        read,
+                        &mut res,
+                    )
+                };
+                GGError::from_code(pub_res)?;
+                GGRequestResponse::try_from(&res)?.to_error_result(req)
+            })
         })
     }
 
+    /// Optionally retry publishes that greengrass throttled. See [`crate::retry`]
+    pub fn with_retry_policy(self, retry_policy: Option<RetryPolicy>) -> Self {
+        IOTDataClient {
+            retry_policy,
+            ..self
+        }
+    }
+
+    /// Optionally limit the rate of publishes from this client. See [`crate::ratelimit`]
+    pub fn with_rate_limiter(self, rate_limiter: Option<RateLimiter>) -> Self {
+        IOTDataClient {
+            rate_limiter,
+            ..self
+        }
+    }
+
     /// Optionally define a publishing options for this Client
     #[allow(clippy::needless_update)]
     pub fn with_publish_options(self, publish_options: Option<PublishOptions>) -> Self {
         IOTDataClient {
             publish_options,
+            native_options: Arc::new(NativePublishOptions::default()),
             ..self
         }
     }
@@ -221,6 +377,23 @@ impl IOTDataClient {
         }
     }
 
+    #[cfg(all(test, feature = "mock"))]
+    pub fn publish_to<T: AsRef<[u8]>>(&self, topic: &Topic, message: T) -> GGResult<()> {
+        self.publish(topic.as_str(), message)
+    }
+
+    #[cfg(all(test, feature = "mock"))]
+    pub fn publish_batch<S, T>(&self, messages: &[(S, T)]) -> GGResult<Vec<GGResult<()>>>
+    where
+        S: AsRef<str>,
+        T: AsRef<[u8]>,
+    {
+        Ok(messages
+            .iter()
+            .map(|(topic, message)| self.publish(topic.as_ref(), message))
+            .collect())
+    }
+
     /// When the mock feature is turned on this will contain captured inputs and return
     /// provided outputs
     #[cfg(all(test, feature = "mock"))]
@@ -233,12 +406,83 @@ impl Default for IOTDataClient {
     fn default() -> Self {
         IOTDataClient {
             publish_options: None,
+            retry_policy: None,
+            rate_limiter: None,
             #[cfg(all(test, feature = "mock"))]
             mocks: MockHolder::default(),
+            native_options: Arc::new(NativePublishOptions::default()),
         }
     }
 }
 
+/// The C publish options of a client. Creating them takes three FFI calls and a heap allocation,
+/// so they are created once on the first publish and freed when the last client using them is dropped.
+#[derive(Default)]
+struct NativePublishOptions {
+    /// The queue policy the options were created with and the options pointer
+    options_c: Mutex<Option<(gg_queue_full_policy_options, gg_publish_options)>>,
+}
+
+// The options pointer is only written while holding the lock and is never modified once created
+unsafe impl Send for NativePublishOptions {}
+
+unsafe impl Sync for NativePublishOptions {}
+
+impl NativePublishOptions {
+    /// Returns the options pointer, creating it with the queue policy if it doesn't exist yet.
+    /// None is returned if the pointer was created with a different queue policy.
+    fn get_or_init(
+        &self,
+        queue_policy_c: gg_queue_full_policy_options,
+    ) -> GGResult<Option<gg_publish_options>> {
+        let mut options_c = self
+            .options_c
+            .lock()
+            .expect("publish options lock poisoned");
+        match *options_c {
+            Some((policy_c, opts)) if policy_c == queue_policy_c => Ok(Some(opts)),
+            Some(_) => Ok(None),
+            None => {
+                let opts = unsafe { new_publish_options(queue_policy_c)? };
+                *options_c = Some((queue_policy_c, opts));
+                Ok(Some(opts))
+            }
+        }
+    }
+}
+
+impl Drop for NativePublishOptions {
+    fn drop(&mut self) {
+        if let Ok(options_c) = self.options_c.get_mut() {
+            if let Some((_, opts)) = options_c.take() {
+                let free_resp = unsafe { gg_publish_options_free(opts) };
+                if let Err(e) = GGError::from_code(free_resp) {
+                    error!("Error freeing publish options: {}", e);
+                }
+            }
+        }
+    }
+}
+
+/// Initializes a C publish options pointer with the queue policy.
+/// The pointer must be freed with gg_publish_options_free
+unsafe fn new_publish_options(
+    queue_policy_c: gg_queue_full_policy_options,
+) -> GGResult<gg_publish_options> {
+    let mut opts_c: gg_publish_options = ptr::null_mut();
+    let init_resp = gg_publish_options_init(&mut opts_c);
+    GGError::from_code(init_resp)?;
+
+    let policy_resp = gg_publish_options_set_queue_full_policy(opts_c, queue_policy_c);
+    if let Err(e) = GGError::from_code(policy_resp) {
+        // make sure that we free the options pointer
+        let free_resp = gg_publish_options_free(opts_c);
+        GGError::from_code(free_resp)?;
+        return Err(e);
+    }
+    Ok(opts_c)
+}
+
 /// Provides mock testing utilities
 #[cfg(all(test, feature = "mock"))]
 pub mod mock {
@@ -310,13 +554,33 @@ pub mod mock {
                 &client.mocks.publish_raw_inputs.borrow()[0];
             assert_eq!(raw_topic, topic);
         }
+
+        #[test]
+        fn test_publish_batch() {
+            let mocks = MockHolder::default()
+                .with_publish_raw_outputs(vec![Ok(()), Err(GGError::InvalidState)]);
+            let client = IOTDataClient::default().with_mocks(mocks);
+            let results = client
+                .publish_batch(&[("foo", "first"), ("bar", "second")])
+                .unwrap();
+
+            assert!(results[0].is_err());
+            assert!(results[1].is_ok());
+            let inputs = client.mocks.publish_raw_inputs.borrow();
+            assert_eq!(inputs.len(), 2);
+            assert_eq!(inputs[0].0, "foo");
+            assert_eq!(inputs[1].0, "bar");
+        }
     }
 }
 
 #[cfg(test)]
 mod test {
     use super::*;
+    use crate::ratelimit::RateLimit;
+    use crate::request::GGRequestStatus;
     use serde_json::Value;
+    use std::time::Duration;
 
     #[cfg(not(feature = "mock"))]
     #[test]
@@ -337,6 +601,147 @@ mod test {
         GG_REQUEST.with(|rc| assert!(!rc.borrow().is_default()));
     }
 
+    #[cfg(not(feature = "mock"))]
+    #[test]
+    fn test_publish_to() {
+        reset_test_state();
+        let client = IOTDataClient::default();
+        let topic = client.topic("prepared/topic").unwrap();
+        client.publish_to(&topic, b"first").unwrap();
+        client.publish_to(&topic, b"second").unwrap();
+        GG_PUBLISH_ARGS.with(|rc| {
+            let args = rc.borrow();
+            assert_eq!(args.topic, "prepared/topic");
+            assert_eq!(args.payload, b"second");
+        });
+        GG_CLOSE_REQUEST_COUNT.with(|rc| assert_eq!(*rc.borrow(), 2));
+    }
+
+    #[test]
+    fn test_topic_with_nul() {
+        assert!(Topic::new("bad\0topic").is_err());
+        assert_eq!(Topic::new("good/topic").unwrap().to_string(), "good/topic");
+    }
+
+    #[cfg(not(feature = "mock"))]
+    #[test]
+    fn test_publish_batch() {
+        reset_test_state();
+        let publish_options =
+            PublishOptions::default().with_queue_full_policy(QueueFullPolicy::AllOrError);
+        let client = IOTDataClient::default().with_publish_options(Some(publish_options));
+        let messages = vec![
+            ("batch_topic", b"first".to_vec()),
+            ("bad\0topic", b"second".to_vec()),
+            ("batch_topic", b"third".to_vec()),
+        ];
+        let results = client.publish_batch(&messages).unwrap();
+        drop(client);
+
+        assert_eq!(results.len(), 3);
+        assert!(results[0].is_ok());
+        assert!(results[1].is_err());
+        assert!(results[2].is_ok());
+        GG_PUBLISH_WITH_OPTIONS_ARGS.with(|rc| {
+            let args = rc.borrow();
+            assert_eq!(args.topic, "batch_topic");
+            assert_eq!(args.payload, b"third");
+        });
+        GG_CLOSE_REQUEST_COUNT.with(|rc| assert_eq!(*rc.borrow(), 2));
+        GG_PUBLISH_OPTION_INIT_COUNT.with(|rc| assert_eq!(*rc.borrow(), 1));
+        GG_PUBLISH_OPTION_FREE_COUNT.with(|rc| assert_eq!(*rc.borrow(), 1));
+    }
+
+    #[cfg(not(feature = "mock"))]
+    #[test]
+    fn test_publish_retry() {
+        reset_test_state();
+        let throttled = (
+            gg_request_status_GG_REQUEST_AGAIN,
+            br#"{"code": 429, "message": "queue full", "timestamp": 0}"#.to_vec(),
+        );
+        GG_PUBLISH_RESPONSES.with(|rc| {
+            rc.replace(vec![
+                (gg_request_status_GG_REQUEST_SUCCESS, vec![]),
+                throttled.clone(),
+                throttled.clone(),
+            ])
+        });
+        let policy = RetryPolicy::default()
+            .with_max_attempts(3)
+            .with_base_delay(Duration::from_millis(1));
+        let client = IOTDataClient::default().with_retry_policy(Some(policy.clone()));
+        client.publish("retry_topic", "payload").unwrap();
+
+        GG_PUBLISH_COUNT.with(|rc| assert_eq!(*rc.borrow(), 3));
+        GG_CLOSE_REQUEST_COUNT.with(|rc| assert_eq!(*rc.borrow(), 3));
+        assert_eq!(policy.stats().retries, 2);
+        assert_eq!(policy.stats().give_ups, 0);
+
+        // without a policy the throttled response is returned
+        GG_PUBLISH_RESPONSES.with(|rc| rc.replace(vec![throttled.clone()]));
+        let result = IOTDataClient::default().publish("retry_topic", "payload");
+        match result {
+            Err(GGError::ErrorResponse(resp)) => {
+                assert_eq!(resp.request_status, GGRequestStatus::Again)
+            }
+            _ => panic!("expected a throttled error response"),
+        }
+    }
+
+    #[cfg(not(feature = "mock"))]
+    #[test]
+    fn test_publish_rate_limited() {
+        reset_test_state();
+        // slow enough that the bucket can't refill between publishes
+        let limiter =
+            RateLimiter::default().with_topic_limit("limited", Some(RateLimit::new(4.0, 2)));
+        let client = IOTDataClient::default().with_rate_limiter(Some(limiter.clone()));
+        for _ in 0..3 {
+            client.publish("limited", "payload").unwrap();
+            client.publish("unlimited", "payload").unwrap();
+        }
+        let stats = limiter.stats();
+        assert_eq!(stats.permitted, 6);
+        assert_eq!(stats.delayed, 1);
+        GG_PUBLISH_COUNT.with(|rc| assert_eq!(*rc.borrow(), 6));
+    }
+
+    #[cfg(not(feature = "mock"))]
+    #[test]
+    fn test_publish_retries_are_rate_limited() {
+        reset_test_state();
+        let throttled = (
+            gg_request_status_GG_REQUEST_AGAIN,
+            br#"{"code": 429, "message": "queue full", "timestamp": 0}"#.to_vec(),
+        );
+        GG_PUBLISH_RESPONSES.with(|rc| {
+            rc.replace(vec![
+                (gg_request_status_GG_REQUEST_SUCCESS, vec![]),
+                throttled.clone(),
+            ])
+        });
+        let limiter = RateLimiter::default().with_client_limit(Some(RateLimit::new(1.0, 10)));
+        let client = IOTDataClient::default()
+            .with_rate_limiter(Some(limiter.clone()))
+            .with_retry_policy(Some(
+                RetryPolicy::default().with_base_delay(Duration::from_millis(1)),
+            ));
+        client.publish("retry_topic", "payload").unwrap();
+
+        GG_PUBLISH_COUNT.with(|rc| assert_eq!(*rc.borrow(), 2));
+        assert_eq!(limiter.stats().permitted, 2);
+    }
+
+    #[cfg(not(feature = "mock"))]
+    #[test]
+    fn test_publish_async() {
+        let result = futures::executor::block_on(
+            IOTDataClient::default().publish_async("my_async_topic", b"async payload".to_vec()),
+        );
+        assert!(result.is_ok());
+    }
+
     #[cfg(not(feature = "mock"))]
     #[test]
     fn test_publish_with_options() {
@@ -347,6 +752,8 @@ mod test {
             PublishOptions::default().with_queue_full_policy(QueueFullPolicy::AllOrError);
         let client = IOTDataClient::default().with_publish_options(Some(publish_options));
         client.publish_json(topic, my_payload.clone()).unwrap();
+        // the options are freed when the client is dropped
+        drop(client);
 
         GG_PUBLISH_WITH_OPTIONS_ARGS.with(|rc| {
             let args = rc.borrow();
@@ -366,4 +773,45 @@ mod test {
             )
         });
     }
+
+    #[cfg(not(feature = "mock"))]
+    #[test]
+    fn test_publish_options_created_once() {
+        reset_test_state();
+        let publish_options =
+            PublishOptions::default().with_queue_full_policy(QueueFullPolicy::AllOrError);
+        let client = IOTDataClient::default().with_publish_options(Some(publish_options));
+        let cloned = client.clone();
+        for _ in 0..3 {
+            client.publish("options_topic", "payload").unwrap();
+            cloned.publish("options_topic", "payload").unwrap();
+        }
+        GG_PUBLISH_OPTION_INIT_COUNT.with(|rc| assert_eq!(*rc.borrow(), 1));
+
+        drop(client);
+        GG_PUBLISH_OPTION_FREE_COUNT.with(|rc| assert_eq!(*rc.borrow(), 0));
+        drop(cloned);
+        GG_PUBLISH_OPTION_FREE_COUNT.with(|rc| assert_eq!(*rc.borrow(), 1));
+    }
+
+    #[cfg(not(feature = "mock"))]
+    #[test]
+    fn test_publish_options_modified() {
+        reset_test_state();
+        let mut client =
+            IOTDataClient::default().with_publish_options(Some(PublishOptions::default()));
+        client.publish("options_topic", "payload").unwrap();
+        client.publish_options =
+            Some(PublishOptions::default().with_queue_full_policy(QueueFullPolicy::AllOrError));
+        client.publish("options_topic", "payload").unwrap();
+
+        GG_PUBLISH_OPTIONS_SET_QUEUE_FULL_POLICY.with(|rc| {
+            assert_eq!(
+                *rc.borrow(),
+                gg_queue_full_policy_options_GG_QUEUE_FULL_POLICY_ALL_OR_ERROR
+            )
+        });
+        GG_PUBLISH_OPTION_INIT_COUNT.with(|rc| assert_eq!(*rc.borrow(), 2));
+        GG_PUBLISH_OPTION_FREE_COUNT.with(|rc| assert_eq!(*rc.borrow(), 1));
+    }
 }
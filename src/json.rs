@@ -0,0 +1,104 @@
+/*
+ * Copyright 2020-present, Nike, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the Apache-2.0 license found in
+ * the LICENSE file in the root of this source tree.
+ */
+
+//! Provides the JSON helpers used for partial and coalesced shadow updates.
+//!
+//! Shadow updates follow JSON merge patch semantics: objects are merged key by key, a null removes a key
+//! and any other value (including arrays) replaces the existing value.
+use serde_json::{Map, Value};
+
+/// Computes the patch that turns old into new, or None if they are equal.
+/// Keys missing from new are set to null so that they are removed.
+pub(crate) fn diff(old: &Value, new: &Value) -> Option<Value> {
+    match (old, new) {
+        (Value::Object(old), Value::Object(new)) => {
+            let mut patch = Map::new();
+            for (key, new_value) in new {
+                let changed = match old.get(key) {
+                    Some(old_value) => diff(old_value, new_value),
+                    None => Some(new_value.clone()),
+                };
+                if let Some(changed) = changed {
+                    patch.insert(key.clone(), changed);
+                }
+            }
+            for key in old.keys() {
+                if !new.contains_key(key) {
+                    patch.insert(key.clone(), Value::Null);
+                }
+            }
+            if patch.is_empty() {
+                None
+            } else {
+                Some(Value::Object(patch))
+            }
+        }
+        _ if old == new => None,
+        _ => Some(new.clone()),
+    }
+}
+
+/// Merges a patch into another patch, so that applying the result is the same as applying both in order.
+/// Objects are merged recursively and any other value, including null, replaces the existing value.
+/// The one difference is a key removed with null and then set to an object: the merged patch sets the object's
+/// keys without first removing the key's other keys.
+pub(crate) fn merge_patch(pending: &mut Value, patch: Value) {
+    match (pending, patch) {
+        (Value::Object(pending), Value::Object(patch)) => {
+            for (key, value) in patch {
+                match pending.get_mut(&key) {
+                    Some(existing) if existing.is_object() && value.is_object() => {
+                        merge_patch(existing, value)
+                    }
+                    _ => {
+                        pending.insert(key, value);
+                    }
+                }
+            }
+        }
+        (pending, patch) => *pending = patch,
+    }
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+    use serde_json::json;
+
+    #[test]
+    fn test_diff() {
+        let old = json!({"state": {"reported": {"temp": 20, "humidity": 40, "fan": {"speed": 1, "on": true}}}});
+        let new = json!({"state": {"reported": {"temp": 21, "fan": {"speed": 1, "on": false}, "door": "open"}}});
+        assert_eq!(
+            diff(&old, &new),
+            Some(
+                json!({"state": {"reported": {"temp": 21, "humidity": null, "fan": {"on": false}, "door": "open"}}})
+            )
+        );
+        assert_eq!(diff(&old, &old), None);
+        // arrays are replaced as a whole
+        assert_eq!(
+            diff(&json!({"a": [1, 2]}), &json!({"a": [1, 3]})),
+            Some(json!({"a": [1, 3]}))
+        );
+    }
+
+    #[test]
+    fn test_merge_patch() {
+        let mut pending = json!({"fan": {"speed": 1, "on": true}, "temp": 20, "door": "open"});
+        merge_patch(
+            &mut pending,
+            json!({"fan": {"on": false}, "temp": null, "door": {"locked": true}}),
+        );
+        // later values win, and nulls are kept so the removals are still sent
+        assert_eq!(
+            pending,
+            json!({"fan": {"speed": 1, "on": false}, "temp": null, "door": {"locked": true}})
+        );
+    }
+}
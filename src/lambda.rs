@@ -5,7 +5,7 @@
  * This source code is licensed under the Apache-2.0 license found in
  * the LICENSE file in the root of this source tree.
  */
- 
+
 use base64::encode;
 use serde::Serialize;
 use serde_json;
@@ -14,12 +14,23 @@ use std::default::Default;
 use std::ffi::CString;
 use std::os::raw::c_void;
 use std::ptr;
+#[cfg(not(all(test, feature = "mock")))]
+use std::{
+    collections::{HashMap, VecDeque},
+    panic::{self, AssertUnwindSafe},
+    time::{Duration, Instant},
+};
 
 use crate::bindings::*;
+#[cfg(not(all(test, feature = "mock")))]
+use crate::blocking::{self, BlockingFuture, BlockingPool};
 use crate::error::GGError;
-use crate::request::GGRequestResponse;
+use crate::request::{GGRequestResponse, ResponseReader};
+use crate::retry::{retry, RetryOnce, RetryPolicy};
 use crate::with_request;
 use crate::GGResult;
+#[cfg(not(all(test, feature = "mock")))]
+use crossbeam_channel::{unbounded, Receiver, RecvTimeoutError, Sender};
 
 #[cfg(all(test, feature = "mock"))]
 use self::mock::*;
@@ -51,8 +62,97 @@ impl<C: Serialize> InvokeOptions<C> {
     }
 }
 
+/// [`InvokeOptions`] with the function arn, qualifier and customer context encoded once into the NUL terminated
+/// strings the C SDK expects, so they can be reused for any number of invocations without being encoded again.
+///
+/// # Example
+/// ```rust
+/// use aws_greengrass_core_rust::lambda::{InvokeOptions, LambdaClient, PreparedInvokeOptions};
+///
+/// let options = InvokeOptions::new("my_func_arn".to_owned(), (), "lambda qualifier".to_owned());
+/// let prepared = PreparedInvokeOptions::new(&options).unwrap();
+/// let client = LambdaClient::default();
+/// for payload in &["one", "two", "three"] {
+///     let result = client.invoke_async_prepared(&prepared, Some(payload));
+/// }
+/// ```
+#[derive(Clone, Debug)]
+pub struct PreparedInvokeOptions {
+    function_arn: CString,
+    /// base64 json string
+    customer_context: CString,
+    qualifier: CString,
+}
+
+impl PreparedInvokeOptions {
+    /// Encodes the options
+    pub fn new<C: Serialize>(options: &InvokeOptions<C>) -> GGResult<Self> {
+        Ok(PreparedInvokeOptions {
+            function_arn: CString::new(options.function_arn.as_str()).map_err(GGError::from)?,
+            customer_context: CString::new(options.serialize_customer_context()?)
+                .map_err(GGError::from)?,
+            qualifier: CString::new(options.qualifier.as_str()).map_err(GGError::from)?,
+        })
+    }
+
+    /// The full ARN of the lambda
+    pub fn function_arn(&self) -> &str {
+        // created from a String so it is valid utf8
+        self.function_arn.to_str().unwrap_or_default()
+    }
+
+    /// Version number of the lambda function
+    pub fn qualifier(&self) -> &str {
+        self.qualifier.to_str().unwrap_or_default()
+    }
+}
+
+impl<C: Serialize> TryFrom<&InvokeOptions<C>> for PreparedInvokeOptions {
+    type Error = GGError;
+
+    fn try_from(options: &InvokeOptions<C>) -> Result<Self, Self::Error> {
+        PreparedInvokeOptions::new(options)
+    }
+}
+
+/// A request response invocation made by [`LambdaClient::invoke_many`]
+#[cfg(not(all(test, feature = "mock")))]
+pub struct Invocation<C: Serialize, P: AsRef<[u8]>> {
+    pub options: InvokeOptions<C>,
+    pub payload: Option<P>,
+    /// If defined, the invocation fails with `GGError::Timeout` if it hasn't completed this long after it started
+    pub deadline: Option<Duration>,
+}
+
+#[cfg(not(all(test, feature = "mock")))]
+impl<C: Serialize, P: AsRef<[u8]>> Invocation<C, P> {
+    pub fn new(options: InvokeOptions<C>, payload: Option<P>) -> Self {
+        Invocation {
+            options,
+            payload,
+            deadline: None,
+        }
+    }
+
+    /// The time after which the invocation fails with `GGError::Timeout`
+    pub fn with_deadline(self, deadline: Option<Duration>) -> Self {
+        Invocation { deadline, ..self }
+    }
+}
+
+/// The response of one of the invocations made by [`LambdaClient::invoke_many`]
+#[cfg(not(all(test, feature = "mock")))]
+#[derive(Debug)]
+pub struct InvocationResult {
+    /// The position of the invocation in the invocations passed to invoke_many
+    pub index: usize,
+    pub result: GGResult<Option<Vec<u8>>>,
+}
+
 /// Provides the ability to execute other lambda functions
 pub struct LambdaClient {
+    /// The policy used to retry invocations that greengrass throttled, if one has been defined
+    pub retry_policy: Option<RetryPolicy>,
     #[cfg(all(test, feature = "mock"))]
     pub mocks: MockHolder,
 }
@@ -78,13 +178,53 @@ impl LambdaClient {
     /// let response = LambdaClient::default().invoke_sync(options, Some(payload));
     /// println!("response: {:?}", response);
     /// ```
-    #[cfg(not(feature = "mock"))]
+    #[cfg(not(all(test, feature = "mock")))]
     pub fn invoke_sync<C: Serialize, P: AsRef<[u8]>>(
         &self,
         option: InvokeOptions<C>,
         payload: Option<P>,
     ) -> GGResult<Option<Vec<u8>>> {
-        invoke(&option, InvokeType::InvokeRequestResponse, &payload)
+        invoke(
+            &option,
+            InvokeType::InvokeRequestResponse,
+            &payload,
+            &self.retry_policy,
+        )
+    }
+
+    /// Allows lambda invocation with an optional payload and wait for a response.
+    /// A reader over the response is passed to the specified function, which allows large responses
+    /// to be read into storage owned by the caller without intermediate copies.
+    ///
+    /// # Example
+    /// ```rust
+    /// use aws_greengrass_core_rust::lambda::LambdaClient;
+    /// use aws_greengrass_core_rust::lambda::InvokeOptions;
+    ///
+    /// let options = InvokeOptions::new("my_func_arn".to_owned(), (), "lambda qualifier".to_owned());
+    /// let mut response = Vec::with_capacity(1024 * 1024);
+    /// let result = LambdaClient::default()
+    ///     .invoke_sync_with(options, Some("Some payload"), |reader| reader.read_into(&mut response));
+    /// ```
+    #[cfg(not(all(test, feature = "mock")))]
+    pub fn invoke_sync_with<C, P, R, F>(
+        &self,
+        option: InvokeOptions<C>,
+        payload: Option<P>,
+        f: F,
+    ) -> GGResult<Option<R>>
+    where
+        C: Serialize,
+        P: AsRef<[u8]>,
+        F: FnOnce(&mut ResponseReader) -> GGResult<R>,
+    {
+        invoke_with(
+            &option,
+            InvokeType::InvokeRequestResponse,
+            &payload,
+            &self.retry_policy,
+            f,
+        )
     }
 
     /// Allows lambda invocation with an optional payload. The lambda will be executed asynchronously and no response will be returned
@@ -108,19 +248,189 @@ impl LambdaClient {
     ///     eprintln!("Error occurred: {}", e);
     /// }
     /// ```
-    #[cfg(not(feature = "mock"))]
+    #[cfg(not(all(test, feature = "mock")))]
     pub fn invoke_async<C: Serialize, P: AsRef<[u8]>>(
         &self,
         option: InvokeOptions<C>,
         payload: Option<P>,
     ) -> GGResult<()> {
-        invoke(&option, InvokeType::InvokeEvent, &payload).map(|_| ())
+        invoke(
+            &option,
+            InvokeType::InvokeEvent,
+            &payload,
+            &self.retry_policy,
+        )
+        .map(|_| ())
+    }
+
+    /// Same as [`LambdaClient::invoke_sync`] with options that were encoded ahead of time.
+    /// See [`PreparedInvokeOptions`]
+    #[cfg(not(all(test, feature = "mock")))]
+    pub fn invoke_sync_prepared<P: AsRef<[u8]>>(
+        &self,
+        option: &PreparedInvokeOptions,
+        payload: Option<P>,
+    ) -> GGResult<Option<Vec<u8>>> {
+        invoke_prepared(
+            option,
+            InvokeType::InvokeRequestResponse,
+            &payload,
+            &self.retry_policy,
+        )
+    }
+
+    /// Same as [`LambdaClient::invoke_sync_with`] with options that were encoded ahead of time.
+    /// Along with a reused response buffer, this makes invocations without any allocations on the Rust side.
+    /// See [`PreparedInvokeOptions`]
+    #[cfg(not(all(test, feature = "mock")))]
+    pub fn invoke_sync_prepared_with<P, R, F>(
+        &self,
+        option: &PreparedInvokeOptions,
+        payload: Option<P>,
+        f: F,
+    ) -> GGResult<Option<R>>
+    where
+        P: AsRef<[u8]>,
+        F: FnOnce(&mut ResponseReader) -> GGResult<R>,
+    {
+        invoke_prepared_with(
+            option,
+            InvokeType::InvokeRequestResponse,
+            &payload,
+            &self.retry_policy,
+            f,
+        )
+    }
+
+    /// Same as [`LambdaClient::invoke_async`] with options that were encoded ahead of time.
+    /// See [`PreparedInvokeOptions`]
+    #[cfg(not(all(test, feature = "mock")))]
+    pub fn invoke_async_prepared<P: AsRef<[u8]>>(
+        &self,
+        option: &PreparedInvokeOptions,
+        payload: Option<P>,
+    ) -> GGResult<()> {
+        invoke_prepared(
+            option,
+            InvokeType::InvokeEvent,
+            &payload,
+            &self.retry_policy,
+        )
+        .map(|_| ())
+    }
+
+    /// Same as [`LambdaClient::invoke_sync`], but the invocation runs on the blocking pool so it
+    /// can be awaited without blocking the executor. See [`crate::blocking`]
+    #[cfg(not(all(test, feature = "mock")))]
+    pub fn invoke_sync_future<C, P>(
+        &self,
+        option: InvokeOptions<C>,
+        payload: Option<P>,
+    ) -> BlockingFuture<Option<Vec<u8>>>
+    where
+        C: Serialize + Send + 'static,
+        P: AsRef<[u8]> + Send + 'static,
+    {
+        let retry_policy = self.retry_policy.clone();
+        blocking::spawn(move || {
+            invoke(
+                &option,
+                InvokeType::InvokeRequestResponse,
+                &payload,
+                &retry_policy,
+            )
+        })
+    }
+
+    /// Same as [`LambdaClient::invoke_async`], but the invocation runs on the blocking pool so it
+    /// can be awaited without blocking the executor. See [`crate::blocking`]
+    #[cfg(not(all(test, feature = "mock")))]
+    pub fn invoke_async_future<C, P>(
+        &self,
+        option: InvokeOptions<C>,
+        payload: Option<P>,
+    ) -> BlockingFuture<()>
+    where
+        C: Serialize + Send + 'static,
+        P: AsRef<[u8]> + Send + 'static,
+    {
+        let retry_policy = self.retry_policy.clone();
+        blocking::spawn(move || {
+            invoke(&option, InvokeType::InvokeEvent, &payload, &retry_policy).map(|_| ())
+        })
+    }
+
+    /// Invokes the lambdas, waiting for their responses, with up to max_in_flight invocations running at once.
+    /// The returned iterator blocks until the next invocation completes, returning the responses in the order
+    /// they complete. Each response is tagged with the index of its invocation.
+    ///
+    /// The invocations run on the blocking pool, so no more than its threads run at once. See [`crate::blocking`]
+    ///
+    /// An invocation that passes its deadline is returned as a `GGError::Timeout`. The C SDK call can't be cancelled,
+    /// so it carries on in the background, still counting towards max_in_flight, and its response is discarded.
+    ///
+    /// # Example
+    /// ```rust
+    /// use aws_greengrass_core_rust::lambda::{Invocation, InvokeOptions, LambdaClient};
+    /// use std::time::Duration;
+    ///
+    /// let invocations = (0..20).map(|i| {
+    ///     let options = InvokeOptions::new(format!("my_func_arn_{}", i), (), "lambda qualifier".to_owned());
+    ///     Invocation::new(options, Some("Some payload")).with_deadline(Some(Duration::from_secs(1)))
+    /// });
+    /// for response in LambdaClient::default().invoke_many(invocations, 8) {
+    ///     println!("invocation {} responded: {:?}", response.index, response.result);
+    /// }
+    /// ```
+    #[cfg(not(all(test, feature = "mock")))]
+    pub fn invoke_many<C, P, I>(&self, invocations: I, max_in_flight: usize) -> InvokeMany
+    where
+        C: Serialize + Send + 'static,
+        P: AsRef<[u8]> + Send + 'static,
+        I: IntoIterator<Item = Invocation<C, P>>,
+    {
+        let calls = invocations
+            .into_iter()
+            .enumerate()
+            .map(|(index, invocation)| {
+                let retry_policy = self.retry_policy.clone();
+                let deadline = invocation.deadline;
+                let job: InvokeJob = Box::new(move || {
+                    invoke(
+                        &invocation.options,
+                        InvokeType::InvokeRequestResponse,
+                        &invocation.payload,
+                        &retry_policy,
+                    )
+                });
+                (index, deadline, job)
+            })
+            .collect();
+        InvokeMany::new(calls, max_in_flight, blocking::pool())
+    }
+
+    /// Same as [`LambdaClient::invoke_many`], but returns a future that can be awaited without blocking the executor.
+    /// The responses are in the order they completed. The responses are waited for on a thread of its own, so a
+    /// blocking pool thread is only taken up by each running invocation. See [`crate::blocking`]
+    #[cfg(not(all(test, feature = "mock")))]
+    pub fn invoke_many_future<C, P, I>(
+        &self,
+        invocations: I,
+        max_in_flight: usize,
+    ) -> BlockingFuture<Vec<InvocationResult>>
+    where
+        C: Serialize + Send + 'static,
+        P: AsRef<[u8]> + Send + 'static,
+        I: IntoIterator<Item = Invocation<C, P>>,
+    {
+        let responses = self.invoke_many(invocations, max_in_flight);
+        blocking::spawn_thread("gg-invoke-many", move || Ok(responses.collect()))
     }
 
     /// Allows lambda functions that have been invoked by another lambda to send a response back
     /// On success send Ok(P)
     /// On Error send Err(String)
-    #[cfg(not(feature = "mock"))]
+    #[cfg(not(all(test, feature = "mock")))]
     pub fn send_response(&self, result: Result<&[u8], &str>) -> GGResult<()> {
         unsafe {
             match result {
@@ -130,6 +440,14 @@ impl LambdaClient {
         }
     }
 
+    /// Optionally retry invocations that greengrass throttled. See [`crate::retry`]
+    pub fn with_retry_policy(self, retry_policy: Option<RetryPolicy>) -> Self {
+        LambdaClient {
+            retry_policy,
+            ..self
+        }
+    }
+
     // -----------------------------------
     // Mock methods
     // -----------------------------------
@@ -200,6 +518,7 @@ impl LambdaClient {
 impl Default for LambdaClient {
     fn default() -> Self {
         LambdaClient {
+            retry_policy: None,
             #[cfg(all(test, feature = "mock"))]
             mocks: MockHolder::default(),
         }
@@ -246,36 +565,83 @@ fn invoke<C: Serialize, P: AsRef<[u8]>>(
     option: &InvokeOptions<C>,
     invoke_type: InvokeType,
     payload: &Option<P>,
+    retry_policy: &Option<RetryPolicy>,
 ) -> GGResult<Option<Vec<u8>>> {
-    unsafe {
-        let function_arn_c = CString::new(option.function_arn.as_str()).map_err(GGError::from)?;
-        let customer_context_c =
-            CString::new(option.serialize_customer_context()?).map_err(GGError::from)?;
-        let qualifier_c = CString::new(option.qualifier.as_str()).map_err(GGError::from)?;
-        let payload_bytes = payload.as_ref().map(|p| p.as_ref());
-        let (payload_c, payload_size) = if let Some(p) = payload_bytes {
-            (p as *const _ as *const c_void, p.len())
-        } else {
-            (ptr::null(), 0)
-        };
+    invoke_with(option, invoke_type, payload, retry_policy, |reader| {
+        let mut data = Vec::new();
+        reader.read_into(&mut data)?;
+        Ok(data)
+    })
+}
 
-        let options_c = Box::new(gg_invoke_options {
-            function_arn: function_arn_c.as_ptr(),
-            customer_context: customer_context_c.as_ptr(),
-            qualifier: qualifier_c.as_ptr(),
-            type_: invoke_type.as_c_invoke_type(),
-            payload: payload_c,
-            payload_size,
-        });
+/// Invokes the lambda and, for request response invocations, passes a reader over the response to f
+fn invoke_with<C, P, R, F>(
+    option: &InvokeOptions<C>,
+    invoke_type: InvokeType,
+    payload: &Option<P>,
+    retry_policy: &Option<RetryPolicy>,
+    f: F,
+) -> GGResult<Option<R>>
+where
+    C: Serialize,
+    P: AsRef<[u8]>,
+    F: FnOnce(&mut ResponseReader) -> GGResult<R>,
+{
+    let prepared = PreparedInvokeOptions::new(option)?;
+    invoke_prepared_with(&prepared, invoke_type, payload, retry_policy, f)
+}
+
+fn invoke_prepared<P: AsRef<[u8]>>(
+    option: &PreparedInvokeOptions,
+    invoke_type: InvokeType,
+    payload: &Option<P>,
+    retry_policy: &Option<RetryPolicy>,
+) -> GGResult<Option<Vec<u8>>> {
+    invoke_prepared_with(option, invoke_type, payload, retry_policy, |reader| {
+        let mut data = Vec::new();
+        reader.read_into(&mut data)?;
+        Ok(data)
+    })
+}
 
+/// Same as [`invoke_with`] with options that have already been encoded
+fn invoke_prepared_with<P, R, F>(
+    option: &PreparedInvokeOptions,
+    invoke_type: InvokeType,
+    payload: &Option<P>,
+    retry_policy: &Option<RetryPolicy>,
+    f: F,
+) -> GGResult<Option<R>>
+where
+    P: AsRef<[u8]>,
+    F: FnOnce(&mut ResponseReader) -> GGResult<R>,
+{
+    let payload_bytes = payload.as_ref().map(|p| p.as_ref());
+    let (payload_c, payload_size) = if let Some(p) = payload_bytes {
+        (p as *const _ as *const c_void, p.len())
+    } else {
+        (ptr::null(), 0)
+    };
+    // the options only borrow the prepared strings and payload, so they can live on the stack
+    let options_c = gg_invoke_options {
+        function_arn: option.function_arn.as_ptr(),
+        customer_context: option.customer_context.as_ptr(),
+        qualifier: option.qualifier.as_ptr(),
+        type_: invoke_type.as_c_invoke_type(),
+        payload: payload_c,
+        payload_size,
+    };
+    let invoke_type = &invoke_type;
+    let f = RetryOnce::new(f);
+    let f = &f;
+
+    retry(retry_policy, || unsafe {
         let mut req: gg_request = ptr::null_mut();
         with_request!(req, {
             let mut res = gg_request_result {
                 request_status: gg_request_status_GG_REQUEST_SUCCESS,
             };
-            let raw_options = Box::into_raw(options_c);
-            let invoke_res = gg_invoke(req, raw_options, &mut res);
-            let _ = Box::from_raw(raw_options); // cleanup
+            let invoke_res = gg_invoke(req, &options_c, &mut res);
             GGError::from_code(invoke_res)?;
 
             match invoke_type {
@@ -283,9 +649,139 @@ fn invoke<C: Serialize, P: AsRef<[u8]>>(
                     GGRequestResponse::try_from(&res)?.to_error_result(req)?;
                     Ok(None)
                 }
-                InvokeType::InvokeRequestResponse => GGRequestResponse::try_from(&res)?.read(req),
+                InvokeType::InvokeRequestResponse => {
+                    GGRequestResponse::try_from(&res)?.read_with(req, |reader| f.call(reader))
+                }
             }
         })
+    })
+}
+
+#[cfg(not(all(test, feature = "mock")))]
+type InvokeJob = Box<dyn FnOnce() -> GGResult<Option<Vec<u8>>> + Send>;
+
+/// The responses of [`LambdaClient::invoke_many`], in the order the invocations complete
+#[cfg(not(all(test, feature = "mock")))]
+pub struct InvokeMany {
+    queued: VecDeque<(usize, Option<Duration>, InvokeJob)>,
+    /// The invocations running, including the ones that have already been returned as timed out
+    in_flight: HashMap<usize, InFlight>,
+    max_in_flight: usize,
+    pool: &'static BlockingPool,
+    sender: Sender<(usize, GGResult<Option<Vec<u8>>>)>,
+    receiver: Receiver<(usize, GGResult<Option<Vec<u8>>>)>,
+}
+
+#[cfg(not(all(test, feature = "mock")))]
+struct InFlight {
+    deadline: Option<Instant>,
+    timed_out: bool,
+}
+
+#[cfg(not(all(test, feature = "mock")))]
+impl InvokeMany {
+    fn new(
+        calls: VecDeque<(usize, Option<Duration>, InvokeJob)>,
+        max_in_flight: usize,
+        pool: &'static BlockingPool,
+    ) -> Self {
+        let (sender, receiver) = unbounded();
+        InvokeMany {
+            queued: calls,
+            in_flight: HashMap::new(),
+            max_in_flight: max_in_flight.max(1),
+            pool,
+            sender,
+            receiver,
+        }
+    }
+
+    /// Starts queued invocations until max_in_flight are running
+    fn start_invocations(&mut self) {
+        while self.in_flight.len() < self.max_in_flight {
+            let (index, deadline, job) = match self.queued.pop_front() {
+                Some(call) => call,
+                None => return,
+            };
+            self.in_flight.insert(
+                index,
+                InFlight {
+                    deadline: deadline.map(|deadline| Instant::now() + deadline),
+                    timed_out: false,
+                },
+            );
+            let sender = self.sender.clone();
+            // the response is sent from within the job, so the pool's future isn't needed
+            self.pool.spawn(move || {
+                let result = panic::catch_unwind(AssertUnwindSafe(job)).unwrap_or_else(|_| {
+                    Err(GGError::Unknown("Lambda invocation panicked".to_owned()))
+                });
+                // the receiver is gone if the responses were dropped, in which case there is no one to tell
+                let _ = sender.send((index, result));
+                Ok(())
+            });
+        }
+    }
+
+    /// The earliest deadline of the running invocations that haven't timed out
+    fn next_deadline(&self) -> Option<(Instant, usize)> {
+        self.in_flight
+            .iter()
+            .filter(|(_, call)| !call.timed_out)
+            .filter_map(|(index, call)| call.deadline.map(|deadline| (deadline, *index)))
+            .min()
+    }
+
+    /// True while there are responses that haven't been returned
+    fn has_pending(&self) -> bool {
+        !self.queued.is_empty() || self.in_flight.values().any(|call| !call.timed_out)
+    }
+}
+
+#[cfg(not(all(test, feature = "mock")))]
+impl Iterator for InvokeMany {
+    type Item = InvocationResult;
+
+    fn next(&mut self) -> Option<Self::Item> {
+        self.start_invocations();
+        while self.has_pending() {
+            let next_deadline = self.next_deadline();
+            let received = match next_deadline {
+                Some((deadline, _)) => self
+                    .receiver
+                    .recv_timeout(deadline.saturating_duration_since(Instant::now())),
+                None => self
+                    .receiver
+                    .recv()
+                    .map_err(|_| RecvTimeoutError::Disconnected),
+            };
+            let (index, result) = match (received, next_deadline) {
+                (Ok(response), _) => response,
+                (Err(RecvTimeoutError::Timeout), Some((_, index))) => {
+                    // the call still holds its slot until it returns
+                    if let Some(call) = self.in_flight.get_mut(&index) {
+                        call.timed_out = true;
+                    }
+                    return Some(InvocationResult {
+                        index,
+                        result: Err(GGError::Timeout),
+                    });
+                }
+                // a sender is held, so this can't happen
+                (Err(_), _) => return None,
+            };
+            let timed_out = self
+                .in_flight
+                .remove(&index)
+                .map(|call| call.timed_out)
+                .unwrap_or(true);
+            self.start_invocations();
+            // responses that arrive after their deadline have already been returned as timeouts
+            if !timed_out {
+                return Some(InvocationResult { index, result });
+            }
+        }
+        None
     }
 }
 
@@ -393,6 +889,8 @@ pub mod mock {
 mod test {
     use super::*;
     use serde::Deserialize;
+    #[cfg(not(feature = "mock"))]
+    use std::thread;
 
     #[derive(Serialize, Deserialize, Clone)]
     struct TestContext {
@@ -525,4 +1023,173 @@ mod test {
             assert_eq!(*rc.borrow(), my_err_response);
         });
     }
+
+    /// A pool of its own, so the invocations aren't held up by other tests using the blocking pool
+    #[cfg(not(feature = "mock"))]
+    fn test_pool() -> &'static BlockingPool {
+        lazy_static::lazy_static! {
+            static ref POOL: BlockingPool = BlockingPool::new(8);
+        }
+        &POOL
+    }
+
+    #[cfg(not(feature = "mock"))]
+    fn sleeping_job(millis: u64) -> InvokeJob {
+        Box::new(move || {
+            thread::sleep(Duration::from_millis(millis));
+            Ok(Some(millis.to_string().into_bytes()))
+        })
+    }
+
+    #[test]
+    #[cfg(not(feature = "mock"))]
+    fn test_invoke_many_completion_order() {
+        let calls = vec![
+            (0, None, sleeping_job(60)),
+            (1, None, sleeping_job(0)),
+            (2, None, sleeping_job(30)),
+        ];
+        let order: Vec<usize> = InvokeMany::new(calls.into_iter().collect(), 3, test_pool())
+            .map(|response| {
+                assert!(response.result.is_ok());
+                response.index
+            })
+            .collect();
+        assert_eq!(order, vec![1, 2, 0]);
+    }
+
+    #[test]
+    #[cfg(not(feature = "mock"))]
+    fn test_invoke_many_max_in_flight() {
+        use std::sync::atomic::{AtomicUsize, Ordering};
+        use std::sync::Arc;
+
+        let running = Arc::new(AtomicUsize::new(0));
+        let max_running = Arc::new(AtomicUsize::new(0));
+        let calls = (0..8)
+            .map(|index| {
+                let running = Arc::clone(&running);
+                let max_running = Arc::clone(&max_running);
+                let job: InvokeJob = Box::new(move || {
+                    let now = running.fetch_add(1, Ordering::SeqCst) + 1;
+                    max_running.fetch_max(now, Ordering::SeqCst);
+                    thread::sleep(Duration::from_millis(10));
+                    running.fetch_sub(1, Ordering::SeqCst);
+                    Ok(None)
+                });
+                (index, None, job)
+            })
+            .collect();
+        assert_eq!(InvokeMany::new(calls, 3, test_pool()).count(), 8);
+        assert_eq!(max_running.load(Ordering::SeqCst), 3);
+    }
+
+    #[test]
+    #[cfg(not(feature = "mock"))]
+    fn test_invoke_many_deadline() {
+        let calls = vec![
+            (0, Some(Duration::from_millis(20)), sleeping_job(200)),
+            (1, Some(Duration::from_secs(5)), sleeping_job(50)),
+            (2, Some(Duration::from_millis(20)), sleeping_job(200)),
+        ];
+        let start = Instant::now();
+        let mut responses = InvokeMany::new(calls.into_iter().collect(), 1, test_pool());
+        let response = responses.next().unwrap();
+        assert_eq!(response.index, 0);
+        match response.result {
+            Err(GGError::Timeout) => (),
+            ref other => panic!("Expected a timeout, got {:?}", other),
+        }
+        assert!(start.elapsed() < Duration::from_millis(200));
+
+        // the timed out call holds the only slot until it returns
+        let response = responses.next().unwrap();
+        assert_eq!(response.index, 1);
+        assert_eq!(response.result.unwrap(), Some(b"50".to_vec()));
+        assert!(start.elapsed() >= Duration::from_millis(250));
+
+        // the last response doesn't wait for its timed out call to return
+        let response = responses.next().unwrap();
+        assert_eq!(response.index, 2);
+        assert!(response.result.is_err());
+        assert!(responses.next().is_none());
+        assert!(start.elapsed() < Duration::from_millis(450));
+    }
+
+    #[test]
+    #[cfg(not(feature = "mock"))]
+    fn test_invoke_many() {
+        let invocations = (0..4).map(|i| {
+            let options = InvokeOptions::new(format!("function_arn_{}", i), (), "1".to_owned());
+            Invocation::new(options, Some(vec![i as u8]))
+        });
+        let mut indexes: Vec<usize> = LambdaClient::default()
+            .invoke_many(invocations, 2)
+            .map(|response| {
+                assert!(response.result.is_ok());
+                response.index
+            })
+            .collect();
+        indexes.sort();
+        assert_eq!(indexes, vec![0, 1, 2, 3]);
+    }
+
+    #[test]
+    #[cfg(not(feature = "mock"))]
+    fn test_invoke_many_future() {
+        let invocations = (0..4).map(|i| {
+            let options = InvokeOptions::new(format!("function_arn_{}", i), (), "1".to_owned());
+            Invocation::new(options, Some(vec![i as u8]))
+        });
+        let responses =
+            futures::executor::block_on(LambdaClient::default().invoke_many_future(invocations, 2))
+                .unwrap();
+        assert_eq!(responses.len(), 4);
+        assert!(responses.iter().all(|response| response.result.is_ok()));
+    }
+
+    #[test]
+    #[cfg(not(feature = "mock"))]
+    fn test_invoke_prepared() {
+        reset_test_state();
+        let context = TestContext {
+            foo: "prepared".to_string(),
+        };
+        let options = InvokeOptions::new(
+            "function_arn_prepared".to_owned(),
+            context.clone(),
+            "7".to_owned(),
+        );
+        let prepared = PreparedInvokeOptions::try_from(&options).unwrap();
+        assert_eq!(prepared.function_arn(), "function_arn_prepared");
+        assert_eq!(prepared.qualifier(), "7");
+
+        let client = LambdaClient::default();
+        for payload in &[b"first".to_vec(), b"second".to_vec()] {
+            client
+                .invoke_async_prepared(&prepared, Some(payload))
+                .unwrap();
+            GG_INVOKE_ARGS.with(|rc| {
+                let args = rc.borrow();
+                assert_eq!(args.function_arn, "function_arn_prepared");
+                assert_eq!(args.qualifier, "7");
+                assert_eq!(args.customer_context, serde_json::to_vec(&context).unwrap());
+                assert_eq!(&args.payload, payload);
+                assert_eq!(args.invoke_type, InvokeType::InvokeEvent);
+            });
+        }
+
+        let response = b"prepared response".to_vec();
+        GG_REQUEST_READ_BUFFER.with(|rc| rc.replace(response.clone()));
+        let mut buffer = Vec::with_capacity(64);
+        client
+            .invoke_sync_prepared_with(&prepared, None::<&[u8]>, |reader| {
+                reader.read_into(&mut buffer)
+            })
+            .unwrap();
+        assert_eq!(buffer, response);
+        GG_INVOKE_ARGS
+            .with(|rc| assert_eq!(rc.borrow().invoke_type, InvokeType::InvokeRequestResponse));
+        GG_CLOSE_REQUEST_COUNT.with(|rc| assert_eq!(*rc.borrow(), 3));
+    }
 }
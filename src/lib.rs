@@ -36,15 +36,21 @@
 #![allow(unused_unsafe)] // because the test bindings will complain otherwise
 
 mod bindings;
+pub mod blocking;
+mod buffer;
 pub mod error;
 pub mod handler;
 pub mod iotdata;
+mod json;
 pub mod lambda;
 pub mod log;
+pub mod ratelimit;
 pub mod request;
+pub mod retry;
 pub mod runtime;
 pub mod secret;
 pub mod shadow;
+pub mod shadow_writer;
 
 use crate::bindings::gg_global_init;
 use crate::error::GGError;
@@ -56,10 +62,14 @@ pub type GGResult<T> = Result<T, GGError>;
 /// Provides the ability initialize the greengrass runtime
 pub struct Initializer {
     runtime: Runtime,
+    blocking_threads: Option<usize>,
 }
 
 impl Initializer {
     pub fn init(self) -> GGResult<()> {
+        if let Some(threads) = self.blocking_threads {
+            blocking::set_max_threads(threads);
+        }
         unsafe {
             // At this time there are no options for gg_global_init
             let init_res = gg_global_init(0);
@@ -80,7 +90,22 @@ impl Initializer {
     /// Initializer::default().with_runtime(Runtime::default());
     /// ```
     pub fn with_runtime(self, runtime: Runtime) -> Self {
-        Initializer { runtime }
+        Initializer { runtime, ..self }
+    }
+
+    /// The number of threads used to run the C SDK calls of the `*_async` client methods.
+    /// This bounds the number of those calls that can run concurrently. See [`blocking`]
+    ///
+    /// ```edition2018
+    /// use aws_greengrass_core_rust::Initializer;
+    ///
+    /// Initializer::default().with_blocking_threads(8);
+    /// ```
+    pub fn with_blocking_threads(self, blocking_threads: usize) -> Self {
+        Initializer {
+            blocking_threads: Some(blocking_threads),
+            ..self
+        }
     }
 }
 
@@ -89,6 +114,7 @@ impl Default for Initializer {
     fn default() -> Self {
         Initializer {
             runtime: Runtime::default(),
+            blocking_threads: None,
         }
     }
 }
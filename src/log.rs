@@ -7,31 +7,197 @@
  */
 
 //! Provide a log crate log implementation that delegates to the the Greengrass logging infrastructure
+//!
+//! [`init_log`] writes every record to gg_log on the thread that logged it.
+//! [`init_async_log`] instead queues records in a bounded ring buffer that a background thread drains to gg_log,
+//! so logging never blocks the caller. Records logged while the buffer is full are dropped and counted,
+//! see [`async_log_stats`]. Call `log::logger().flush()` to wait until every queued record has been written,
+//! e.g. before the process exits.
+//!
+//! Levels can be set per target with a [`LogFilter`], using the same directives as env_logger.
+//! The log max level is set to the most verbose directive, so records that no directive enables
+//! are skipped by the log macros before they are formatted.
+//!
+//! # Examples
+//! ```edition2018
+//! use aws_greengrass_core_rust::log::{self as gglog, LogFilter};
+//!
+//! let filter = LogFilter::parse("warn,my_lambda=debug,aws_greengrass_core_rust::runtime=info").unwrap();
+//! gglog::init_log_with_filter(filter);
+//! ```
 use crate::bindings::*;
+use crate::error::GGError;
+use crate::GGResult;
+use crossbeam_channel::{bounded, Receiver, Sender};
 use lazy_static::lazy_static;
 use log::{self, Level, LevelFilter, Log, Metadata, Record};
-use std::ffi::CString;
+use std::cell::RefCell;
+use std::cmp;
+use std::ffi::CStr;
+use std::fmt::{self, Write};
+use std::panic::{self, AssertUnwindSafe};
+use std::str::FromStr;
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::{Arc, Mutex};
+use std::thread;
+
+/// Formatted lines larger than this are not retained in the per thread buffer
+const MAX_RETAINED_LINE_CAPACITY: usize = 16 * 1024;
 
 lazy_static! {
-    static ref LOGGER: GGLogger = GGLogger;
+    /// The queue of the async logger, if it has been initialized
+    static ref ASYNC_QUEUE: Mutex<Option<AsyncQueue>> = Mutex::new(None);
+}
+
+thread_local! {
+    /// The buffer records are formatted into when they are written on the logging thread
+    static LINE_BUFFER: RefCell<Vec<u8>> = RefCell::new(Vec::with_capacity(512));
 }
 
 /// A logger implementation that wraps the greengrass logging backend
 #[derive(Default)]
-struct GGLogger;
+struct GGLogger {
+    filter: LogFilter,
+    /// When defined records are written to gg_log from a background thread
+    queue: Option<AsyncQueue>,
+}
 
 impl Log for GGLogger {
-    fn enabled(&self, _: &Metadata) -> bool {
-        true
+    fn enabled(&self, metadata: &Metadata) -> bool {
+        self.filter.enabled(metadata.target(), metadata.level())
     }
 
     fn log(&self, record: &Record) {
         if self.enabled(record.metadata()) {
-            to_gg_log(record)
+            let level = to_gg_log_level(record.level());
+            match &self.queue {
+                Some(queue) => {
+                    let mut line = Vec::with_capacity(128);
+                    format_record(record, &mut line);
+                    queue.push(level, line);
+                }
+                None => write_with_line_buffer(level, record),
+            }
+        }
+    }
+
+    fn flush(&self) {
+        if let Some(queue) = &self.queue {
+            queue.flush();
+        }
+    }
+}
+
+/// The levels records are logged at, per target.
+///
+/// A record is logged if its level is enabled by the directive with the longest target that is a
+/// module path prefix of the record's target, or by the default level if there is no such directive.
+#[derive(Clone, Debug, PartialEq)]
+pub struct LogFilter {
+    default_level: LevelFilter,
+    /// Sorted from the longest target to the shortest so the first match is the most specific
+    directives: Vec<(String, LevelFilter)>,
+    /// The most verbose level of any directive
+    max_level: LevelFilter,
+}
+
+impl LogFilter {
+    /// A filter that logs every target at the specified level
+    pub fn new(default_level: LevelFilter) -> Self {
+        LogFilter {
+            default_level,
+            directives: vec![],
+            max_level: default_level,
+        }
+    }
+
+    /// Logs the target, and modules under it, at the specified level
+    pub fn with_directive(mut self, target: &str, level: LevelFilter) -> Self {
+        self.directives.retain(|(t, _)| t != target);
+        self.directives.push((target.to_owned(), level));
+        self.directives
+            .sort_by(|(a, _), (b, _)| b.len().cmp(&a.len()));
+        self.update_max_level();
+        self
+    }
+
+    /// The level targets without a directive are logged at
+    pub fn with_default_level(mut self, default_level: LevelFilter) -> Self {
+        self.default_level = default_level;
+        self.update_max_level();
+        self
+    }
+
+    fn update_max_level(&mut self) {
+        self.max_level = self
+            .directives
+            .iter()
+            .map(|(_, level)| *level)
+            .fold(self.default_level, cmp::max);
+    }
+
+    /// Parses env_logger style directives, e.g. `warn,my_lambda=debug,my_lambda::noisy=off`.
+    /// A directive without a target sets the default level.
+    pub fn parse(spec: &str) -> GGResult<Self> {
+        let mut filter = LogFilter::new(LevelFilter::Error);
+        for directive in spec.split(',').map(str::trim).filter(|d| !d.is_empty()) {
+            let mut parts = directive.splitn(2, '=');
+            let first = parts.next().unwrap_or_default().trim();
+            filter = match parts.next() {
+                Some(level) => filter.with_directive(first, parse_level(level.trim())?),
+                None => match LevelFilter::from_str(first) {
+                    Ok(level) => filter.with_default_level(level),
+                    // a bare target enables everything for it
+                    Err(_) => filter.with_directive(first, LevelFilter::Trace),
+                },
+            };
+        }
+        Ok(filter)
+    }
+
+    /// The most verbose level that any target is logged at
+    pub fn max_level(&self) -> LevelFilter {
+        self.max_level
+    }
+
+    fn enabled(&self, target: &str, level: Level) -> bool {
+        // Most disabled records are rejected here without looking at the directives
+        if level > self.max_level {
+            return false;
         }
+        self.directives
+            .iter()
+            .find(|(prefix, _)| is_module_prefix(prefix, target))
+            .map(|(_, level_filter)| level <= *level_filter)
+            .unwrap_or(level <= self.default_level)
     }
+}
 
-    fn flush(&self) {}
+impl Default for LogFilter {
+    fn default() -> Self {
+        LogFilter::new(LevelFilter::Trace)
+    }
+}
+
+fn parse_level(level: &str) -> GGResult<LevelFilter> {
+    LevelFilter::from_str(level)
+        .map_err(|_| GGError::InvalidString(format!("Invalid log level: {}", level)))
+}
+
+/// True if prefix is the target or one of its parent modules
+fn is_module_prefix(prefix: &str, target: &str) -> bool {
+    target.starts_with(prefix)
+        && (target.len() == prefix.len() || target[prefix.len()..].starts_with("::"))
+}
+
+/// Counts of the records handled by the async logger
+#[derive(Clone, Debug, Default, PartialEq)]
+pub struct AsyncLogStats {
+    /// The number of records waiting to be written
+    pub queued: usize,
+    /// The number of records dropped because the buffer was full, the background thread had stopped
+    /// or the record could not be written as a C string
+    pub dropped: u64,
 }
 
 /// Initializes the Greengrass Logger with the specified run level
@@ -44,19 +210,195 @@ impl Log for GGLogger {
 /// gglog::init_log(Level::Debug);
 /// ```
 pub fn init_log(max_level: LevelFilter) {
-    log::set_max_level(max_level);
-    log::set_logger(&*LOGGER).expect("GGLogger implementation could not be set as logger");
+    init_log_with_filter(LogFilter::new(max_level));
+}
+
+/// Initializes the Greengrass Logger with per target levels
+pub fn init_log_with_filter(filter: LogFilter) {
+    set_logger(GGLogger {
+        filter,
+        queue: None,
+    });
+}
+
+/// Initializes the Greengrass Logger with the specified run level, writing records to gg_log
+/// from a background thread. Up to capacity records are buffered, further records are dropped until
+/// the background thread catches up.
+///
+/// # Examples
+/// ```edition2018
+/// use log::LevelFilter;
+/// use aws_greengrass_core_rust::log as gglog;
+///
+/// gglog::init_async_log(LevelFilter::Info, 4096);
+/// log::info!("written by the background thread");
+/// log::logger().flush();
+/// ```
+pub fn init_async_log(max_level: LevelFilter, capacity: usize) {
+    init_async_log_with_filter(LogFilter::new(max_level), capacity);
+}
+
+/// Initializes the asynchronous Greengrass Logger with per target levels. See [`init_async_log`]
+pub fn init_async_log_with_filter(filter: LogFilter, capacity: usize) {
+    let queue = AsyncQueue::start(capacity.max(1), write_gg_log);
+    *ASYNC_QUEUE.lock().expect("async log lock poisoned") = Some(queue.clone());
+    set_logger(GGLogger {
+        filter,
+        queue: Some(queue),
+    });
+}
+
+fn set_logger(logger: GGLogger) {
+    log::set_max_level(logger.filter.max_level());
+    // The logger lives for the rest of the process
+    log::set_logger(Box::leak(Box::new(logger)))
+        .expect("GGLogger implementation could not be set as logger");
+}
+
+/// The records queued and dropped by the async logger. Empty if [`init_async_log`] has not been called.
+pub fn async_log_stats() -> AsyncLogStats {
+    ASYNC_QUEUE
+        .lock()
+        .expect("async log lock poisoned")
+        .as_ref()
+        .map(AsyncQueue::stats)
+        .unwrap_or_default()
+}
+
+enum Message {
+    /// A NUL terminated line
+    Record(gg_log_level, Vec<u8>),
+    /// Acknowledged once every record queued before it has been written
+    Flush(Sender<()>),
+}
+
+/// A bounded queue of records drained by a background thread
+#[derive(Clone)]
+struct AsyncQueue {
+    sender: Sender<Message>,
+    dropped: Arc<AtomicU64>,
+}
+
+impl AsyncQueue {
+    fn start<W>(capacity: usize, write: W) -> Self
+    where
+        W: Fn(gg_log_level, &CStr) + Send + 'static,
+    {
+        let (sender, receiver) = bounded(capacity);
+        let dropped = Arc::new(AtomicU64::new(0));
+        let drain_dropped = Arc::clone(&dropped);
+        thread::Builder::new()
+            .name("gg-log".to_owned())
+            .spawn(move || drain(receiver, &drain_dropped, write))
+            .expect("could not start the greengrass log thread");
+        AsyncQueue { sender, dropped }
+    }
+
+    /// Queues a NUL terminated line
+    fn push(&self, level: gg_log_level, line: Vec<u8>) {
+        // Never log from here, it would recurse into the logger.
+        // The channel is only disconnected if the background thread has died.
+        if self.sender.try_send(Message::Record(level, line)).is_err() {
+            self.dropped.fetch_add(1, Ordering::Relaxed);
+        }
+    }
+
+    fn flush(&self) {
+        let (ack_sender, ack_receiver) = bounded(1);
+        // Blocks until there is room, a flush is never dropped
+        if self.sender.send(Message::Flush(ack_sender)).is_ok() {
+            let _ = ack_receiver.recv();
+        }
+    }
+
+    fn stats(&self) -> AsyncLogStats {
+        AsyncLogStats {
+            queued: self.sender.len(),
+            dropped: self.dropped.load(Ordering::Relaxed),
+        }
+    }
 }
 
-/// Converts a [`log::Record`] to a c log entry and sends it to gg_log
-fn to_gg_log(record: &Record) {
-    let formatted = format!("{} -- {}", record.target(), record.args());
-    let bytes = formatted.into_bytes();
+fn drain<W: Fn(gg_log_level, &CStr)>(receiver: Receiver<Message>, dropped: &AtomicU64, write: W) {
+    for message in receiver.iter() {
+        match message {
+            Message::Record(level, line) => {
+                // A record that can't be written must not stop the thread, a pending flush would
+                // never be acknowledged
+                let written = CStr::from_bytes_with_nul(&line).map(|line_c| {
+                    panic::catch_unwind(AssertUnwindSafe(|| write(level, line_c))).is_ok()
+                });
+                if written != Ok(true) {
+                    dropped.fetch_add(1, Ordering::Relaxed);
+                }
+            }
+            Message::Flush(ack) => {
+                let _ = ack.send(());
+            }
+        }
+    }
+}
+
+/// Formats the record into the thread's line buffer and writes it to gg_log
+fn write_with_line_buffer(level: gg_log_level, record: &Record) {
+    LINE_BUFFER.with(|rc| match rc.try_borrow_mut() {
+        Ok(mut line) => {
+            line.clear();
+            format_record(record, &mut line);
+            if let Ok(line_c) = CStr::from_bytes_with_nul(&line) {
+                write_gg_log(level, line_c);
+            }
+            if line.capacity() > MAX_RETAINED_LINE_CAPACITY {
+                *line = Vec::with_capacity(512);
+            }
+        }
+        // Something logged while formatting a record on this thread
+        Err(_) => {
+            let mut line = Vec::new();
+            format_record(record, &mut line);
+            if let Ok(line_c) = CStr::from_bytes_with_nul(&line) {
+                write_gg_log(level, line_c);
+            }
+        }
+    })
+}
+
+/// Formats the record into the buffer as a NUL terminated gg_log format string
+fn format_record(record: &Record, line: &mut Vec<u8>) {
+    let _ = write!(
+        FormatEscaper(line),
+        "{} -- {}",
+        record.target(),
+        record.args()
+    );
+    line.push(0);
+}
+
+/// gg_log treats the line as a printf format string, so % is escaped.
+/// NUL can't be represented in a C string so it is written as \0.
+struct FormatEscaper<'a>(&'a mut Vec<u8>);
+
+impl<'a> fmt::Write for FormatEscaper<'a> {
+    fn write_str(&mut self, s: &str) -> fmt::Result {
+        let mut rest = s.as_bytes();
+        while let Some(i) = rest.iter().position(|b| *b == b'%' || *b == 0) {
+            self.0.extend_from_slice(&rest[..i]);
+            if rest[i] == b'%' {
+                self.0.extend_from_slice(b"%%");
+            } else {
+                self.0.extend_from_slice(b"\\0");
+            }
+            rest = &rest[i + 1..];
+        }
+        self.0.extend_from_slice(rest);
+        Ok(())
+    }
+}
 
-    let c_to_print = CString::new(bytes.as_slice()).expect("CString: new failed");
-    let level = to_gg_log_level(record.level());
+/// Sends a log entry to gg_log
+fn write_gg_log(level: gg_log_level, line: &CStr) {
     unsafe {
-        gg_log(level, c_to_print.as_ptr());
+        gg_log(level, line.as_ptr());
     }
 }
 
@@ -73,6 +415,7 @@ fn to_gg_log_level(l: Level) -> gg_log_level {
 #[cfg(test)]
 mod test {
     use super::*;
+    use std::sync::Mutex;
 
     #[cfg(not(feature = "mock"))]
     #[test]
@@ -113,4 +456,112 @@ mod test {
             assert!(borrowed.contains(&trace_value));
         });
     }
+
+    #[test]
+    fn test_async_queue() {
+        let written = Arc::new(Mutex::new(vec![]));
+        let (started_sender, started) = bounded(1);
+        let (gate, gate_receiver) = bounded::<()>(0);
+        let written_clone = Arc::clone(&written);
+        let queue = AsyncQueue::start(2, move |level, line: &CStr| {
+            let line = line.to_str().unwrap().to_owned();
+            if line == "first" {
+                // hold the background thread until the queue has filled up
+                started_sender.send(()).unwrap();
+                gate_receiver.recv().unwrap();
+            }
+            written_clone.lock().unwrap().push((level, line));
+        });
+
+        queue.push(gg_log_level_GG_LOG_INFO, b"first\0".to_vec());
+        started.recv().unwrap();
+        for i in 0..5 {
+            queue.push(
+                gg_log_level_GG_LOG_WARN,
+                format!("record {}\0", i).into_bytes(),
+            );
+        }
+        assert_eq!(
+            queue.stats(),
+            AsyncLogStats {
+                queued: 2,
+                dropped: 3
+            }
+        );
+
+        gate.send(()).unwrap();
+        queue.flush();
+        let written = written.lock().unwrap();
+        assert_eq!(
+            *written,
+            vec![
+                (gg_log_level_GG_LOG_INFO, "first".to_owned()),
+                (gg_log_level_GG_LOG_WARN, "record 0".to_owned()),
+                (gg_log_level_GG_LOG_WARN, "record 1".to_owned()),
+            ]
+        );
+        assert_eq!(queue.stats().queued, 0);
+    }
+
+    #[test]
+    fn test_async_queue_drops_unwritable_records() {
+        let queue = AsyncQueue::start(4, |_, line: &CStr| {
+            if line.to_bytes() == b"fatal" {
+                panic!("the writer failed");
+            }
+        });
+        queue.push(gg_log_level_GG_LOG_INFO, b"interior\0nul\0".to_vec());
+        queue.push(gg_log_level_GG_LOG_INFO, b"unterminated".to_vec());
+        queue.push(gg_log_level_GG_LOG_INFO, b"fatal\0".to_vec());
+        queue.flush();
+        assert_eq!(queue.stats().dropped, 3);
+
+        // the background thread carries on after a record it failed to write
+        queue.push(gg_log_level_GG_LOG_INFO, b"after\0".to_vec());
+        queue.flush();
+        assert_eq!(queue.stats().dropped, 3);
+    }
+
+    #[test]
+    fn test_filter() {
+        let filter = LogFilter::new(LevelFilter::Warn)
+            .with_directive("my_lambda", LevelFilter::Debug)
+            .with_directive("my_lambda::noisy", LevelFilter::Off);
+        assert_eq!(filter.max_level(), LevelFilter::Debug);
+        assert!(filter.enabled("my_lambda", Level::Debug));
+        assert!(filter.enabled("my_lambda::handler", Level::Debug));
+        assert!(!filter.enabled("my_lambda::handler", Level::Trace));
+        assert!(!filter.enabled("my_lambda::noisy", Level::Error));
+        assert!(!filter.enabled("my_lambda_other", Level::Info));
+        assert!(filter.enabled("my_lambda_other", Level::Warn));
+        assert!(!filter.enabled("other", Level::Info));
+    }
+
+    #[test]
+    fn test_parse_filter() {
+        let filter = LogFilter::parse("info, my_lambda=trace,hyper=off").unwrap();
+        assert_eq!(
+            filter,
+            LogFilter::new(LevelFilter::Info)
+                .with_directive("my_lambda", LevelFilter::Trace)
+                .with_directive("hyper", LevelFilter::Off)
+        );
+        let filter = LogFilter::parse("my_lambda").unwrap();
+        assert!(filter.enabled("my_lambda", Level::Trace));
+        assert!(!filter.enabled("other", Level::Warn));
+        assert!(LogFilter::parse("my_lambda=loud").is_err());
+    }
+
+    #[test]
+    fn test_format_record() {
+        let mut line = vec![];
+        format_record(
+            &Record::builder()
+                .target("my_target")
+                .args(format_args!("100% done\0"))
+                .build(),
+            &mut line,
+        );
+        assert_eq!(line, b"my_target -- 100%% done\\0\0".to_vec());
+    }
 }
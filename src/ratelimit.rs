@@ -0,0 +1,354 @@
+/*
+ * Copyright 2020-present, Nike, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the Apache-2.0 license found in
+ * the LICENSE file in the root of this source tree.
+ */
+
+//! Provides client side rate limiting of publishes.
+//!
+//! Bursts of publishes with `QueueFullPolicy::AllOrError` are rejected by greengrass once its queue is full.
+//! A [`RateLimiter`] on an `IOTDataClient` smooths those bursts with token buckets before they reach greengrass.
+//! A publish that finds no token waits until one is available.
+//!
+//! Limits can be set for the whole client, for every topic and for individual topics, and can be changed
+//! at any time. Clones of a limiter share their buckets, limits and stats.
+//!
+//! # Examples
+//! ```rust
+//! use aws_greengrass_core_rust::iotdata::IOTDataClient;
+//! use aws_greengrass_core_rust::ratelimit::{RateLimit, RateLimiter};
+//!
+//! let limiter = RateLimiter::default()
+//!     .with_client_limit(Some(RateLimit::new(100.0, 20)))
+//!     .with_topic_limit("telemetry/temp", Some(RateLimit::new(10.0, 5)));
+//! let client = IOTDataClient::default().with_rate_limiter(Some(limiter.clone()));
+//! client.publish("telemetry/temp", "21.5");
+//!
+//! // raise the limit during a maintenance window
+//! limiter.set_client_limit(Some(RateLimit::new(500.0, 50)));
+//! println!("publishes delayed so far: {}", limiter.stats().delayed);
+//! ```
+use std::collections::HashMap;
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::{Arc, Mutex};
+use std::thread;
+use std::time::{Duration, Instant};
+
+/// The number of topic buckets at which idle buckets are first pruned
+const PRUNE_BUCKETS_AT: usize = 1024;
+
+/// A token bucket limit
+#[derive(Clone, Debug, PartialEq)]
+pub struct RateLimit {
+    /// The number of publishes per second allowed over time
+    pub per_second: f64,
+    /// The number of publishes allowed at once, after the bucket has had time to fill
+    pub burst: u32,
+}
+
+impl RateLimit {
+    /// A limit of `per_second` publishes on average, allowing bursts of up to `burst` publishes.
+    ///
+    /// A `per_second` of zero or less doesn't limit publishes.
+    pub fn new(per_second: f64, burst: u32) -> Self {
+        RateLimit { per_second, burst }
+    }
+}
+
+/// Counts of the publishes that passed through a limiter
+#[derive(Clone, Debug, Default, PartialEq)]
+pub struct RateLimiterStats {
+    /// The number of publishes that passed through the limiter
+    pub permitted: u64,
+    /// The number of publishes that had to wait for a token
+    pub delayed: u64,
+    /// The total time publishes waited for tokens
+    pub total_delay: Duration,
+}
+
+/// Limits the rate of publishes for a client and its topics
+#[derive(Clone, Default)]
+pub struct RateLimiter {
+    inner: Arc<Inner>,
+}
+
+#[derive(Default)]
+struct Inner {
+    client: Mutex<Option<TokenBucket>>,
+    topics: Mutex<Topics>,
+    permitted: AtomicU64,
+    delayed: AtomicU64,
+    total_delay_nanos: AtomicU64,
+}
+
+#[derive(Default)]
+struct Topics {
+    /// The limit for topics that do not have their own
+    default_limit: Option<RateLimit>,
+    /// Limits for individual topics
+    limits: HashMap<String, RateLimit>,
+    buckets: HashMap<String, TokenBucket>,
+    /// The number of buckets at which they are next pruned
+    prune_at: usize,
+}
+
+impl Topics {
+    fn limit(&self, topic: &str) -> Option<&RateLimit> {
+        self.limits
+            .get(topic)
+            .or_else(|| self.default_limit.as_ref())
+    }
+
+    /// Removes the buckets that have refilled, which behave the same as the new bucket that replaces
+    /// them on the next publish to their topic
+    fn prune(&mut self, now: Instant) {
+        self.buckets.retain(|_, bucket| !bucket.is_full(now));
+        self.prune_at = (self.buckets.len() * 2).max(PRUNE_BUCKETS_AT);
+    }
+}
+
+impl RateLimiter {
+    /// The limit for all publishes from the client
+    pub fn with_client_limit(self, limit: Option<RateLimit>) -> Self {
+        self.set_client_limit(limit);
+        self
+    }
+
+    /// The limit for each topic that doesn't have its own limit
+    pub fn with_default_topic_limit(self, limit: Option<RateLimit>) -> Self {
+        self.set_default_topic_limit(limit);
+        self
+    }
+
+    /// The limit for a topic
+    pub fn with_topic_limit(self, topic: &str, limit: Option<RateLimit>) -> Self {
+        self.set_topic_limit(topic, limit);
+        self
+    }
+
+    /// Changes the limit for all publishes from the client
+    pub fn set_client_limit(&self, limit: Option<RateLimit>) {
+        let mut client = self
+            .inner
+            .client
+            .lock()
+            .expect("rate limiter lock poisoned");
+        *client = limit.map(TokenBucket::new);
+    }
+
+    /// Changes the limit for each topic that doesn't have its own limit
+    pub fn set_default_topic_limit(&self, limit: Option<RateLimit>) {
+        let mut topics = self
+            .inner
+            .topics
+            .lock()
+            .expect("rate limiter lock poisoned");
+        topics.default_limit = limit;
+        // buckets are recreated with the new limit on the next publish
+        topics.buckets.clear();
+    }
+
+    /// Changes the limit for a topic. None reverts the topic to the default topic limit.
+    pub fn set_topic_limit(&self, topic: &str, limit: Option<RateLimit>) {
+        let mut topics = self
+            .inner
+            .topics
+            .lock()
+            .expect("rate limiter lock poisoned");
+        match limit {
+            Some(limit) => topics.limits.insert(topic.to_owned(), limit),
+            None => topics.limits.remove(topic),
+        };
+        topics.buckets.remove(topic);
+    }
+
+    /// The publishes that passed through this limiter, and its clones, so far
+    pub fn stats(&self) -> RateLimiterStats {
+        RateLimiterStats {
+            permitted: self.inner.permitted.load(Ordering::Relaxed),
+            delayed: self.inner.delayed.load(Ordering::Relaxed),
+            total_delay: Duration::from_nanos(self.inner.total_delay_nanos.load(Ordering::Relaxed)),
+        }
+    }
+
+    /// Takes a token for the topic, waiting until one is available
+    pub(crate) fn acquire(&self, topic: &str) {
+        let delay = self.take(topic, Instant::now());
+        if delay > Duration::from_secs(0) {
+            thread::sleep(delay);
+        }
+    }
+
+    /// Reserves a token and counts it in the stats, returning how long to wait before it may be used
+    fn take(&self, topic: &str, now: Instant) -> Duration {
+        let delay = self.reserve(topic, now);
+        self.inner.permitted.fetch_add(1, Ordering::Relaxed);
+        if delay > Duration::from_secs(0) {
+            self.inner.delayed.fetch_add(1, Ordering::Relaxed);
+            self.inner
+                .total_delay_nanos
+                .fetch_add(delay.as_nanos() as u64, Ordering::Relaxed);
+        }
+        delay
+    }
+
+    /// Reserves a token from the client and topic buckets, returning how long to wait before it may be used
+    fn reserve(&self, topic: &str, now: Instant) -> Duration {
+        let client_delay = {
+            let mut client = self
+                .inner
+                .client
+                .lock()
+                .expect("rate limiter lock poisoned");
+            client
+                .as_mut()
+                .map(|bucket| bucket.reserve(now))
+                .unwrap_or_default()
+        };
+
+        let topic_delay = {
+            let mut topics = self
+                .inner
+                .topics
+                .lock()
+                .expect("rate limiter lock poisoned");
+            if let Some(bucket) = topics.buckets.get_mut(topic) {
+                bucket.reserve(now)
+            } else if let Some(limit) = topics.limit(topic).cloned() {
+                if topics.buckets.len() >= topics.prune_at.max(PRUNE_BUCKETS_AT) {
+                    topics.prune(now);
+                }
+                let mut bucket = TokenBucket::new(limit);
+                let delay = bucket.reserve(now);
+                topics.buckets.insert(topic.to_owned(), bucket);
+                delay
+            } else {
+                Duration::default()
+            }
+        };
+
+        client_delay.max(topic_delay)
+    }
+}
+
+/// A token bucket that allows tokens to be borrowed from the future.
+/// A reservation that drives the bucket negative must wait until the bucket refills to zero.
+struct TokenBucket {
+    limit: RateLimit,
+    tokens: f64,
+    updated: Instant,
+}
+
+impl TokenBucket {
+    fn new(limit: RateLimit) -> Self {
+        TokenBucket {
+            tokens: f64::from(limit.burst),
+            limit,
+            updated: Instant::now(),
+        }
+    }
+
+    /// True if the bucket will have refilled to its burst by now
+    fn is_full(&self, now: Instant) -> bool {
+        let elapsed = now.saturating_duration_since(self.updated);
+        self.limit.per_second <= 0.0
+            || self.tokens + elapsed.as_secs_f64() * self.limit.per_second
+                >= f64::from(self.limit.burst)
+    }
+
+    fn reserve(&mut self, now: Instant) -> Duration {
+        if self.limit.per_second <= 0.0 {
+            return Duration::default();
+        }
+        let elapsed = now.saturating_duration_since(self.updated);
+        self.updated = now;
+        self.tokens = (self.tokens + elapsed.as_secs_f64() * self.limit.per_second)
+            .min(f64::from(self.limit.burst));
+        self.tokens -= 1.0;
+        if self.tokens >= 0.0 {
+            Duration::default()
+        } else {
+            Duration::from_secs_f64(-self.tokens / self.limit.per_second)
+        }
+    }
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    #[test]
+    fn test_token_bucket() {
+        let mut bucket = TokenBucket::new(RateLimit::new(10.0, 2));
+        let now = bucket.updated;
+        assert_eq!(bucket.reserve(now), Duration::default());
+        assert_eq!(bucket.reserve(now), Duration::default());
+        assert_eq!(bucket.reserve(now), Duration::from_millis(100));
+        assert_eq!(bucket.reserve(now), Duration::from_millis(200));
+        // after refilling for a second the bucket is capped at the burst
+        let later = now + Duration::from_secs(1);
+        assert_eq!(bucket.reserve(later), Duration::default());
+        assert_eq!(bucket.reserve(later), Duration::default());
+        assert!(bucket.reserve(later) > Duration::default());
+    }
+
+    #[test]
+    fn test_topic_limits() {
+        let limiter = RateLimiter::default()
+            .with_default_topic_limit(Some(RateLimit::new(1.0, 1)))
+            .with_topic_limit("fast", Some(RateLimit::new(1.0, 3)));
+        let now = Instant::now();
+
+        assert_eq!(limiter.reserve("slow", now), Duration::default());
+        assert!(limiter.reserve("slow", now) > Duration::default());
+        // topics have their own buckets
+        assert_eq!(limiter.reserve("other", now), Duration::default());
+        for _ in 0..3 {
+            assert_eq!(limiter.reserve("fast", now), Duration::default());
+        }
+        assert!(limiter.reserve("fast", now) > Duration::default());
+
+        // limits can be changed at runtime
+        limiter.set_topic_limit("fast", None);
+        assert_eq!(limiter.reserve("fast", now), Duration::default());
+        assert!(limiter.reserve("fast", now) > Duration::default());
+    }
+
+    #[test]
+    fn test_client_limit() {
+        let limiter = RateLimiter::default().with_client_limit(Some(RateLimit::new(10.0, 2)));
+        let now = Instant::now();
+        for topic in &["a", "b", "c"] {
+            limiter.take(topic, now);
+        }
+        let stats = limiter.stats();
+        assert_eq!(stats.permitted, 3);
+        assert_eq!(stats.delayed, 1);
+        assert_eq!(stats.total_delay, Duration::from_millis(100));
+
+        limiter.set_client_limit(None);
+        limiter.take("a", now);
+        assert_eq!(limiter.clone().stats().delayed, 1);
+    }
+
+    #[test]
+    fn test_idle_topic_buckets_are_pruned() {
+        let limiter = RateLimiter::default().with_default_topic_limit(Some(RateLimit::new(1.0, 1)));
+        let bucket_count = || limiter.inner.topics.lock().unwrap().buckets.len();
+        let now = Instant::now();
+        for i in 1..PRUNE_BUCKETS_AT {
+            limiter.reserve(&format!("topic/{}", i), now);
+        }
+        let later = now + Duration::from_secs(2);
+        limiter.reserve("busy", later);
+        assert_eq!(bucket_count(), PRUNE_BUCKETS_AT);
+
+        // the buckets that have refilled are dropped when the next bucket is created,
+        // the ones still refilling are kept
+        limiter.reserve("new", later);
+        assert_eq!(bucket_count(), 2);
+        assert!(limiter.reserve("busy", later) > Duration::default());
+    }
+}
@@ -37,10 +37,11 @@ use serde::{Deserialize, Serialize};
 use std::convert::TryFrom;
 use std::default::Default;
 use std::ffi::c_void;
+use std::io::{self, Read};
 
-/// The size of buffer we will use when reading results
+/// The smallest buffer we will use when reading results
 /// from the C API
-const BUFFER_SIZE: usize = 512;
+const MIN_BUFFER_SIZE: usize = 512;
 
 /// Greengrass SDK request status enum
 /// Maps to gg_request_status
@@ -115,11 +116,21 @@ impl GGRequestResponse {
     /// If the response is an error the error will be returned else the body in bytes.
     /// This is useful for requests that contain a body
     pub(crate) fn read(&self, req: gg_request) -> GGResult<Option<Vec<u8>>> {
+        self.read_with(req, |reader| {
+            let mut data = Vec::new();
+            reader.read_into(&mut data)?;
+            Ok(data)
+        })
+    }
+
+    /// Provides a reader over the response body to the specified function.
+    /// If the response is an error the error will be returned and the function will not be called.
+    pub(crate) fn read_with<R, F>(&self, req: gg_request, f: F) -> GGResult<Option<R>>
+    where
+        F: FnOnce(&mut ResponseReader) -> GGResult<R>,
+    {
         match self.determine_error(req) {
-            ErrorState::None => {
-                let data = read_response_data(req)?;
-                Ok(Some(data))
-            }
+            ErrorState::None => f(&mut ResponseReader::new(req)).map(Some),
             ErrorState::NotFoundError => Ok(None),
             ErrorState::Error(e) => Err(e),
         }
@@ -226,32 +237,95 @@ impl TryFrom<&[u8]> for ErrorResponse {
     }
 }
 
-/// Reads the response data from the gg_request_reqd call
-fn read_response_data(req_to_read: gg_request) -> Result<Vec<u8>, GGError> {
-    let mut bytes: Vec<u8> = Vec::new();
+/// Streams the body of a response from greengrass straight out of the C API.
+///
+/// The reader is only valid while the request it reads from is open, so it is only ever
+/// lent out to a function (e.g. [`crate::shadow::ShadowClient::get_thing_shadow_with`]).
+///
+/// # Examples
+/// ```rust
+/// use aws_greengrass_core_rust::shadow::ShadowClient;
+///
+/// // read the document into a buffer that is reused between requests
+/// let mut buffer = Vec::with_capacity(64 * 1024);
+/// let result = ShadowClient::default().get_thing_shadow_with("my_thing", |reader| {
+///     buffer.clear();
+///     reader.read_into(&mut buffer)
+/// });
+/// ```
+pub struct ResponseReader {
+    req: gg_request,
+}
+
+impl ResponseReader {
+    pub(crate) fn new(req: gg_request) -> Self {
+        ResponseReader { req }
+    }
 
-    unsafe {
+    /// Appends the rest of the response to the vector, reading directly into its spare capacity.
+    /// The vector grows geometrically if the response does not fit in the capacity reserved.
+    /// Returns the number of bytes appended.
+    pub fn read_into(&mut self, buffer: &mut Vec<u8>) -> GGResult<usize> {
+        let start = buffer.len();
+        if buffer.capacity() == start {
+            buffer.reserve(MIN_BUFFER_SIZE);
+        }
         loop {
-            let mut buffer = [0u8; BUFFER_SIZE];
-            let mut read: usize = 0;
-            let raw_read = &mut read as *mut usize;
-
-            let read_res = gg_request_read(
-                req_to_read,
-                buffer.as_mut_ptr() as *mut c_void,
-                BUFFER_SIZE,
-                raw_read,
-            );
-            GGError::from_code(read_res)?;
-
-            if read > 0 {
-                bytes.extend_from_slice(&buffer[..read]);
-            } else {
+            if buffer.len() == buffer.capacity() {
+                buffer.reserve(buffer.capacity());
+            }
+            let len = buffer.len();
+            let spare = buffer.capacity() - len;
+            let read = unsafe {
+                let read = self.read_raw(buffer.as_mut_ptr().add(len), spare)?;
+                buffer.set_len(len + read);
+                read
+            };
+            if read == 0 {
+                return Ok(buffer.len() - start);
+            }
+        }
+    }
+
+    /// Reads the response into the slice until either the response or the slice is exhausted.
+    /// Returns the number of bytes read. If the slice was filled, any remaining response is discarded
+    /// when the request is closed.
+    pub fn read_into_slice(&mut self, buffer: &mut [u8]) -> GGResult<usize> {
+        let mut total = 0;
+        while total < buffer.len() {
+            let remaining = &mut buffer[total..];
+            let read = unsafe { self.read_raw(remaining.as_mut_ptr(), remaining.len())? };
+            if read == 0 {
                 break;
             }
+            total += read;
         }
+        Ok(total)
     }
 
+    /// Wraps gg_request_read. Returns zero once the response has been completely read.
+    unsafe fn read_raw(&mut self, buffer: *mut u8, buffer_size: usize) -> GGResult<usize> {
+        let mut read: usize = 0;
+        let raw_read = &mut read as *mut usize;
+        let read_res = gg_request_read(self.req, buffer as *mut c_void, buffer_size, raw_read);
+        GGError::from_code(read_res)?;
+        Ok(read.min(buffer_size))
+    }
+}
+
+impl Read for ResponseReader {
+    fn read(&mut self, buf: &mut [u8]) -> io::Result<usize> {
+        if buf.is_empty() {
+            return Ok(0);
+        }
+        unsafe { self.read_raw(buf.as_mut_ptr(), buf.len()) }.map_err(GGError::as_ioerror)
+    }
+}
+
+/// Reads the response data from the gg_request_reqd call
+fn read_response_data(req_to_read: gg_request) -> Result<Vec<u8>, GGError> {
+    let mut bytes: Vec<u8> = Vec::new();
+    ResponseReader::new(req_to_read).read_into(&mut bytes)?;
     Ok(bytes)
 }
 
@@ -308,6 +382,31 @@ Parturient montes nascetur ridiculus mus mauris vitae ultricies. Suspendisse sed
         assert_eq!(result, READ_DATA);
     }
 
+    #[test]
+    fn test_response_reader() {
+        GG_REQUEST_READ_BUFFER.with(|buffer| buffer.replace(READ_DATA.to_owned()));
+        let mut req: gg_request = ptr::null_mut();
+        gg_request_init(&mut req);
+        let mut reader = ResponseReader::new(req);
+
+        let mut start = [0u8; 11];
+        assert_eq!(reader.read_into_slice(&mut start).unwrap(), start.len());
+        assert_eq!(&start, b"Lorem ipsum");
+
+        let mut next = [0u8; 6];
+        reader.read_exact(&mut next).unwrap();
+        assert_eq!(&next, b" dolor");
+
+        // the rest should be appended after what the vector already holds
+        let mut rest = b"prefix".to_vec();
+        let read = reader.read_into(&mut rest).unwrap();
+        assert_eq!(read, READ_DATA.len() - 17);
+        assert_eq!(&rest[..6], b"prefix");
+        assert_eq!(&rest[6..], &READ_DATA[17..]);
+
+        assert_eq!(reader.read_into_slice(&mut next).unwrap(), 0);
+    }
+
     #[test]
     fn test_try_from_gg_request_status() {
         assert_eq!(
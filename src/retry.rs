@@ -0,0 +1,348 @@
+/*
+ * Copyright 2020-present, Nike, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the Apache-2.0 license found in
+ * the LICENSE file in the root of this source tree.
+ */
+
+//! Provides retrying of requests that greengrass throttled.
+//!
+//! When greengrass is throttling (e.g. an MQTT queue is full) requests fail with a
+//! `GGError::ErrorResponse` with a request status of `GGRequestStatus::Again`. A client configured
+//! with a [`RetryPolicy`] retries those requests with an exponential, optionally jittered, backoff.
+//!
+//! # Examples
+//! ```rust
+//! use aws_greengrass_core_rust::iotdata::IOTDataClient;
+//! use aws_greengrass_core_rust::retry::RetryPolicy;
+//! use std::time::Duration;
+//!
+//! let policy = RetryPolicy::default()
+//!     .with_max_attempts(5)
+//!     .with_deadline(Some(Duration::from_secs(2)));
+//! let client = IOTDataClient::default().with_retry_policy(Some(policy.clone()));
+//! if let Err(e) = client.publish("some_topic", "some payload") {
+//!     eprintln!("Gave up publishing after {:?}: {}", policy.stats(), e);
+//! }
+//! ```
+use crate::error::GGError;
+use crate::request::GGRequestStatus;
+use crate::GGResult;
+use log::warn;
+use std::cell::Cell;
+use std::cmp;
+use std::collections::hash_map::RandomState;
+use std::hash::{BuildHasher, Hasher};
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::Arc;
+use std::thread;
+use std::time::{Duration, Instant};
+
+thread_local! {
+    /// xorshift state used for jitter, seeded randomly per thread
+    static RNG_STATE: Cell<u64> = Cell::new(RandomState::new().build_hasher().finish() | 1);
+}
+
+/// How requests that greengrass throttled are retried.
+///
+/// Clones of a policy share their [`RetryStats`].
+#[derive(Clone, Debug)]
+pub struct RetryPolicy {
+    /// The maximum number of times a request is attempted, including the first attempt
+    pub max_attempts: u32,
+    /// The delay before the first retry. Each retry doubles the delay
+    pub base_delay: Duration,
+    /// The largest delay between attempts
+    pub max_delay: Duration,
+    /// When true each delay is chosen at random between zero and the backoff delay, so
+    /// throttled callers do not retry in lock step
+    pub jitter: bool,
+    /// If defined, no retry is attempted that would start after this much time has passed since the first attempt
+    pub deadline: Option<Duration>,
+    counters: Arc<RetryCounters>,
+}
+
+/// Counts of the retries made by a policy
+#[derive(Clone, Debug, Default, PartialEq)]
+pub struct RetryStats {
+    /// The number of times a request was retried
+    pub retries: u64,
+    /// The number of requests that were still throttled when the attempts or deadline ran out
+    pub give_ups: u64,
+}
+
+#[derive(Debug, Default)]
+struct RetryCounters {
+    retries: AtomicU64,
+    give_ups: AtomicU64,
+}
+
+impl RetryPolicy {
+    /// The maximum number of times a request is attempted, including the first attempt
+    pub fn with_max_attempts(self, max_attempts: u32) -> Self {
+        RetryPolicy {
+            max_attempts,
+            ..self
+        }
+    }
+
+    /// The delay before the first retry
+    pub fn with_base_delay(self, base_delay: Duration) -> Self {
+        RetryPolicy { base_delay, ..self }
+    }
+
+    /// The largest delay between attempts
+    pub fn with_max_delay(self, max_delay: Duration) -> Self {
+        RetryPolicy { max_delay, ..self }
+    }
+
+    /// Whether delays are randomized
+    pub fn with_jitter(self, jitter: bool) -> Self {
+        RetryPolicy { jitter, ..self }
+    }
+
+    /// The total time after which a throttled request is no longer retried
+    pub fn with_deadline(self, deadline: Option<Duration>) -> Self {
+        RetryPolicy { deadline, ..self }
+    }
+
+    /// The retries made with this policy, and its clones, so far
+    pub fn stats(&self) -> RetryStats {
+        RetryStats {
+            retries: self.counters.retries.load(Ordering::Relaxed),
+            give_ups: self.counters.give_ups.load(Ordering::Relaxed),
+        }
+    }
+
+    /// Calls the function until it returns something other than a throttled error
+    /// or the attempts or deadline run out.
+    pub(crate) fn run<R, F>(&self, mut f: F) -> GGResult<R>
+    where
+        F: FnMut() -> GGResult<R>,
+    {
+        let start = Instant::now();
+        let mut attempt = 1;
+        loop {
+            match f() {
+                Err(e) if is_throttled(&e) => {
+                    let delay = self.delay(attempt);
+                    let past_deadline = self
+                        .deadline
+                        .map(|deadline| start.elapsed() + delay > deadline)
+                        .unwrap_or(false);
+                    if attempt >= self.max_attempts || past_deadline {
+                        warn!("Giving up on throttled request after {} attempts", attempt);
+                        self.counters.give_ups.fetch_add(1, Ordering::Relaxed);
+                        return Err(e);
+                    }
+                    self.counters.retries.fetch_add(1, Ordering::Relaxed);
+                    thread::sleep(delay);
+                    attempt += 1;
+                }
+                result => return result,
+            }
+        }
+    }
+
+    /// The delay to wait after the specified attempt
+    fn delay(&self, attempt: u32) -> Duration {
+        let factor = 1u32.checked_shl(attempt - 1).unwrap_or(u32::max_value());
+        let backoff = self
+            .base_delay
+            .checked_mul(factor)
+            .map(|delay| cmp::min(delay, self.max_delay))
+            .unwrap_or(self.max_delay);
+        if self.jitter {
+            let nanos = backoff.as_nanos() as u64;
+            Duration::from_nanos(next_random() % nanos.saturating_add(1))
+        } else {
+            backoff
+        }
+    }
+}
+
+impl Default for RetryPolicy {
+    fn default() -> Self {
+        RetryPolicy {
+            max_attempts: 3,
+            base_delay: Duration::from_millis(50),
+            max_delay: Duration::from_secs(2),
+            jitter: true,
+            deadline: None,
+            counters: Arc::new(RetryCounters::default()),
+        }
+    }
+}
+
+/// Calls the function, retrying it with the policy if one is defined
+pub(crate) fn retry<R, F>(policy: &Option<RetryPolicy>, mut f: F) -> GGResult<R>
+where
+    F: FnMut() -> GGResult<R>,
+{
+    match policy {
+        Some(policy) => policy.run(f),
+        None => f(),
+    }
+}
+
+/// Holds a function that consumes the response of a request made within [`retry`].
+///
+/// The closure passed to [`retry`] may be called many times, so it can't move a `FnOnce` into
+/// the response handling. The function is only called with a successful response, which is
+/// never retried, so taking it out of the cell on first use is enough.
+pub(crate) struct RetryOnce<F>(Cell<Option<F>>);
+
+impl<F> RetryOnce<F> {
+    pub(crate) fn new(f: F) -> Self {
+        RetryOnce(Cell::new(Some(f)))
+    }
+
+    /// Calls the function, or returns `GGError::InvalidState` if it was already called
+    pub(crate) fn call<A, R>(&self, arg: A) -> GGResult<R>
+    where
+        F: FnOnce(A) -> GGResult<R>,
+    {
+        match self.0.take() {
+            Some(f) => f(arg),
+            None => Err(GGError::InvalidState),
+        }
+    }
+}
+
+/// True if greengrass rejected the request because it is throttling
+fn is_throttled(error: &GGError) -> bool {
+    match error {
+        GGError::ErrorResponse(response) => response.request_status == GGRequestStatus::Again,
+        _ => false,
+    }
+}
+
+/// xorshift64*, which is plenty for spreading out retries
+fn next_random() -> u64 {
+    RNG_STATE.with(|state| {
+        let mut x = state.get();
+        x ^= x >> 12;
+        x ^= x << 25;
+        x ^= x >> 27;
+        state.set(x);
+        x.wrapping_mul(0x2545_F491_4F6C_DD1D)
+    })
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+    use crate::request::GGRequestResponse;
+
+    fn throttled() -> GGError {
+        GGError::ErrorResponse(GGRequestResponse {
+            request_status: GGRequestStatus::Again,
+            error_response: None,
+        })
+    }
+
+    fn policy() -> RetryPolicy {
+        RetryPolicy::default()
+            .with_base_delay(Duration::from_millis(1))
+            .with_jitter(false)
+    }
+
+    #[test]
+    fn test_retries_until_success() {
+        let policy = policy().with_max_attempts(5);
+        let mut calls = 0;
+        let result = policy.run(|| {
+            calls += 1;
+            if calls < 3 {
+                Err(throttled())
+            } else {
+                Ok(calls)
+            }
+        });
+        assert_eq!(result.unwrap(), 3);
+        assert_eq!(
+            policy.stats(),
+            RetryStats {
+                retries: 2,
+                give_ups: 0
+            }
+        );
+    }
+
+    #[test]
+    fn test_gives_up_after_max_attempts() {
+        let policy = policy().with_max_attempts(3);
+        let mut calls = 0;
+        let result: GGResult<()> = policy.run(|| {
+            calls += 1;
+            Err(throttled())
+        });
+        assert!(is_throttled(&result.unwrap_err()));
+        assert_eq!(calls, 3);
+        assert_eq!(
+            policy.clone().stats(),
+            RetryStats {
+                retries: 2,
+                give_ups: 1
+            }
+        );
+    }
+
+    #[test]
+    fn test_other_errors_are_not_retried() {
+        let policy = policy();
+        let mut calls = 0;
+        let result: GGResult<()> = policy.run(|| {
+            calls += 1;
+            Err(GGError::InvalidState)
+        });
+        assert!(result.is_err());
+        assert_eq!(calls, 1);
+        assert_eq!(policy.stats(), RetryStats::default());
+    }
+
+    #[test]
+    fn test_deadline() {
+        let policy = policy()
+            .with_max_attempts(100)
+            .with_base_delay(Duration::from_millis(20))
+            .with_deadline(Some(Duration::from_millis(50)));
+        let mut calls = 0;
+        let result: GGResult<()> = policy.run(|| {
+            calls += 1;
+            Err(throttled())
+        });
+        assert!(result.is_err());
+        // 20ms + 40ms would pass the deadline
+        assert_eq!(calls, 2);
+        assert_eq!(policy.stats().give_ups, 1);
+    }
+
+    #[test]
+    fn test_retry_once() {
+        let once = RetryOnce::new(|value: u32| Ok(value + 1));
+        assert_eq!(once.call(1).unwrap(), 2);
+        match once.call(1) {
+            Err(GGError::InvalidState) => (),
+            other => panic!("Expected InvalidState, got {:?}", other),
+        }
+    }
+
+    #[test]
+    fn test_delay() {
+        let policy = RetryPolicy::default()
+            .with_base_delay(Duration::from_millis(10))
+            .with_max_delay(Duration::from_millis(50))
+            .with_jitter(false);
+        assert_eq!(policy.delay(1), Duration::from_millis(10));
+        assert_eq!(policy.delay(3), Duration::from_millis(40));
+        assert_eq!(policy.delay(4), Duration::from_millis(50));
+        assert_eq!(policy.delay(64), Duration::from_millis(50));
+
+        let jittered = policy.with_jitter(true);
+        for attempt in 1..10 {
+            assert!(jittered.delay(attempt) <= Duration::from_millis(50));
+        }
+    }
+}
@@ -10,25 +10,44 @@ use crate::bindings::*;
 use crate::error::GGError;
 use crate::handler::{Handler, LambdaContext};
 use crate::GGResult;
-use crossbeam_channel::{unbounded, Receiver, Sender};
+use crossbeam_channel::{bounded, unbounded, Receiver, SendError, Sender, TrySendError};
 use lazy_static::lazy_static;
 use log::{error, info};
+use std::cell::Cell;
+use std::collections::hash_map::DefaultHasher;
+use std::convert::TryFrom;
 use std::default::Default;
 use std::ffi::CStr;
+use std::fs::{File, OpenOptions};
+use std::hash::{Hash, Hasher};
+use std::io::{self, Read, Seek, SeekFrom, Write};
 use std::os::raw::c_void;
-use std::sync::Arc;
+use std::path::PathBuf;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::{Arc, Mutex, RwLock};
 use std::thread;
 
-/// The size of the buffer for reading content received via the C SDK
-const BUFFER_SIZE: usize = 100;
+/// The smallest buffer used for reading content received via the C SDK
+const MIN_BUFFER_SIZE: usize = 4096;
 
 /// Denotes a handler that is thread safe
 pub type ShareableHandler = dyn Handler + Send + Sync;
 
+/// A function that computes the ordering key of an event. See [`DispatchOrdering::ByKey`]
+pub type KeyFn = dyn Fn(&LambdaContext) -> u64 + Send + Sync;
+
+thread_local! {
+    // The buffer capacity that fit the recent messages read on this thread.
+    // Greengrass calls the c handler from the same thread, so each read can start
+    // with a buffer large enough to read a typical message with a single call.
+    static READ_CAPACITY_HINT: Cell<usize> = Cell::new(MIN_BUFFER_SIZE);
+}
+
 lazy_static! {
     // This establishes a thread safe global channel that can
-    // be acquired from the callback function we register with the C Api
-    static ref CHANNEL: Arc<ChannelHolder> = ChannelHolder::new();
+    // be acquired from the callback function we register with the C Api.
+    // It is replaced with a channel built from the runtime's ChannelOptions when the runtime starts.
+    static ref CHANNEL: RwLock<Arc<ChannelHolder>> = RwLock::new(ChannelHolder::new(ChannelOptions::default()));
 }
 
 /// Type of runtime. Currently only one, Async exits
@@ -52,11 +71,121 @@ impl RuntimeOption {
     }
 }
 
+/// Determines which ordering guarantees are kept when events are handled by more than one worker.
+/// Events that share an ordering key are always handled by the same worker in the order they were received.
+pub enum DispatchOrdering {
+    /// Events are handled by whichever worker is free. This is the default option.
+    Unordered,
+    /// Events published to the same MQTT topic are handled in order. See [`LambdaContext::topic`]
+    ByTopic,
+    /// Events for the same function arn are handled in order
+    ByFunctionArn,
+    /// Events that produce the same key are handled in order
+    ByKey(Box<KeyFn>),
+}
+
+impl DispatchOrdering {
+    /// Returns the ordering key for the event or None if the event can be handled by any worker
+    fn key(&self, ctx: &LambdaContext) -> Option<u64> {
+        match self {
+            Self::Unordered => None,
+            Self::ByTopic => Some(hash_of(&ctx.topic())),
+            Self::ByFunctionArn => Some(hash_of(&ctx.function_arn)),
+            Self::ByKey(key_fn) => Some(key_fn(ctx)),
+        }
+    }
+}
+
+fn hash_of<T: Hash>(value: &T) -> u64 {
+    let mut hasher = DefaultHasher::new();
+    value.hash(&mut hasher);
+    hasher.finish()
+}
+
+/// What should happen to an event received from greengrass when the handler channel is full
+#[derive(Clone, Debug, PartialEq)]
+pub enum OverflowPolicy {
+    /// Block the greengrass callback until a worker makes room. This is the default option.
+    Block,
+    /// Discard the oldest queued event to make room for the new one
+    DropOldest,
+    /// Discard the event that was just received
+    DropNewest,
+    /// Append events to the specified file until the workers catch up.
+    /// Spilled events are handled in the order they were received.
+    SpillToDisk(PathBuf),
+}
+
+/// Options for the channel that passes events from greengrass to the handler workers
+#[derive(Clone, Debug)]
+pub struct ChannelOptions {
+    /// The maximum number of queued events. None is unbounded, and a capacity of 0 is treated as 1.
+    /// When workers keep an ordering, each worker also queues up to its share of the capacity.
+    pub capacity: Option<usize>,
+    /// What to do when a bounded channel is full
+    pub overflow_policy: OverflowPolicy,
+}
+
+impl ChannelOptions {
+    /// Bound the number of events that can be queued for the handler. Defaults to unbounded.
+    ///
+    /// The capacity is at least 1. A channel without room would only pass an event on when a
+    /// worker is already waiting for one, so a capacity of 0 is raised to 1.
+    pub fn with_capacity(self, capacity: Option<usize>) -> Self {
+        ChannelOptions {
+            capacity: capacity.map(|capacity| capacity.max(1)),
+            ..self
+        }
+    }
+
+    /// Define what happens to events that are received while the channel is full
+    pub fn with_overflow_policy(self, overflow_policy: OverflowPolicy) -> Self {
+        ChannelOptions {
+            overflow_policy,
+            ..self
+        }
+    }
+}
+
+impl Default for ChannelOptions {
+    fn default() -> Self {
+        ChannelOptions {
+            capacity: None,
+            overflow_policy: OverflowPolicy::Block,
+        }
+    }
+}
+
+/// A snapshot of the counters of the handler channel
+#[derive(Clone, Debug, Default, PartialEq)]
+pub struct ChannelStats {
+    /// Number of events received from greengrass
+    pub received: usize,
+    /// Number of events discarded because the channel was full
+    pub dropped: usize,
+    /// Number of events written to the spill file
+    pub spilled: usize,
+    /// The largest number of events that were waiting to be handled at once
+    pub high_water_mark: usize,
+}
+
+/// Returns the counters of the handler channel of the running runtime
+pub fn channel_stats() -> ChannelStats {
+    current_channel().stats()
+}
+
+fn current_channel() -> Arc<ChannelHolder> {
+    Arc::clone(&CHANNEL.read().expect("handler channel lock poisoned"))
+}
+
 /// Configures and instantiates the green grass core runtime
 /// Runtime can only be started by the Initializer. You must pass the runtime into the [`Initializer::with_runtime`] method.
 pub struct Runtime {
     runtime_option: RuntimeOption,
     handler: Option<Box<ShareableHandler>>,
+    workers: usize,
+    ordering: DispatchOrdering,
+    channel_options: ChannelOptions,
 }
 
 impl Default for Runtime {
@@ -64,6 +193,9 @@ impl Default for Runtime {
         Runtime {
             runtime_option: RuntimeOption::Sync,
             handler: None,
+            workers: 1,
+            ordering: DispatchOrdering::Unordered,
+            channel_options: ChannelOptions::default(),
         }
     }
 }
@@ -73,15 +205,12 @@ impl Runtime {
     pub(crate) fn start(self) -> GGResult<()> {
         unsafe {
             // If there is a handler defined, then register the
-            // the c delegating handler and start a thread that
-            // monitors the channel for messages from the c handler
+            // the c delegating handler and start the worker threads that
+            // monitor the channel for messages from the c handler
             let c_handler = if let Some(handler) = self.handler {
-                thread::spawn(move || loop {
-                    match ChannelHolder::recv() {
-                        Ok(context) => handler.handle(context),
-                        Err(e) => error!("{}", e),
-                    }
-                });
+                let channel = ChannelHolder::new(self.channel_options);
+                *CHANNEL.write().expect("handler channel lock poisoned") = Arc::clone(&channel);
+                spawn_workers(channel, Arc::from(handler), self.workers, self.ordering);
 
                 delgating_handler
             } else {
@@ -121,6 +250,121 @@ impl Runtime {
     pub fn with_handler(self, handler: Option<Box<ShareableHandler>>) -> Self {
         Runtime { handler, ..self }
     }
+
+    /// The number of worker threads that will call the handler concurrently. Defaults to 1.
+    ///
+    /// With more than one worker events may be handled out of order, see [`Runtime::with_ordering`].
+    ///
+    /// ```rust
+    /// use aws_greengrass_core_rust::runtime::{Runtime, DispatchOrdering};
+    ///
+    /// Runtime::default()
+    ///     .with_workers(4)
+    ///     .with_ordering(DispatchOrdering::ByTopic);
+    /// ```
+    pub fn with_workers(self, workers: usize) -> Self {
+        Runtime {
+            workers: workers.max(1),
+            ..self
+        }
+    }
+
+    /// Provide the ordering guarantees kept between workers. Defaults to [`DispatchOrdering::Unordered`]
+    pub fn with_ordering(self, ordering: DispatchOrdering) -> Self {
+        Runtime { ordering, ..self }
+    }
+
+    /// Provide non-default options for the channel between greengrass and the handler.
+    /// By default the channel is unbounded.
+    ///
+    /// ```rust
+    /// use aws_greengrass_core_rust::runtime::{ChannelOptions, OverflowPolicy, Runtime};
+    ///
+    /// let options = ChannelOptions::default()
+    ///     .with_capacity(Some(1000))
+    ///     .with_overflow_policy(OverflowPolicy::DropOldest);
+    /// Runtime::default().with_channel_options(options);
+    /// ```
+    pub fn with_channel_options(self, channel_options: ChannelOptions) -> Self {
+        Runtime {
+            channel_options,
+            ..self
+        }
+    }
+}
+
+/// Starts the threads that pull events from the channel and pass them to the handler.
+///
+/// When the ordering is unordered every worker pulls from the channel directly. Otherwise a
+/// dispatching thread assigns each event to a worker based on the event's ordering key, through
+/// a queue per worker that shares the channel's capacity and overflow policy.
+fn spawn_workers(
+    channel: Arc<ChannelHolder>,
+    handler: Arc<ShareableHandler>,
+    workers: usize,
+    ordering: DispatchOrdering,
+) {
+    let unordered = match ordering {
+        DispatchOrdering::Unordered => true,
+        _ => false,
+    };
+    if workers <= 1 || unordered {
+        for _ in 0..workers {
+            let worker_channel = Arc::clone(&channel);
+            spawn_worker(move || worker_channel.recv(), Arc::clone(&handler));
+        }
+        return;
+    }
+
+    let queues: Vec<WorkerQueue> = (0..workers)
+        .map(|_| {
+            let queue = channel.worker_queue(workers);
+            let worker_receiver = queue.receiver.clone();
+            let worker_channel = Arc::clone(&channel);
+            spawn_worker(
+                move || {
+                    let context = worker_receiver.recv()?;
+                    worker_channel
+                        .worker_backlog
+                        .fetch_sub(1, Ordering::Relaxed);
+                    Ok(context)
+                },
+                Arc::clone(&handler),
+            );
+            queue
+        })
+        .collect();
+
+    thread::spawn(move || loop {
+        match channel.recv() {
+            Ok(context) => {
+                let index = ordering.key(&context).unwrap_or(0) % queues.len() as u64;
+                if let Err(e) = channel.dispatch(&queues[index as usize], context) {
+                    error!("Error sending to handler worker: {}", e);
+                }
+            }
+            Err(e) => {
+                error!("{}", e);
+                break;
+            }
+        }
+    });
+}
+
+/// Starts a thread that calls the handler for every event received until the channel disconnects
+fn spawn_worker<F>(recv: F, handler: Arc<ShareableHandler>)
+where
+    F: Fn() -> GGResult<LambdaContext> + Send + 'static,
+{
+    thread::spawn(move || loop {
+        match recv() {
+            Ok(context) => handler.handle(context),
+            Err(e) => {
+                error!("{}", e);
+                break;
+            }
+        }
+    });
 }
 
 /// c handler that performs a no op
@@ -133,7 +377,7 @@ extern "C" fn no_op_handler(_: *const gg_lambda_context) {
 extern "C" fn delgating_handler(c_ctx: *const gg_lambda_context) {
     info!("delegating_handler called!");
     unsafe {
-        let result = build_context(c_ctx).and_then(ChannelHolder::send);
+        let result = build_context(c_ctx).and_then(|context| current_channel().send(context));
         if let Err(e) = result {
             error!("{}", e);
         }
@@ -155,65 +399,405 @@ unsafe fn build_context(c_ctx: *const gg_lambda_context) -> GGResult<LambdaConte
 }
 
 /// Wraps the C gg_lambda_handler_read call
+///
+/// The message is read directly into the spare capacity of the returned vector, which
+/// starts at the size of recent messages and doubles whenever it fills up.
 unsafe fn handler_read_message() -> GGResult<Vec<u8>> {
-    let mut collected: Vec<u8> = Vec::new();
+    let mut collected: Vec<u8> = Vec::with_capacity(READ_CAPACITY_HINT.with(Cell::get));
     loop {
-        let mut buffer = [0u8; BUFFER_SIZE];
+        if collected.len() == collected.capacity() {
+            collected.reserve(collected.capacity());
+        }
+        let spare = collected.capacity() - collected.len();
         let mut read: usize = 0;
 
         let raw_read = &mut read as *mut usize;
 
-        let pub_res =
-            gg_lambda_handler_read(buffer.as_mut_ptr() as *mut c_void, BUFFER_SIZE, raw_read);
+        let pub_res = gg_lambda_handler_read(
+            collected.as_mut_ptr().add(collected.len()) as *mut c_void,
+            spare,
+            raw_read,
+        );
 
         GGError::from_code(pub_res)?;
 
         if read > 0 {
-            collected.extend_from_slice(&buffer[..read]);
+            collected.set_len(collected.len() + read.min(spare));
         } else {
             break;
         }
     }
+    READ_CAPACITY_HINT.with(|hint| hint.set(next_capacity_hint(hint.get(), collected.len())));
     Ok(collected)
 }
 
+/// Reads the message of the event being handled.
+/// Only public so that the benchmarks can measure the read path, which is otherwise driven by the runtime.
+///
+/// # Safety
+/// The C SDK only allows the message to be read from within the lambda handler. Outside the handler this is
+/// only sound against the stubbed C SDK, after a message has been set with `gg_sim_set_handler_message`.
+#[doc(hidden)]
+pub unsafe fn bench_handler_read_message() -> GGResult<Vec<u8>> {
+    handler_read_message()
+}
+
+/// Grows the hint straight to the capacity the last message needed, including room for the
+/// final zero length read, and shrinks it by half at a time so one small message does not
+/// undo the capacity large messages need.
+fn next_capacity_hint(hint: usize, message_len: usize) -> usize {
+    let needed = (message_len + 1).next_power_of_two().max(MIN_BUFFER_SIZE);
+    if needed >= hint {
+        needed
+    } else {
+        needed.max(hint / 2)
+    }
+}
+
+/// The queue of a single worker when events are assigned to workers by ordering key
+struct WorkerQueue {
+    sender: Sender<LambdaContext>,
+    receiver: Receiver<LambdaContext>,
+}
+
 /// Wraps a Channel.
 /// This is mostly needed as there is no way to instantiate a static ref with a tuple (see CHANNEL above)
 struct ChannelHolder {
     sender: Sender<LambdaContext>,
     receiver: Receiver<LambdaContext>,
+    capacity: Option<usize>,
+    overflow_policy: OverflowPolicy,
+    /// Only defined when the overflow policy is SpillToDisk
+    spill: Option<Mutex<SpillFile>>,
+    received: AtomicUsize,
+    dropped: AtomicUsize,
+    spilled: AtomicUsize,
+    high_water_mark: AtomicUsize,
+    /// Events waiting in the worker queues
+    worker_backlog: AtomicUsize,
 }
 
 impl ChannelHolder {
-    pub fn new() -> Arc<Self> {
-        let (sender, receiver) = unbounded();
-        let holder = ChannelHolder { sender, receiver };
+    pub fn new(options: ChannelOptions) -> Arc<Self> {
+        // the field is public, so options built without with_capacity are raised to 1 here too
+        let capacity = options.capacity.map(|capacity| capacity.max(1));
+        let (sender, receiver) = match capacity {
+            Some(capacity) => bounded(capacity),
+            None => unbounded(),
+        };
+        let spill = match (&capacity, &options.overflow_policy) {
+            (Some(_), OverflowPolicy::SpillToDisk(path)) => {
+                Some(Mutex::new(SpillFile::new(path.to_owned())))
+            }
+            _ => None,
+        };
+        let holder = ChannelHolder {
+            sender,
+            receiver,
+            capacity,
+            overflow_policy: options.overflow_policy,
+            spill,
+            received: AtomicUsize::new(0),
+            dropped: AtomicUsize::new(0),
+            spilled: AtomicUsize::new(0),
+            high_water_mark: AtomicUsize::new(0),
+            worker_backlog: AtomicUsize::new(0),
+        };
         Arc::new(holder)
     }
 
-    /// Performs a send with CHANNEL and coerces the error type
-    fn send(context: LambdaContext) -> GGResult<()> {
-        Arc::clone(&CHANNEL)
-            .sender
-            .send(context)
-            .map_err(GGError::from)
+    /// Creates a worker queue holding an equal share of the channel's capacity
+    fn worker_queue(&self, workers: usize) -> WorkerQueue {
+        let (sender, receiver) = match self.capacity {
+            Some(capacity) => bounded((capacity / workers).max(1)),
+            None => unbounded(),
+        };
+        WorkerQueue { sender, receiver }
+    }
+
+    /// Queues the context for the handler, applying the overflow policy if the channel is full
+    fn send(&self, context: LambdaContext) -> GGResult<()> {
+        self.received.fetch_add(1, Ordering::Relaxed);
+        let result = match &self.spill {
+            Some(spill) => self.send_or_spill(spill, context),
+            None => self
+                .send_dropping(&self.sender, &self.receiver, context)
+                .map(|dropped| {
+                    self.dropped.fetch_add(dropped, Ordering::Relaxed);
+                }),
+        };
+        self.record_queue_length();
+        result
+    }
+
+    /// Passes the context on to a worker's queue, applying the drop policies if it is full.
+    /// Otherwise the dispatcher waits for room, so the channel fills up and blocks or spills.
+    fn dispatch(&self, queue: &WorkerQueue, context: LambdaContext) -> GGResult<()> {
+        // counted before sending so that the worker never takes the backlog below zero
+        self.worker_backlog.fetch_add(1, Ordering::Relaxed);
+        let result = match self.send_dropping(&queue.sender, &queue.receiver, context) {
+            Ok(dropped) => {
+                self.worker_backlog.fetch_sub(dropped, Ordering::Relaxed);
+                self.dropped.fetch_add(dropped, Ordering::Relaxed);
+                Ok(())
+            }
+            Err(e) => {
+                self.worker_backlog.fetch_sub(1, Ordering::Relaxed);
+                Err(e)
+            }
+        };
+        self.record_queue_length();
+        result
+    }
+
+    /// Sends the context, discarding it or older contexts when the queue is full and the policy
+    /// is to drop. Returns the number of contexts discarded.
+    fn send_dropping(
+        &self,
+        sender: &Sender<LambdaContext>,
+        receiver: &Receiver<LambdaContext>,
+        mut context: LambdaContext,
+    ) -> GGResult<usize> {
+        match self.overflow_policy {
+            OverflowPolicy::DropNewest => match sender.try_send(context) {
+                Err(TrySendError::Full(_)) => Ok(1),
+                other => other.map(|_| 0).map_err(from_try_send_error),
+            },
+            OverflowPolicy::DropOldest => {
+                let mut dropped = 0;
+                loop {
+                    match sender.try_send(context) {
+                        Err(TrySendError::Full(returned)) => {
+                            if receiver.try_recv().is_ok() {
+                                dropped += 1;
+                            }
+                            context = returned;
+                        }
+                        other => return other.map(|_| dropped).map_err(from_try_send_error),
+                    }
+                }
+            }
+            _ => sender.send(context).map(|_| 0).map_err(GGError::from),
+        }
+    }
+
+    /// Once anything has been spilled, everything is spilled until the
+    /// spill file is drained so that events stay in order
+    fn send_or_spill(&self, spill: &Mutex<SpillFile>, context: LambdaContext) -> GGResult<()> {
+        let mut spill = spill.lock().expect("spill file lock poisoned");
+        let context = if spill.pending == 0 {
+            match self.sender.try_send(context) {
+                Err(TrySendError::Full(returned)) => returned,
+                other => return other.map_err(from_try_send_error),
+            }
+        } else {
+            context
+        };
+        match spill.write(&context) {
+            Ok(_) => self.spilled.fetch_add(1, Ordering::Relaxed),
+            Err(e) => {
+                error!("Could not spill event to {:?}: {}", spill.path, e);
+                self.dropped.fetch_add(1, Ordering::Relaxed)
+            }
+        };
+        Ok(())
+    }
+
+    /// Receives the next context, moving spilled contexts back into the channel first
+    fn recv(&self) -> GGResult<LambdaContext> {
+        if let Some(spill) = &self.spill {
+            let mut spill = spill.lock().expect("spill file lock poisoned");
+            while spill.pending > 0 && !self.sender.is_full() {
+                match spill.read() {
+                    Ok(context) => self.sender.try_send(context).map_err(from_try_send_error)?,
+                    Err(e) => {
+                        error!("Could not read spilled event from {:?}: {}", spill.path, e);
+                        let lost = spill.pending;
+                        self.dropped.fetch_add(lost, Ordering::Relaxed);
+                        spill.reset();
+                    }
+                }
+            }
+        }
+        self.receiver.recv().map_err(GGError::from)
+    }
+
+    fn record_queue_length(&self) {
+        let spill_pending = self.spill.as_ref().map_or(0, |spill| {
+            spill.lock().expect("spill file lock poisoned").pending
+        });
+        let queued =
+            self.sender.len() + spill_pending + self.worker_backlog.load(Ordering::Relaxed);
+        let mut current = self.high_water_mark.load(Ordering::Relaxed);
+        while queued > current {
+            match self.high_water_mark.compare_exchange_weak(
+                current,
+                queued,
+                Ordering::Relaxed,
+                Ordering::Relaxed,
+            ) {
+                Ok(_) => break,
+                Err(actual) => current = actual,
+            }
+        }
     }
 
-    /// Performs a recv with CHANNEL and coerces the error type
-    fn recv() -> GGResult<LambdaContext> {
-        Arc::clone(&CHANNEL).receiver.recv().map_err(GGError::from)
+    fn stats(&self) -> ChannelStats {
+        ChannelStats {
+            received: self.received.load(Ordering::Relaxed),
+            dropped: self.dropped.load(Ordering::Relaxed),
+            spilled: self.spilled.load(Ordering::Relaxed),
+            high_water_mark: self.high_water_mark.load(Ordering::Relaxed),
+        }
+    }
+}
+
+fn from_try_send_error(e: TrySendError<LambdaContext>) -> GGError {
+    match e {
+        TrySendError::Full(context) | TrySendError::Disconnected(context) => {
+            GGError::from(SendError(context))
+        }
+    }
+}
+
+/// File that events are written to when the channel is full.
+/// Each event is stored as three length prefixed fields: function arn, client context and message.
+struct SpillFile {
+    path: PathBuf,
+    file: Option<File>,
+    read_position: u64,
+    write_position: u64,
+    /// The number of events written that have not been read back
+    pending: usize,
+}
+
+impl SpillFile {
+    fn new(path: PathBuf) -> Self {
+        SpillFile {
+            path,
+            file: None,
+            read_position: 0,
+            write_position: 0,
+            pending: 0,
+        }
+    }
+
+    fn open(&mut self) -> io::Result<&mut File> {
+        if self.file.is_none() {
+            let file = OpenOptions::new()
+                .read(true)
+                .write(true)
+                .create(true)
+                .truncate(true)
+                .open(&self.path)?;
+            self.file = Some(file);
+        }
+        Ok(self.file.as_mut().unwrap())
+    }
+
+    fn write(&mut self, context: &LambdaContext) -> io::Result<()> {
+        let fields = [
+            context.function_arn.as_bytes(),
+            context.client_context.as_bytes(),
+            context.message.as_slice(),
+        ];
+        let mut record = Vec::with_capacity(fields.iter().map(|f| f.len() + 4).sum());
+        for field in fields.iter() {
+            let len = u32::try_from(field.len())
+                .map_err(|_| io::Error::new(io::ErrorKind::InvalidInput, "event too large"))?;
+            record.extend_from_slice(&len.to_le_bytes());
+            record.extend_from_slice(field);
+        }
+        let position = self.write_position;
+        let file = self.open()?;
+        file.seek(SeekFrom::Start(position))?;
+        file.write_all(&record)?;
+        self.write_position += record.len() as u64;
+        self.pending += 1;
+        Ok(())
+    }
+
+    fn read(&mut self) -> io::Result<LambdaContext> {
+        let position = self.read_position;
+        let file = self.open()?;
+        file.seek(SeekFrom::Start(position))?;
+        let function_arn = read_field(file)?;
+        let client_context = read_field(file)?;
+        let message = read_field(file)?;
+        self.read_position +=
+            (12 + function_arn.len() + client_context.len() + message.len()) as u64;
+        self.pending -= 1;
+        if self.pending == 0 {
+            self.reset();
+        }
+        Ok(LambdaContext::new(
+            String::from_utf8_lossy(&function_arn).to_string(),
+            String::from_utf8_lossy(&client_context).to_string(),
+            message,
+        ))
+    }
+
+    /// Discards everything in the file
+    fn reset(&mut self) {
+        self.read_position = 0;
+        self.write_position = 0;
+        self.pending = 0;
+        if let Some(file) = &self.file {
+            if let Err(e) = file.set_len(0) {
+                error!("Could not truncate spill file {:?}: {}", self.path, e);
+            }
+        }
     }
 }
 
+fn read_field(file: &mut File) -> io::Result<Vec<u8>> {
+    let mut len = [0u8; 4];
+    file.read_exact(&mut len)?;
+    let mut field = vec![0u8; u32::from_le_bytes(len) as usize];
+    file.read_exact(&mut field)?;
+    Ok(field)
+}
+
 #[cfg(test)]
 mod test {
     use super::*;
     use crate::handler::{Handler, LambdaContext};
     use crate::Initializer;
-    use crossbeam_channel::{bounded, Sender};
+    use crossbeam_channel::{bounded, Receiver, Sender};
     use std::ffi::CString;
+    use std::sync::Barrier;
     use std::time::Duration;
 
+    #[cfg(not(feature = "mock"))]
+    #[test]
+    fn test_handler_read_message_call_count() {
+        reset_test_state();
+        let message: Vec<u8> = (0..256 * 1024).map(|i| i as u8).collect();
+        READ_CAPACITY_HINT.with(|hint| hint.set(MIN_BUFFER_SIZE));
+
+        // The first read grows from the minimum buffer size: 4k, 8k, ... 256k plus the final empty read.
+        // This took 2623 calls with the original fixed 100 byte buffer
+        GG_LAMBDA_HANDLER_READ_BUFFER.with(|b| b.replace(message.clone()));
+        let read = unsafe { handler_read_message().unwrap() };
+        assert_eq!(read, message);
+        GG_LAMBDA_HANDLER_READ_COUNT.with(|rc| assert_eq!(*rc.borrow(), 8));
+
+        // The following reads reuse the capacity hint and need a single call plus the final empty read
+        GG_LAMBDA_HANDLER_READ_COUNT.with(|rc| rc.replace(0));
+        GG_LAMBDA_HANDLER_READ_BUFFER.with(|b| b.replace(message.clone()));
+        let read = unsafe { handler_read_message().unwrap() };
+        assert_eq!(read, message);
+        GG_LAMBDA_HANDLER_READ_COUNT.with(|rc| assert_eq!(*rc.borrow(), 2));
+    }
+
+    #[test]
+    fn test_next_capacity_hint() {
+        assert_eq!(next_capacity_hint(MIN_BUFFER_SIZE, 10), MIN_BUFFER_SIZE);
+        assert_eq!(next_capacity_hint(MIN_BUFFER_SIZE, 5000), 8192);
+        assert_eq!(next_capacity_hint(8192, 8192), 16384);
+        assert_eq!(next_capacity_hint(65536, 10), 32768);
+    }
+
     #[test]
     fn test_build_context() {
         unsafe {
@@ -284,4 +868,220 @@ mod test {
             .expect("Context was sent within the timeout period");
         assert_eq!(ctx, context);
     }
+
+    /// Handler that will not return until every worker is inside of it
+    struct BarrierHandler {
+        barrier: Barrier,
+        sender: Sender<LambdaContext>,
+    }
+
+    impl Handler for BarrierHandler {
+        fn handle(&self, ctx: LambdaContext) {
+            self.barrier.wait();
+            self.sender.send(ctx).expect("Could not send context");
+        }
+    }
+
+    fn numbered_context(key: u8, sequence: u8) -> LambdaContext {
+        LambdaContext::new(
+            "my_function_arn".to_owned(),
+            "my_context".to_owned(),
+            vec![key, sequence],
+        )
+    }
+
+    #[test]
+    fn test_workers_handle_concurrently() {
+        let workers = 4;
+        let channel = ChannelHolder::new(ChannelOptions::default());
+        let (handled_sender, handled_receiver) = unbounded();
+        let handler = BarrierHandler {
+            barrier: Barrier::new(workers),
+            sender: handled_sender,
+        };
+        spawn_workers(
+            Arc::clone(&channel),
+            Arc::new(handler),
+            workers,
+            DispatchOrdering::Unordered,
+        );
+        for i in 0..workers {
+            channel.send(numbered_context(0, i as u8)).unwrap();
+        }
+        for _ in 0..workers {
+            handled_receiver
+                .recv_timeout(Duration::from_secs(120))
+                .expect("All workers should be handling events at the same time");
+        }
+    }
+
+    #[test]
+    fn test_workers_keep_key_ordering() {
+        let channel = ChannelHolder::new(ChannelOptions::default());
+        let (handled_sender, handled_receiver) = unbounded();
+        let ordering =
+            DispatchOrdering::ByKey(Box::new(|ctx: &LambdaContext| ctx.message[0] as u64));
+        spawn_workers(
+            Arc::clone(&channel),
+            Arc::new(TestHandler::new(handled_sender)),
+            3,
+            ordering,
+        );
+        for sequence in 0..50 {
+            for key in 0..5 {
+                channel.send(numbered_context(key, sequence)).unwrap();
+            }
+        }
+        let mut last_seen = [None; 5];
+        for _ in 0..250 {
+            let ctx = handled_receiver
+                .recv_timeout(Duration::from_secs(120))
+                .expect("Context was handled within the timeout period");
+            let (key, sequence) = (ctx.message[0] as usize, ctx.message[1]);
+            if let Some(last) = last_seen[key] {
+                assert!(sequence > last, "events for key {} out of order", key);
+            }
+            last_seen[key] = Some(sequence);
+        }
+    }
+
+    /// Handler that waits for the gate to close before handling each event
+    struct GatedHandler {
+        gate: Receiver<()>,
+        sender: Sender<LambdaContext>,
+    }
+
+    impl Handler for GatedHandler {
+        fn handle(&self, ctx: LambdaContext) {
+            let _ = self.gate.recv();
+            self.sender.send(ctx).expect("Could not send context");
+        }
+    }
+
+    #[test]
+    fn test_ordered_workers_keep_channel_bounds() {
+        let options = ChannelOptions::default()
+            .with_capacity(Some(4))
+            .with_overflow_policy(OverflowPolicy::DropNewest);
+        let channel = ChannelHolder::new(options);
+        let (gate_sender, gate) = bounded::<()>(0);
+        let (handled_sender, handled_receiver) = unbounded();
+        let ordering =
+            DispatchOrdering::ByKey(Box::new(|ctx: &LambdaContext| ctx.message[0] as u64));
+        spawn_workers(
+            Arc::clone(&channel),
+            Arc::new(GatedHandler {
+                gate,
+                sender: handled_sender,
+            }),
+            2,
+            ordering,
+        );
+        for sequence in 0..20 {
+            channel
+                .send(numbered_context(sequence % 2, sequence))
+                .unwrap();
+        }
+
+        // While the handlers are stuck, at most the channel's 4, a queue of 2 per worker,
+        // the event held by the dispatcher and the 2 events being handled are kept.
+        // The rest must be dropped.
+        let deadline = std::time::Instant::now() + Duration::from_secs(120);
+        while channel.stats().dropped < 9 {
+            assert!(
+                std::time::Instant::now() < deadline,
+                "events were not dropped"
+            );
+            thread::sleep(Duration::from_millis(1));
+        }
+        assert!(channel.stats().high_water_mark <= 9);
+
+        drop(gate_sender);
+        let mut handled = 0;
+        let mut last_seen = [None; 2];
+        while handled + channel.stats().dropped < 20 {
+            let ctx = handled_receiver
+                .recv_timeout(Duration::from_secs(120))
+                .expect("Context was handled within the timeout period");
+            let (key, sequence) = (ctx.message[0] as usize, ctx.message[1]);
+            if let Some(last) = last_seen[key] {
+                assert!(sequence > last, "events for key {} out of order", key);
+            }
+            last_seen[key] = Some(sequence);
+            handled += 1;
+        }
+        let stats = channel.stats();
+        assert_eq!(stats.received, 20);
+        assert_eq!(handled + stats.dropped, 20);
+    }
+
+    fn bounded_channel(overflow_policy: OverflowPolicy) -> Arc<ChannelHolder> {
+        let options = ChannelOptions::default()
+            .with_capacity(Some(2))
+            .with_overflow_policy(overflow_policy);
+        ChannelHolder::new(options)
+    }
+
+    #[test]
+    fn test_drop_newest() {
+        let channel = bounded_channel(OverflowPolicy::DropNewest);
+        for sequence in 0..5 {
+            channel.send(numbered_context(0, sequence)).unwrap();
+        }
+        assert_eq!(channel.recv().unwrap().message[1], 0);
+        assert_eq!(channel.recv().unwrap().message[1], 1);
+        let stats = channel.stats();
+        assert_eq!(stats.received, 5);
+        assert_eq!(stats.dropped, 3);
+        assert_eq!(stats.high_water_mark, 2);
+    }
+
+    #[test]
+    fn test_drop_oldest() {
+        let channel = bounded_channel(OverflowPolicy::DropOldest);
+        for sequence in 0..5 {
+            channel.send(numbered_context(0, sequence)).unwrap();
+        }
+        assert_eq!(channel.recv().unwrap().message[1], 3);
+        assert_eq!(channel.recv().unwrap().message[1], 4);
+        assert_eq!(channel.stats().dropped, 3);
+    }
+
+    #[test]
+    fn test_zero_capacity_is_raised_to_one() {
+        let options = ChannelOptions::default().with_capacity(Some(0));
+        assert_eq!(options.capacity, Some(1));
+
+        // without a waiting worker a zero size channel would never have room for the event
+        let channel = ChannelHolder::new(ChannelOptions {
+            capacity: Some(0),
+            overflow_policy: OverflowPolicy::DropOldest,
+        });
+        for sequence in 0..3 {
+            channel.send(numbered_context(0, sequence)).unwrap();
+        }
+        assert_eq!(channel.recv().unwrap().message[1], 2);
+        let stats = channel.stats();
+        assert_eq!(stats.dropped, 2);
+        assert_eq!(stats.high_water_mark, 1);
+    }
+
+    #[test]
+    fn test_spill_to_disk() {
+        let path = std::env::temp_dir().join(format!("gg_spill_{}", uuid::Uuid::new_v4()));
+        let channel = bounded_channel(OverflowPolicy::SpillToDisk(path.clone()));
+        for sequence in 0..10 {
+            channel.send(numbered_context(0, sequence)).unwrap();
+        }
+        for sequence in 0..10 {
+            let ctx = channel.recv().unwrap();
+            assert_eq!(ctx.message, vec![0, sequence]);
+            assert_eq!(ctx.function_arn, "my_function_arn");
+        }
+        let stats = channel.stats();
+        assert_eq!(stats.spilled, 8);
+        assert_eq!(stats.dropped, 0);
+        assert_eq!(stats.high_water_mark, 10);
+        std::fs::remove_file(path).unwrap();
+    }
 }
@@ -10,17 +10,25 @@
 //! that the lambda function has been configured to run in.
 
 use crate::bindings::*;
+#[cfg(not(all(test, feature = "mock")))]
+use crate::blocking::{self, BlockingFuture};
 use crate::error::GGError;
 use crate::request::GGRequestResponse;
+use crate::retry::{retry, RetryPolicy};
 use crate::with_request;
 use crate::GGResult;
 use serde::Deserialize;
+use std::collections::HashMap;
 use std::convert::From;
 use std::convert::TryFrom;
 use std::default::Default;
 use std::ffi::CString;
 use std::os::raw::c_char;
 use std::ptr;
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::{Arc, Condvar, Mutex, MutexGuard};
+use std::thread;
+use std::time::{Duration, Instant};
 
 #[cfg(all(test, feature = "mock"))]
 use self::mock::*;
@@ -52,6 +60,241 @@ impl Secret {
     }
 }
 
+/// The cache key of a secret: the secret id, version and version stage
+type SecretKey = (String, Option<String>, Option<String>);
+
+/// Caches secrets so that repeated requests do not go to greengrass.
+///
+/// Secrets are cached for the ttl. A request for a secret within `refresh_ahead` of its expiry returns the
+/// cached secret and refreshes it in the background, so busy secrets never expire. Concurrent requests for a
+/// secret that isn't cached wait for a single request to greengrass. Secrets that are not found are not cached.
+///
+/// Clones of a cache share their secrets and stats.
+///
+/// # Examples
+/// ```rust
+/// use aws_greengrass_core_rust::secret::{SecretCache, SecretClient};
+/// use std::time::Duration;
+///
+/// let cache = SecretCache::new(Duration::from_secs(300)).with_refresh_ahead(Duration::from_secs(30));
+/// let client = SecretClient::default().with_cache(Some(cache.clone()));
+/// let secret_result = client.for_secret_id("mysecret").request();
+/// println!("cache stats: {:?}", cache.stats());
+/// ```
+#[derive(Clone)]
+pub struct SecretCache {
+    ttl: Duration,
+    refresh_ahead: Duration,
+    inner: Arc<CacheInner>,
+}
+
+/// Counts of the requests made through a [`SecretCache`]
+#[derive(Clone, Debug, Default, PartialEq)]
+pub struct SecretCacheStats {
+    /// Requests answered from the cache
+    pub hits: u64,
+    /// Requests that went to greengrass
+    pub misses: u64,
+    /// Requests that waited for another request for the same secret to greengrass
+    pub coalesced: u64,
+    /// Background refreshes started
+    pub refreshes: u64,
+}
+
+#[derive(Default)]
+struct CacheInner {
+    entries: Mutex<HashMap<SecretKey, CacheEntry>>,
+    /// Notified when a load completes
+    loaded: Condvar,
+    hits: AtomicU64,
+    misses: AtomicU64,
+    coalesced: AtomicU64,
+    refreshes: AtomicU64,
+}
+
+enum CacheEntry {
+    /// A request to greengrass is in flight
+    Loading,
+    Ready {
+        secret: Secret,
+        fetched: Instant,
+        refreshing: bool,
+    },
+}
+
+impl SecretCache {
+    /// A cache that keeps secrets for the ttl
+    pub fn new(ttl: Duration) -> Self {
+        SecretCache {
+            ttl,
+            refresh_ahead: Duration::from_secs(0),
+            inner: Arc::new(CacheInner::default()),
+        }
+    }
+
+    /// Requests within this long of a secret's expiry refresh it in the background
+    pub fn with_refresh_ahead(self, refresh_ahead: Duration) -> Self {
+        SecretCache {
+            refresh_ahead,
+            ..self
+        }
+    }
+
+    /// The requests made through this cache, and its clones, so far
+    pub fn stats(&self) -> SecretCacheStats {
+        SecretCacheStats {
+            hits: self.inner.hits.load(Ordering::Relaxed),
+            misses: self.inner.misses.load(Ordering::Relaxed),
+            coalesced: self.inner.coalesced.load(Ordering::Relaxed),
+            refreshes: self.inner.refreshes.load(Ordering::Relaxed),
+        }
+    }
+
+    /// Removes every cached secret
+    pub fn clear(&self) {
+        let mut entries = self.lock();
+        entries.retain(|_, entry| match entry {
+            CacheEntry::Loading => true,
+            CacheEntry::Ready { .. } => false,
+        });
+    }
+
+    /// Returns the cached secret, calling fetch if it isn't cached or has expired
+    fn get<F>(&self, key: &SecretKey, fetch: F) -> GGResult<Option<Secret>>
+    where
+        F: Fn() -> GGResult<Option<Secret>> + Send + 'static,
+    {
+        let mut entries = self.lock();
+        let mut waited = false;
+        loop {
+            match entries.get_mut(key) {
+                Some(CacheEntry::Ready {
+                    secret,
+                    fetched,
+                    refreshing,
+                }) if fetched.elapsed() < self.ttl => {
+                    if waited {
+                        self.inner.coalesced.fetch_add(1, Ordering::Relaxed);
+                    } else {
+                        self.inner.hits.fetch_add(1, Ordering::Relaxed);
+                    }
+                    let secret = secret.clone();
+                    if !*refreshing && fetched.elapsed() + self.refresh_ahead >= self.ttl {
+                        *refreshing = true;
+                        self.refresh(key.clone(), fetch);
+                    }
+                    return Ok(Some(secret));
+                }
+                Some(CacheEntry::Loading) => {
+                    waited = true;
+                    entries = self
+                        .inner
+                        .loaded
+                        .wait(entries)
+                        .expect("secret cache lock poisoned");
+                }
+                _ => break,
+            }
+        }
+
+        // Not cached, or expired, so this request loads it
+        self.inner.misses.fetch_add(1, Ordering::Relaxed);
+        entries.insert(key.clone(), CacheEntry::Loading);
+        drop(entries);
+        let _guard = FetchGuard { cache: self, key };
+        let result = fetch();
+        self.store(key, &result);
+        result
+    }
+
+    /// Fetches the secret on a background thread, leaving the cached secret in place until it completes
+    fn refresh<F>(&self, key: SecretKey, fetch: F)
+    where
+        F: Fn() -> GGResult<Option<Secret>> + Send + 'static,
+    {
+        self.inner.refreshes.fetch_add(1, Ordering::Relaxed);
+        let cache = self.clone();
+        thread::spawn(move || {
+            let _guard = FetchGuard {
+                cache: &cache,
+                key: &key,
+            };
+            let result = fetch();
+            let mut entries = cache.lock();
+            match (result, entries.get_mut(&key)) {
+                (Ok(Some(secret)), _) => {
+                    entries.insert(
+                        key.clone(),
+                        CacheEntry::Ready {
+                            secret,
+                            fetched: Instant::now(),
+                            refreshing: false,
+                        },
+                    );
+                }
+                // keep serving the cached secret until it expires
+                (_, Some(CacheEntry::Ready { refreshing, .. })) => *refreshing = false,
+                _ => (),
+            }
+        });
+    }
+
+    /// Stores the result of a load and wakes any requests waiting on it
+    fn store(&self, key: &SecretKey, result: &GGResult<Option<Secret>>) {
+        let mut entries = self.lock();
+        match result {
+            Ok(Some(secret)) => {
+                entries.insert(
+                    key.clone(),
+                    CacheEntry::Ready {
+                        secret: secret.clone(),
+                        fetched: Instant::now(),
+                        refreshing: false,
+                    },
+                );
+            }
+            // Waiting requests will make their own request
+            _ => {
+                entries.remove(key);
+            }
+        }
+        self.inner.loaded.notify_all();
+    }
+
+    fn lock(&self) -> MutexGuard<'_, HashMap<SecretKey, CacheEntry>> {
+        self.inner
+            .entries
+            .lock()
+            .expect("secret cache lock poisoned")
+    }
+}
+
+/// Cleans up after a fetch that panics, so that requests waiting on the load, or later refreshes,
+/// aren't blocked forever
+struct FetchGuard<'a> {
+    cache: &'a SecretCache,
+    key: &'a SecretKey,
+}
+
+impl Drop for FetchGuard<'_> {
+    fn drop(&mut self) {
+        if !thread::panicking() {
+            return;
+        }
+        if let Ok(mut entries) = self.cache.inner.entries.lock() {
+            match entries.get_mut(self.key) {
+                Some(CacheEntry::Loading) => {
+                    // Waiting requests will make their own request
+                    entries.remove(self.key);
+                }
+                Some(CacheEntry::Ready { refreshing, .. }) => *refreshing = false,
+                None => (),
+            }
+        }
+        self.cache.inner.loaded.notify_all();
+    }
+}
+
 /// Handles requests to the SecretManager secrets
 /// that have been exposed to the green grass lambda
 ///
@@ -64,6 +307,10 @@ impl Secret {
 /// ```
 #[derive(Clone)]
 pub struct SecretClient {
+    /// The policy used to retry requests that greengrass throttled, if one has been defined
+    pub retry_policy: Option<RetryPolicy>,
+    /// The cache secrets are requested through, if one has been defined
+    pub cache: Option<SecretCache>,
     #[cfg(all(test, feature = "mock"))]
     pub mocks: Rc<MockHolder>,
 }
@@ -77,11 +324,26 @@ impl SecretClient {
             secret_id: secret_id.to_owned(),
             secret_version: None,
             secret_version_stage: None,
+            retry_policy: self.retry_policy.clone(),
+            cache: self.cache.clone(),
             #[cfg(all(test, feature = "mock"))]
             mocks: Rc::clone(&self.mocks),
         }
     }
 
+    /// Optionally retry requests that greengrass throttled. See [`crate::retry`]
+    pub fn with_retry_policy(self, retry_policy: Option<RetryPolicy>) -> Self {
+        SecretClient {
+            retry_policy,
+            ..self
+        }
+    }
+
+    /// Optionally cache secrets. See [`SecretCache`]
+    pub fn with_cache(self, cache: Option<SecretCache>) -> Self {
+        SecretClient { cache, ..self }
+    }
+
     /// Use the specified mock holder
     #[cfg(all(test, feature = "mock"))]
     pub fn with_mocks(self, mocks: Rc<MockHolder>) -> Self {
@@ -92,6 +354,8 @@ impl SecretClient {
 impl Default for SecretClient {
     fn default() -> Self {
         SecretClient {
+            retry_policy: None,
+            cache: None,
             #[cfg(all(test, feature = "mock"))]
             mocks: Rc::new(MockHolder::default()),
         }
@@ -104,6 +368,8 @@ pub struct SecretRequestBuilder {
     pub secret_id: String,
     pub secret_version: Option<String>,
     pub secret_version_stage: Option<String>,
+    pub retry_policy: Option<RetryPolicy>,
+    pub cache: Option<SecretCache>,
     #[cfg(all(test, feature = "mock"))]
     pub mocks: Rc<MockHolder>,
 }
@@ -125,9 +391,26 @@ impl SecretRequestBuilder {
         }
     }
 
-    /// Executes the request and returns the secret
+    /// Executes the request and returns the secret, from the cache if the client has one
     #[cfg(not(all(test, feature = "mock")))]
     pub fn request(&self) -> GGResult<Option<Secret>> {
+        match &self.cache {
+            Some(cache) => {
+                let key = (
+                    self.secret_id.clone(),
+                    self.secret_version.clone(),
+                    self.secret_version_stage.clone(),
+                );
+                let builder = self.clone();
+                cache.get(&key, move || builder.fetch())
+            }
+            None => self.fetch(),
+        }
+    }
+
+    /// Requests the secret from greengrass
+    #[cfg(not(all(test, feature = "mock")))]
+    fn fetch(&self) -> GGResult<Option<Secret>> {
         if let Some(response) = read_secret(self)? {
             Ok(Some(self.parse_response(&response)?))
         } else {
@@ -135,6 +418,14 @@ impl SecretRequestBuilder {
         }
     }
 
+    /// Same as [`SecretRequestBuilder::request`], but the request runs on the blocking pool so it
+    /// can be awaited without blocking the executor. See [`crate::blocking`]
+    #[cfg(not(all(test, feature = "mock")))]
+    pub fn request_async(&self) -> BlockingFuture<Option<Secret>> {
+        let builder = self.clone();
+        blocking::spawn(move || builder.request())
+    }
+
     fn parse_response(&self, response: &[u8]) -> GGResult<Secret> {
         serde_json::from_slice::<Secret>(response).map_err(GGError::from)
     }
@@ -171,26 +462,32 @@ fn read_secret(builder: &SecretRequestBuilder) -> GGResult<Option<Vec<u8>>> {
             None
         };
 
-        let mut req: gg_request = ptr::null_mut();
-        with_request!(req, {
-            let mut res = gg_request_result {
-                request_status: gg_request_status_GG_REQUEST_SUCCESS,
-            };
-
-            let fetch_res = gg_get_secret_value(
-                req,
-                secret_name_c.as_ptr(),
-                maybe_secret_version_c
-                    .map(|c| c.as_ptr())
-                    .unwrap_or(ptr::null() as *const c_char),
-                maybe_secret_stage_c
-                    .map(|c| c.as_ptr())
-                    .unwrap_or(ptr::null() as *const c_char),
-                &mut res,
-            );
-            GGError::from_code(fetch_res)?;
-            let response = GGRequestResponse::try_from(&res)?;
-            response.read(req)
+        let secret_name_c = secret_name_c.as_c_str();
+        let maybe_secret_version_c = maybe_secret_version_c.as_ref();
+        let maybe_secret_stage_c = maybe_secret_stage_c.as_ref();
+
+        retry(&builder.retry_policy, || {
+            let mut req: gg_request = ptr::null_mut();
+            with_request!(req, {
+                let mut res = gg_request_result {
+                    request_status: gg_request_status_GG_REQUEST_SUCCESS,
+                };
+
+                let fetch_res = gg_get_secret_value(
+                    req,
+                    secret_name_c.as_ptr(),
+                    maybe_secret_version_c
+                        .map(|c| c.as_ptr())
+                        .unwrap_or(ptr::null() as *const c_char),
+                    maybe_secret_stage_c
+                        .map(|c| c.as_ptr())
+                        .unwrap_or(ptr::null() as *const c_char),
+                    &mut res,
+                );
+                GGError::from_code(fetch_res)?;
+                let response = GGRequestResponse::try_from(&res)?;
+                response.read(req)
+            })
         })
     }
 }
@@ -337,4 +634,176 @@ mod tests {
             panic!("There should have been an Invalid Err");
         }
     }
+
+    fn secret(value: &str) -> Secret {
+        Secret::default().with_secret_string(Some(value.to_owned()))
+    }
+
+    fn key(id: &str) -> SecretKey {
+        (id.to_owned(), None, None)
+    }
+
+    #[test]
+    fn test_cache_hit_and_expiry() {
+        let cache = SecretCache::new(Duration::from_millis(50));
+        let calls = Arc::new(AtomicU64::new(0));
+        let fetch = {
+            let calls = Arc::clone(&calls);
+            move || {
+                let n = calls.fetch_add(1, Ordering::SeqCst);
+                Ok(Some(secret(&format!("value {}", n))))
+            }
+        };
+        let first = cache.get(&key("a"), fetch.clone()).unwrap().unwrap();
+        let second = cache.get(&key("a"), fetch.clone()).unwrap().unwrap();
+        assert_eq!(first, second);
+        // other versions of the secret are cached separately
+        let key_v2 = ("a".to_owned(), Some("v2".to_owned()), None);
+        cache.get(&key_v2, fetch.clone()).unwrap();
+        assert_eq!(calls.load(Ordering::SeqCst), 2);
+
+        thread::sleep(Duration::from_millis(60));
+        let expired = cache.get(&key("a"), fetch).unwrap().unwrap();
+        assert_eq!(expired.secret_string.unwrap(), "value 2");
+        assert_eq!(
+            cache.stats(),
+            SecretCacheStats {
+                hits: 1,
+                misses: 3,
+                coalesced: 0,
+                refreshes: 0
+            }
+        );
+    }
+
+    #[test]
+    fn test_cache_refresh_ahead() {
+        let cache =
+            SecretCache::new(Duration::from_secs(60)).with_refresh_ahead(Duration::from_secs(60));
+        let (refreshed_sender, refreshed) = crossbeam_channel::bounded(1);
+        let calls = Arc::new(AtomicU64::new(0));
+        let fetch = {
+            let calls = Arc::clone(&calls);
+            move || {
+                let n = calls.fetch_add(1, Ordering::SeqCst);
+                if n > 0 {
+                    let _ = refreshed_sender.try_send(());
+                }
+                Ok(Some(secret(&format!("value {}", n))))
+            }
+        };
+        cache.get(&key("a"), fetch.clone()).unwrap();
+        // within the refresh ahead window, the cached value is returned while it is refreshed
+        let cached = cache.get(&key("a"), fetch.clone()).unwrap().unwrap();
+        assert_eq!(cached.secret_string.unwrap(), "value 0");
+        refreshed
+            .recv_timeout(Duration::from_secs(5))
+            .expect("secret was not refreshed");
+        assert_eq!(cache.stats().refreshes, 1);
+    }
+
+    #[test]
+    fn test_cache_single_flight() {
+        let cache = SecretCache::new(Duration::from_secs(60));
+        let calls = Arc::new(AtomicU64::new(0));
+        let threads: Vec<_> = (0..8)
+            .map(|_| {
+                let cache = cache.clone();
+                let calls = Arc::clone(&calls);
+                thread::spawn(move || {
+                    cache
+                        .get(&key("shared"), move || {
+                            calls.fetch_add(1, Ordering::SeqCst);
+                            thread::sleep(Duration::from_millis(50));
+                            Ok(Some(secret("value")))
+                        })
+                        .unwrap()
+                })
+            })
+            .collect();
+        for t in threads {
+            assert_eq!(t.join().unwrap().unwrap().secret_string.unwrap(), "value");
+        }
+        assert_eq!(calls.load(Ordering::SeqCst), 1);
+        let stats = cache.stats();
+        assert_eq!(stats.misses, 1);
+        assert_eq!(stats.hits + stats.coalesced, 7);
+    }
+
+    #[test]
+    fn test_cache_errors_are_not_cached() {
+        let cache = SecretCache::new(Duration::from_secs(60));
+        assert!(cache.get(&key("a"), || Err(GGError::InvalidState)).is_err());
+        assert!(cache.get(&key("a"), || Ok(None)).unwrap().is_none());
+        assert!(cache
+            .get(&key("a"), || Ok(Some(secret("value"))))
+            .unwrap()
+            .is_some());
+        assert_eq!(cache.stats().misses, 3);
+    }
+
+    #[test]
+    fn test_cache_load_panics() {
+        let cache = SecretCache::new(Duration::from_secs(60));
+        let (started_sender, started) = crossbeam_channel::bounded(1);
+        let (gate, gate_receiver) = crossbeam_channel::bounded::<()>(0);
+        let loader = {
+            let cache = cache.clone();
+            thread::spawn(move || {
+                cache.get(&key("a"), move || {
+                    started_sender.send(()).unwrap();
+                    gate_receiver.recv().unwrap();
+                    panic!("fetch failed")
+                })
+            })
+        };
+        started.recv().unwrap();
+        let waiter = {
+            let cache = cache.clone();
+            thread::spawn(move || cache.get(&key("a"), || Ok(Some(secret("value")))))
+        };
+        gate.send(()).unwrap();
+        assert!(loader.join().is_err());
+        // the waiting request loads the secret itself
+        let value = waiter.join().unwrap().unwrap().unwrap();
+        assert_eq!(value.secret_string.unwrap(), "value");
+    }
+
+    #[test]
+    fn test_cache_refresh_panics() {
+        let cache =
+            SecretCache::new(Duration::from_secs(60)).with_refresh_ahead(Duration::from_secs(60));
+        let calls = Arc::new(AtomicU64::new(0));
+        let fetch = {
+            let calls = Arc::clone(&calls);
+            move || {
+                if calls.fetch_add(1, Ordering::SeqCst) > 0 {
+                    panic!("refresh failed");
+                }
+                Ok(Some(secret("value")))
+            }
+        };
+        cache.get(&key("a"), fetch.clone()).unwrap();
+        // once the failed refresh has finished, the next request starts another
+        let deadline = Instant::now() + Duration::from_secs(5);
+        while calls.load(Ordering::SeqCst) < 3 {
+            assert!(Instant::now() < deadline, "refresh was not retried");
+            let cached = cache.get(&key("a"), fetch.clone()).unwrap().unwrap();
+            assert_eq!(cached.secret_string.unwrap(), "value");
+            thread::sleep(Duration::from_millis(1));
+        }
+    }
+
+    #[cfg(not(feature = "mock"))]
+    #[test]
+    fn test_request_through_cache() {
+        reset_test_state();
+        GG_REQUEST_READ_BUFFER.with(|rc| rc.replace(test_response().into_bytes()));
+        let client =
+            SecretClient::default().with_cache(Some(SecretCache::new(Duration::from_secs(60))));
+        let first = client.for_secret_id("cached_secret").request().unwrap();
+        let second = client.for_secret_id("cached_secret").request().unwrap();
+        assert_eq!(first, second);
+        GG_CLOSE_REQUEST_COUNT.with(|rc| assert_eq!(*rc.borrow(), 1));
+    }
 }
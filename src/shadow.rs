@@ -7,17 +7,29 @@
  */
 
 use serde_json;
+use std::collections::HashMap;
 use std::convert::TryFrom;
 use std::ffi::CString;
 use std::ptr;
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::{Arc, Mutex, MutexGuard};
+use std::time::{Duration, Instant};
 
 use crate::bindings::*;
+#[cfg(not(all(test, feature = "mock")))]
+use crate::blocking::{self, BlockingFuture};
+#[cfg(not(all(test, feature = "mock")))]
+use crate::buffer;
 use crate::error::GGError;
-use crate::request::GGRequestResponse;
+use crate::handler::{Handler, LambdaContext};
+use crate::json;
+use crate::request::{GGRequestResponse, ResponseReader};
+use crate::retry::{retry, RetryOnce, RetryPolicy};
 use crate::with_request;
 use crate::GGResult;
 use serde::de::DeserializeOwned;
-use serde::Serialize;
+use serde::{Deserialize, Serialize};
+use serde_json::Value;
 use std::default::Default;
 
 #[cfg(all(test, feature = "mock"))]
@@ -28,6 +40,12 @@ use self::mock::*;
 /// Information on shadow documents can be found at: https://docs.aws.amazon.com/iot/latest/developerguide/device-shadow-document.html#device-shadow-example
 #[derive(Clone)]
 pub struct ShadowClient {
+    /// The policy used to retry requests that greengrass throttled, if one has been defined
+    pub retry_policy: Option<RetryPolicy>,
+    /// The cache documents are read through, if one has been defined
+    pub cache: Option<ShadowCache>,
+    /// The last document acknowledged by greengrass for each thing updated with update_thing_shadow_delta
+    baselines: Arc<Mutex<HashMap<String, Value>>>,
     /// When the mock feature is turned on this field will contain captured input
     /// and values to be returned
     #[cfg(all(test, feature = "mock"))]
@@ -53,7 +71,18 @@ impl ShadowClient {
     /// ```
     #[cfg(not(all(test, feature = "mock")))]
     pub fn get_thing_shadow<T: DeserializeOwned>(&self, thing_name: &str) -> GGResult<Option<T>> {
-        if let Some(bytes) = read_thing_shadow(thing_name)? {
+        let bytes = match &self.cache {
+            Some(cache) => match cache.get(thing_name) {
+                Some(bytes) => Some(bytes),
+                None => {
+                    let epoch = cache.epoch(thing_name);
+                    read_thing_shadow(thing_name, &self.retry_policy)?
+                        .map(|bytes| cache.insert(thing_name, bytes, epoch))
+                }
+            },
+            None => read_thing_shadow(thing_name, &self.retry_policy)?.map(Arc::new),
+        };
+        if let Some(bytes) = bytes {
             let json: T = serde_json::from_slice(&bytes).map_err(GGError::from)?;
             Ok(Some(json))
         } else {
@@ -61,6 +90,29 @@ impl ShadowClient {
         }
     }
 
+    /// Get thing shadow for thing name, passing a reader over the raw document to the specified function.
+    /// This allows the document to be read into storage owned by the caller (e.g. a buffer that is reused
+    /// between requests) without any intermediate copies.
+    ///
+    /// Returns None if there isn't a shadow document for the thing, in which case the function is not called.
+    /// This always reads the document from greengrass, bypassing the cache.
+    ///
+    /// # Example
+    ///
+    /// ```rust
+    /// use aws_greengrass_core_rust::shadow::ShadowClient;
+    ///
+    /// let mut buffer = Vec::with_capacity(16 * 1024);
+    /// let result = ShadowClient::default().get_thing_shadow_with("my_thing", |reader| reader.read_into(&mut buffer));
+    /// ```
+    #[cfg(not(all(test, feature = "mock")))]
+    pub fn get_thing_shadow_with<R, F>(&self, thing_name: &str, f: F) -> GGResult<Option<R>>
+    where
+        F: FnOnce(&mut ResponseReader) -> GGResult<R>,
+    {
+        read_thing_shadow_with(thing_name, &self.retry_policy, f)
+    }
+
     /// Updates a shadow thing with the specified document.
     ///
     /// # Arguments
@@ -80,25 +132,83 @@ impl ShadowClient {
     /// ```
     #[cfg(not(all(test, feature = "mock")))]
     pub fn update_thing_shadow<T: Serialize>(&self, thing_name: &str, doc: &T) -> GGResult<()> {
-        let json_string = serde_json::to_string(doc).map_err(GGError::from)?;
-        unsafe {
-            let thing_name_c = CString::new(thing_name).map_err(GGError::from)?;
-            let json_string_c = CString::new(json_string).map_err(GGError::from)?;
-            let mut req: gg_request = ptr::null_mut();
-            with_request!(req, {
-                let mut res = gg_request_result {
-                    request_status: gg_request_status_GG_REQUEST_SUCCESS,
-                };
-                let update_res = gg_update_thing_shadow(
-                    req,
-                    thing_name_c.as_ptr(),
-                    json_string_c.as_ptr(),
-                    &mut res,
-                );
-                GGError::from_code(update_res)?;
-                GGRequestResponse::try_from(&res)?.to_error_result(req)
+        let thing_name_c = CString::new(thing_name).map_err(GGError::from)?;
+        let thing_name_c = thing_name_c.as_c_str();
+        let _invalidate = self
+            .cache
+            .as_ref()
+            .map(|cache| cache.invalidate_on_drop(thing_name));
+        buffer::with_json_c(doc, |json_string_c| {
+            retry(&self.retry_policy, || unsafe {
+                let mut req: gg_request = ptr::null_mut();
+                with_request!(req, {
+                    let mut res = gg_request_result {
+                        request_status: gg_request_status_GG_REQUEST_SUCCESS,
+                    };
+                    let update_res = gg_update_thing_shadow(
+                        req,
+                        thing_name_c.as_ptr(),
+                        json_string_c.as_ptr(),
+                        &mut res,
+                    );
+                    GGError::from_code(update_res)?;
+                    GGRequestResponse::try_from(&res)?.to_error_result(req)
+                })
             })
-        }
+        })
+    }
+
+    /// Updates a shadow thing with only the parts of the document that changed since the last document
+    /// this client successfully sent with `update_thing_shadow_delta`. Keys that were removed are sent as null,
+    /// which removes them from the shadow. If nothing changed no request is made.
+    ///
+    /// The first update for a thing, and the first update after a failed update, sends the whole document.
+    /// Only the `state` is compared. A top level `version` or `clientToken` is sent with every update that
+    /// is made, and never removed because an earlier document had one.
+    ///
+    /// # Examples
+    /// ```rust
+    /// use aws_greengrass_core_rust::shadow::ShadowClient;
+    /// use serde_json::json;
+    ///
+    /// let client = ShadowClient::default();
+    /// let result = client.update_thing_shadow_delta("foo", &json!({"state": {"reported": {"temp": 20, "humidity": 40}}}));
+    /// // only sends {"state": {"reported": {"temp": 21}}}
+    /// let result = client.update_thing_shadow_delta("foo", &json!({"state": {"reported": {"temp": 21, "humidity": 40}}}));
+    /// ```
+    pub fn update_thing_shadow_delta<T: Serialize>(
+        &self,
+        thing_name: &str,
+        doc: &T,
+    ) -> GGResult<()> {
+        let doc = serde_json::to_value(doc).map_err(GGError::from)?;
+        // the baseline is taken for the duration of the request, so a concurrent update sends its whole document
+        let baseline = self.lock_baselines().remove(thing_name);
+        let patch = match &baseline {
+            Some(baseline) => match shadow_delta(baseline, &doc) {
+                Some(patch) => patch,
+                None => {
+                    self.lock_baselines().insert(thing_name.to_owned(), doc);
+                    return Ok(());
+                }
+            },
+            None => doc.clone(),
+        };
+        self.update_thing_shadow(thing_name, &patch)?;
+        self.lock_baselines().insert(thing_name.to_owned(), doc);
+        Ok(())
+    }
+
+    /// Forgets the last document sent with `update_thing_shadow_delta`, so the next one sends the whole document.
+    /// Use this if the shadow may have been changed by someone else.
+    pub fn reset_shadow_delta(&self, thing_name: &str) {
+        self.lock_baselines().remove(thing_name);
+    }
+
+    fn lock_baselines(&self) -> MutexGuard<'_, HashMap<String, Value>> {
+        self.baselines
+            .lock()
+            .expect("shadow baselines lock poisoned")
     }
 
     /// Deletes thing shadow for thing name.
@@ -117,8 +227,14 @@ impl ShadowClient {
     /// ```
     #[cfg(not(all(test, feature = "mock")))]
     pub fn delete_thing_shadow(&self, thing_name: &str) -> GGResult<()> {
-        unsafe {
-            let thing_name_c = CString::new(thing_name).map_err(GGError::from)?;
+        let thing_name_c = CString::new(thing_name).map_err(GGError::from)?;
+        let thing_name_c = thing_name_c.as_c_str();
+        let _invalidate = self
+            .cache
+            .as_ref()
+            .map(|cache| cache.invalidate_on_drop(thing_name));
+        self.reset_shadow_delta(thing_name);
+        retry(&self.retry_policy, || unsafe {
             let mut req: gg_request = ptr::null_mut();
             with_request!(req, {
                 let mut res_c = gg_request_result {
@@ -128,9 +244,55 @@ impl ShadowClient {
                 GGError::from_code(delete_res)?;
                 GGRequestResponse::try_from(&res_c)?.to_error_result(req)
             })
+        })
+    }
+
+    /// Same as [`ShadowClient::get_thing_shadow`], but the request runs on the blocking pool so it
+    /// can be awaited without blocking the executor. See [`crate::blocking`]
+    #[cfg(not(all(test, feature = "mock")))]
+    pub fn get_thing_shadow_async<T>(&self, thing_name: &str) -> BlockingFuture<Option<T>>
+    where
+        T: DeserializeOwned + Send + 'static,
+    {
+        let client = self.clone();
+        let thing_name = thing_name.to_owned();
+        blocking::spawn(move || client.get_thing_shadow(&thing_name))
+    }
+
+    /// Same as [`ShadowClient::update_thing_shadow`], but the request runs on the blocking pool so it
+    /// can be awaited without blocking the executor. See [`crate::blocking`]
+    #[cfg(not(all(test, feature = "mock")))]
+    pub fn update_thing_shadow_async<T>(&self, thing_name: &str, doc: T) -> BlockingFuture<()>
+    where
+        T: Serialize + Send + 'static,
+    {
+        let client = self.clone();
+        let thing_name = thing_name.to_owned();
+        blocking::spawn(move || client.update_thing_shadow(&thing_name, &doc))
+    }
+
+    /// Same as [`ShadowClient::delete_thing_shadow`], but the request runs on the blocking pool so it
+    /// can be awaited without blocking the executor. See [`crate::blocking`]
+    #[cfg(not(all(test, feature = "mock")))]
+    pub fn delete_thing_shadow_async(&self, thing_name: &str) -> BlockingFuture<()> {
+        let client = self.clone();
+        let thing_name = thing_name.to_owned();
+        blocking::spawn(move || client.delete_thing_shadow(&thing_name))
+    }
+
+    /// Optionally retry requests that greengrass throttled. See [`crate::retry`]
+    pub fn with_retry_policy(self, retry_policy: Option<RetryPolicy>) -> Self {
+        ShadowClient {
+            retry_policy,
+            ..self
         }
     }
 
+    /// Optionally cache shadow documents. See [`ShadowCache`]
+    pub fn with_cache(self, cache: Option<ShadowCache>) -> Self {
+        ShadowClient { cache, ..self }
+    }
+
     // -----------------------------------
     // Mock methods
     // -----------------------------------
@@ -182,15 +344,309 @@ impl ShadowClient {
 impl Default for ShadowClient {
     fn default() -> Self {
         ShadowClient {
+            retry_policy: None,
+            cache: None,
+            baselines: Arc::new(Mutex::new(HashMap::new())),
             #[cfg(all(test, feature = "mock"))]
             mocks: MockHolder::default(),
         }
     }
 }
 
-fn read_thing_shadow(thing_name: &str) -> GGResult<Option<Vec<u8>>> {
-    unsafe {
-        let thing_name_c = CString::new(thing_name).map_err(GGError::from)?;
+/// Caches the shadow documents read by a [`ShadowClient`], so that reads within the staleness bound
+/// don't go to greengrass.
+///
+/// A cached document is dropped when the client updates or deletes the shadow, and when a message on one of the
+/// thing's `$aws/things/<thing_name>/shadow/update/...` or `.../shadow/delete/accepted` topics reports a newer
+/// version. Wrap the lambda's handler in a [`ShadowCacheHandler`] to have those messages applied as they arrive.
+///
+/// Clones of a cache share their documents and stats.
+///
+/// # Examples
+/// ```rust
+/// use aws_greengrass_core_rust::handler::{Handler, LambdaContext};
+/// use aws_greengrass_core_rust::runtime::Runtime;
+/// use aws_greengrass_core_rust::shadow::{ShadowCache, ShadowCacheHandler, ShadowClient};
+/// use serde_json::Value;
+/// use std::time::Duration;
+///
+/// struct MyHandler;
+///
+/// impl Handler for MyHandler {
+///     fn handle(&self, ctx: LambdaContext) {
+///         // Do something here
+///     }
+/// }
+///
+/// let cache = ShadowCache::new(Duration::from_secs(30));
+/// let client = ShadowClient::default().with_cache(Some(cache.clone()));
+/// let runtime = Runtime::default().with_handler(Some(Box::new(ShadowCacheHandler::new(cache, MyHandler))));
+/// let shadow = client.get_thing_shadow::<Value>("my_thing");
+/// ```
+#[derive(Clone)]
+pub struct ShadowCache {
+    max_staleness: Duration,
+    inner: Arc<ShadowCacheInner>,
+}
+
+/// Counts of the reads made through a [`ShadowCache`]
+#[derive(Clone, Debug, Default, PartialEq)]
+pub struct ShadowCacheStats {
+    /// Reads answered from the cache
+    pub hits: u64,
+    /// Reads that went to greengrass
+    pub misses: u64,
+    /// Cached documents dropped because the shadow changed
+    pub invalidations: u64,
+}
+
+#[derive(Default)]
+struct ShadowCacheInner {
+    documents: Mutex<Documents>,
+    hits: AtomicU64,
+    misses: AtomicU64,
+    invalidations: AtomicU64,
+}
+
+#[derive(Default)]
+struct Documents {
+    cached: HashMap<String, CachedShadow>,
+    /// Incremented by every invalidation of a thing, so that a read of the thing that raced with one
+    /// isn't cached. Things are only added once invalidated.
+    epochs: HashMap<String, u64>,
+}
+
+impl Documents {
+    fn epoch(&self, thing_name: &str) -> u64 {
+        self.epochs.get(thing_name).copied().unwrap_or(0)
+    }
+}
+
+struct CachedShadow {
+    document: Arc<Vec<u8>>,
+    version: Option<u64>,
+    fetched: Instant,
+}
+
+/// The part of a shadow document or shadow message needed to order it
+#[derive(Deserialize)]
+struct ShadowVersion {
+    version: Option<u64>,
+}
+
+impl ShadowCache {
+    /// A cache that serves documents for up to max_staleness after they were read from greengrass
+    pub fn new(max_staleness: Duration) -> Self {
+        ShadowCache {
+            max_staleness,
+            inner: Arc::new(ShadowCacheInner::default()),
+        }
+    }
+
+    /// The reads made through this cache, and its clones, so far
+    pub fn stats(&self) -> ShadowCacheStats {
+        ShadowCacheStats {
+            hits: self.inner.hits.load(Ordering::Relaxed),
+            misses: self.inner.misses.load(Ordering::Relaxed),
+            invalidations: self.inner.invalidations.load(Ordering::Relaxed),
+        }
+    }
+
+    /// The version of the cached document for the thing, if there is one
+    pub fn version(&self, thing_name: &str) -> Option<u64> {
+        self.lock()
+            .cached
+            .get(thing_name)
+            .and_then(|cached| cached.version)
+    }
+
+    /// Drops the cached document for the thing
+    pub fn invalidate(&self, thing_name: &str) {
+        let mut documents = self.lock();
+        *documents.epochs.entry(thing_name.to_owned()).or_insert(0) += 1;
+        if documents.cached.remove(thing_name).is_some() {
+            self.inner.invalidations.fetch_add(1, Ordering::Relaxed);
+        }
+    }
+
+    /// Applies a message received on a shadow topic, dropping the cached document if the message
+    /// reports a change newer than it. Messages on other topics are ignored.
+    pub fn handle_message(&self, topic: &str, payload: &[u8]) {
+        let (thing_name, operation) = match parse_shadow_topic(topic) {
+            Some(parsed) => parsed,
+            None => return,
+        };
+        match operation {
+            "delete/accepted" => self.invalidate(thing_name),
+            "update/accepted" | "update/delta" | "update/documents" => {
+                let version = serde_json::from_slice::<ShadowVersion>(payload)
+                    .ok()
+                    .and_then(|v| v.version);
+                let cached_version = self.version(thing_name);
+                match (version, cached_version) {
+                    // the cached document already includes this change
+                    (Some(version), Some(cached_version)) if version <= cached_version => (),
+                    _ => self.invalidate(thing_name),
+                }
+            }
+            _ => (),
+        }
+    }
+
+    /// The cached document for the thing, if it is within the staleness bound
+    fn get(&self, thing_name: &str) -> Option<Arc<Vec<u8>>> {
+        let document = self
+            .lock()
+            .cached
+            .get(thing_name)
+            .filter(|cached| cached.fetched.elapsed() < self.max_staleness)
+            .map(|cached| Arc::clone(&cached.document));
+        let counter = if document.is_some() {
+            &self.inner.hits
+        } else {
+            &self.inner.misses
+        };
+        counter.fetch_add(1, Ordering::Relaxed);
+        document
+    }
+
+    /// Taken before reading a document for the thing from greengrass and passed to insert
+    fn epoch(&self, thing_name: &str) -> u64 {
+        self.lock().epoch(thing_name)
+    }
+
+    /// Caches a document read from greengrass, unless the thing was invalidated while it was being read
+    fn insert(&self, thing_name: &str, document: Vec<u8>, epoch: u64) -> Arc<Vec<u8>> {
+        let version = serde_json::from_slice::<ShadowVersion>(&document)
+            .ok()
+            .and_then(|v| v.version);
+        let document = Arc::new(document);
+        let mut documents = self.lock();
+        if documents.epoch(thing_name) == epoch {
+            documents.cached.insert(
+                thing_name.to_owned(),
+                CachedShadow {
+                    document: Arc::clone(&document),
+                    version,
+                    fetched: Instant::now(),
+                },
+            );
+        }
+        document
+    }
+
+    /// Invalidates the thing's document when the returned guard is dropped, after a request that changes it
+    #[cfg(not(all(test, feature = "mock")))]
+    fn invalidate_on_drop<'a>(&'a self, thing_name: &'a str) -> InvalidateOnDrop<'a> {
+        // invalidate up front too, so a read racing with the request isn't cached
+        self.invalidate(thing_name);
+        InvalidateOnDrop {
+            cache: self,
+            thing_name,
+        }
+    }
+
+    fn lock(&self) -> MutexGuard<'_, Documents> {
+        self.inner
+            .documents
+            .lock()
+            .expect("shadow cache lock poisoned")
+    }
+}
+
+#[cfg(not(all(test, feature = "mock")))]
+struct InvalidateOnDrop<'a> {
+    cache: &'a ShadowCache,
+    thing_name: &'a str,
+}
+
+#[cfg(not(all(test, feature = "mock")))]
+impl Drop for InvalidateOnDrop<'_> {
+    fn drop(&mut self) {
+        self.cache.invalidate(self.thing_name);
+    }
+}
+
+/// Splits a classic shadow topic, `$aws/things/<thing_name>/shadow/<operation>`, into the thing name and operation
+fn parse_shadow_topic(topic: &str) -> Option<(&str, &str)> {
+    const PREFIX: &str = "$aws/things/";
+    if !topic.starts_with(PREFIX) {
+        return None;
+    }
+    let rest = &topic[PREFIX.len()..];
+    let separator = rest.find("/shadow/")?;
+    let thing_name = &rest[..separator];
+    let operation = &rest[separator + "/shadow/".len()..];
+    if thing_name.is_empty() || thing_name.contains('/') {
+        None
+    } else {
+        Some((thing_name, operation))
+    }
+}
+
+/// Wraps a [`Handler`], applying shadow messages to a [`ShadowCache`] before passing every message to the handler.
+///
+/// The lambda must be subscribed to the shadow topics for the messages to be received.
+pub struct ShadowCacheHandler<H> {
+    cache: ShadowCache,
+    handler: H,
+}
+
+impl<H: Handler> ShadowCacheHandler<H> {
+    pub fn new(cache: ShadowCache, handler: H) -> Self {
+        ShadowCacheHandler { cache, handler }
+    }
+}
+
+impl<H: Handler> Handler for ShadowCacheHandler<H> {
+    fn handle(&self, ctx: LambdaContext) {
+        if let Some(topic) = ctx.topic() {
+            self.cache.handle_message(&topic, &ctx.message);
+        }
+        self.handler.handle(ctx)
+    }
+}
+
+/// The update that turns the state of the baseline into the state of the document, with the document's
+/// `version` and `clientToken`. None if the state is unchanged.
+fn shadow_delta(baseline: &Value, doc: &Value) -> Option<Value> {
+    let null = Value::Null;
+    let old_state = baseline.get("state").unwrap_or(&null);
+    let new_state = doc.get("state").unwrap_or(&null);
+    let mut patch = serde_json::Map::new();
+    patch.insert("state".to_owned(), json::diff(old_state, new_state)?);
+    for key in &["version", "clientToken"] {
+        if let Some(value) = doc.get(key) {
+            patch.insert((*key).to_owned(), value.clone());
+        }
+    }
+    Some(Value::Object(patch))
+}
+
+fn read_thing_shadow(
+    thing_name: &str,
+    retry_policy: &Option<RetryPolicy>,
+) -> GGResult<Option<Vec<u8>>> {
+    read_thing_shadow_with(thing_name, retry_policy, |reader| {
+        let mut bytes = Vec::new();
+        reader.read_into(&mut bytes)?;
+        Ok(bytes)
+    })
+}
+
+fn read_thing_shadow_with<R, F>(
+    thing_name: &str,
+    retry_policy: &Option<RetryPolicy>,
+    f: F,
+) -> GGResult<Option<R>>
+where
+    F: FnOnce(&mut ResponseReader) -> GGResult<R>,
+{
+    let thing_name_c = CString::new(thing_name).map_err(GGError::from)?;
+    let thing_name_c = thing_name_c.as_c_str();
+    let f = RetryOnce::new(f);
+    let f = &f;
+    retry(retry_policy, || unsafe {
         let mut req: gg_request = ptr::null_mut();
         with_request!(req, {
             let mut res = gg_request_result {
@@ -198,9 +654,9 @@ fn read_thing_shadow(thing_name: &str) -> GGResult<Option<Vec<u8>>> {
             };
             let fetch_res = gg_get_thing_shadow(req, thing_name_c.as_ptr(), &mut res);
             GGError::from_code(fetch_res)?;
-            GGRequestResponse::try_from(&res)?.read(req)
+            GGRequestResponse::try_from(&res)?.read_with(req, |reader| f.call(reader))
         })
-    }
+    })
 }
 
 #[cfg(all(test, feature = "mock"))]
@@ -317,6 +773,26 @@ pub mod test {
         GG_REQUEST.with(|rc| assert!(!rc.borrow().is_default()));
     }
 
+    #[cfg(not(feature = "mock"))]
+    #[test]
+    fn test_get_shadow_thing_with() {
+        reset_test_state();
+        GG_REQUEST_READ_BUFFER.with(|rc| rc.replace(DEFAULT_SHADOW_DOC.as_bytes().to_vec()));
+        let thing_name = "my_thing_get_with";
+        let mut buffer = Vec::with_capacity(DEFAULT_SHADOW_DOC.len() + 1);
+        let capacity = buffer.capacity();
+        let read = ShadowClient::default()
+            .get_thing_shadow_with(thing_name, |reader| reader.read_into(&mut buffer))
+            .unwrap()
+            .unwrap();
+        assert_eq!(read, DEFAULT_SHADOW_DOC.len());
+        assert_eq!(buffer, DEFAULT_SHADOW_DOC.as_bytes());
+        // the document should have been read into the reserved storage
+        assert_eq!(buffer.capacity(), capacity);
+        GG_SHADOW_THING_ARG.with(|rc| assert_eq!(*rc.borrow(), thing_name));
+        GG_CLOSE_REQUEST_COUNT.with(|rc| assert_eq!(*rc.borrow(), 1));
+    }
+
     #[cfg(not(feature = "mock"))]
     #[test]
     fn test_delete_shadow_thing() {
@@ -346,4 +822,192 @@ pub mod test {
         GG_CLOSE_REQUEST_COUNT.with(|rc| assert_eq!(*rc.borrow(), 1));
         GG_REQUEST.with(|rc| assert!(!rc.borrow().is_default()));
     }
+
+    fn shadow_message_context(topic: &str, payload: &str) -> LambdaContext {
+        let client_context = serde_json::json!({"custom": {"subject": topic}}).to_string();
+        LambdaContext::new(
+            "my_function_arn".to_owned(),
+            client_context,
+            payload.as_bytes().to_vec(),
+        )
+    }
+
+    struct NoopHandler;
+
+    impl Handler for NoopHandler {
+        fn handle(&self, _: LambdaContext) {}
+    }
+
+    #[test]
+    fn test_parse_shadow_topic() {
+        assert_eq!(
+            parse_shadow_topic("$aws/things/my_thing/shadow/update/delta"),
+            Some(("my_thing", "update/delta"))
+        );
+        assert_eq!(parse_shadow_topic("$aws/things//shadow/update/delta"), None);
+        assert_eq!(parse_shadow_topic("some/other/topic"), None);
+    }
+
+    #[test]
+    fn test_cache_staleness() {
+        let cache = ShadowCache::new(Duration::from_millis(50));
+        cache.insert(
+            "my_thing",
+            DEFAULT_SHADOW_DOC.as_bytes().to_vec(),
+            cache.epoch("my_thing"),
+        );
+        assert_eq!(cache.version("my_thing"), Some(10));
+        assert!(cache.get("my_thing").is_some());
+        std::thread::sleep(Duration::from_millis(60));
+        assert!(cache.get("my_thing").is_none());
+        assert_eq!(
+            cache.stats(),
+            ShadowCacheStats {
+                hits: 1,
+                misses: 1,
+                invalidations: 0
+            }
+        );
+    }
+
+    #[test]
+    fn test_cache_read_racing_invalidation_is_not_cached() {
+        let cache = ShadowCache::new(Duration::from_secs(60));
+        let epoch = cache.epoch("my_thing");
+        let other_epoch = cache.epoch("other_thing");
+        cache.invalidate("my_thing");
+        cache.insert("my_thing", DEFAULT_SHADOW_DOC.as_bytes().to_vec(), epoch);
+        assert!(cache.get("my_thing").is_none());
+        // invalidating one thing doesn't stop reads of others from being cached
+        cache.insert(
+            "other_thing",
+            DEFAULT_SHADOW_DOC.as_bytes().to_vec(),
+            other_epoch,
+        );
+        assert!(cache.get("other_thing").is_some());
+    }
+
+    #[test]
+    fn test_cache_handler_invalidates_on_newer_version() {
+        let cache = ShadowCache::new(Duration::from_secs(60));
+        let handler = ShadowCacheHandler::new(cache.clone(), NoopHandler);
+        cache.insert(
+            "my_thing",
+            DEFAULT_SHADOW_DOC.as_bytes().to_vec(),
+            cache.epoch("my_thing"),
+        );
+
+        // older or equal versions are already reflected in the cached document
+        handler.handle(shadow_message_context(
+            "$aws/things/my_thing/shadow/update/delta",
+            r#"{"version": 10, "state": {"color": "RED"}}"#,
+        ));
+        // other things and topics are ignored
+        handler.handle(shadow_message_context(
+            "$aws/things/other_thing/shadow/update/delta",
+            r#"{"version": 11}"#,
+        ));
+        handler.handle(shadow_message_context("my/topic", "{}"));
+        assert_eq!(cache.version("my_thing"), Some(10));
+
+        handler.handle(shadow_message_context(
+            "$aws/things/my_thing/shadow/update/delta",
+            r#"{"version": 11, "state": {"color": "BLUE"}}"#,
+        ));
+        assert_eq!(cache.version("my_thing"), None);
+        assert_eq!(cache.stats().invalidations, 1);
+
+        cache.insert(
+            "my_thing",
+            DEFAULT_SHADOW_DOC.as_bytes().to_vec(),
+            cache.epoch("my_thing"),
+        );
+        handler.handle(shadow_message_context(
+            "$aws/things/my_thing/shadow/delete/accepted",
+            r#"{"version": 3}"#,
+        ));
+        assert!(cache.get("my_thing").is_none());
+    }
+
+    #[cfg(not(feature = "mock"))]
+    #[test]
+    fn test_get_shadow_thing_cached() {
+        reset_test_state();
+        GG_REQUEST_READ_BUFFER.with(|rc| rc.replace(DEFAULT_SHADOW_DOC.as_bytes().to_vec()));
+        let cache = ShadowCache::new(Duration::from_secs(60));
+        let client = ShadowClient::default().with_cache(Some(cache.clone()));
+        let first = client.get_thing_shadow::<Value>("my_thing_cached").unwrap();
+        let second = client.get_thing_shadow::<Value>("my_thing_cached").unwrap();
+        assert_eq!(first, second);
+        GG_CLOSE_REQUEST_COUNT.with(|rc| assert_eq!(*rc.borrow(), 1));
+
+        // our own updates invalidate the cached document
+        client
+            .update_thing_shadow("my_thing_cached", &first)
+            .unwrap();
+        GG_REQUEST_READ_BUFFER.with(|rc| rc.replace(DEFAULT_SHADOW_DOC.as_bytes().to_vec()));
+        client.get_thing_shadow::<Value>("my_thing_cached").unwrap();
+        GG_CLOSE_REQUEST_COUNT.with(|rc| assert_eq!(*rc.borrow(), 3));
+        assert_eq!(
+            cache.stats(),
+            ShadowCacheStats {
+                hits: 1,
+                misses: 2,
+                invalidations: 1
+            }
+        );
+    }
+
+    #[cfg(not(feature = "mock"))]
+    #[test]
+    fn test_update_shadow_thing_delta() {
+        reset_test_state();
+        let thing_name = "my_thing_update_delta";
+        let client = ShadowClient::default();
+        let first =
+            serde_json::json!({"state": {"reported": {"temp": 20, "humidity": 40, "fan": "on"}}});
+        client
+            .update_thing_shadow_delta(thing_name, &first)
+            .unwrap();
+        GG_UPDATE_PAYLOAD.with(|rc| assert_eq!(*rc.borrow(), first.to_string()));
+
+        let second =
+            serde_json::json!({"state": {"reported": {"temp": 21, "humidity": 40}}, "version": 3});
+        client
+            .update_thing_shadow_delta(thing_name, &second)
+            .unwrap();
+        GG_UPDATE_PAYLOAD.with(|rc| {
+            let sent = serde_json::from_str::<Value>(&rc.borrow()).unwrap();
+            assert_eq!(
+                sent,
+                serde_json::json!({"state": {"reported": {"temp": 21, "fan": null}}, "version": 3})
+            );
+        });
+
+        // unchanged documents are not sent
+        client
+            .clone()
+            .update_thing_shadow_delta(thing_name, &second)
+            .unwrap();
+        GG_CLOSE_REQUEST_COUNT.with(|rc| assert_eq!(*rc.borrow(), 2));
+
+        // a baseline with a version doesn't remove the version from the shadow
+        let third = serde_json::json!({"state": {"reported": {"temp": 22, "humidity": 40}}});
+        client
+            .update_thing_shadow_delta(thing_name, &third)
+            .unwrap();
+        GG_UPDATE_PAYLOAD.with(|rc| {
+            let sent = serde_json::from_str::<Value>(&rc.borrow()).unwrap();
+            assert_eq!(
+                sent,
+                serde_json::json!({"state": {"reported": {"temp": 22}}})
+            );
+        });
+
+        client.reset_shadow_delta(thing_name);
+        client
+            .update_thing_shadow_delta(thing_name, &second)
+            .unwrap();
+        GG_UPDATE_PAYLOAD.with(|rc| assert_eq!(*rc.borrow(), second.to_string()));
+    }
 }
@@ -0,0 +1,362 @@
+/*
+ * Copyright 2020-present, Nike, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the Apache-2.0 license found in
+ * the LICENSE file in the root of this source tree.
+ */
+
+//! Provides coalescing of frequent shadow updates.
+//!
+//! A [`ShadowWriter`] collects the updates made for each thing and merges them, the latest value of each
+//! field winning, into a single request that a background thread sends once the thing has had no updates
+//! for the window. A thing that is updated continuously is still sent at least every `max_latency`.
+//! Anything not yet sent is flushed when the writer is dropped.
+//!
+//! # Examples
+//! ```rust
+//! use aws_greengrass_core_rust::shadow::ShadowClient;
+//! use aws_greengrass_core_rust::shadow_writer::ShadowWriter;
+//! use serde_json::json;
+//! use std::time::Duration;
+//!
+//! let writer = ShadowWriter::new(ShadowClient::default(), Duration::from_millis(100))
+//!     .with_max_latency(Duration::from_secs(1));
+//! for temp in 0..100 {
+//!     writer.update("my_thing", &json!({"state": {"reported": {"temp": temp}}})).unwrap();
+//! }
+//! // one update of {"state": {"reported": {"temp": 99}}} is sent
+//! ```
+use crate::error::GGError;
+use crate::json;
+use crate::shadow::ShadowClient;
+use crate::GGResult;
+use log::error;
+use serde::Serialize;
+use serde_json::Value;
+use std::cmp;
+use std::collections::HashMap;
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::{Arc, Condvar, Mutex, MutexGuard};
+use std::thread::{self, JoinHandle};
+use std::time::{Duration, Instant};
+
+/// Merges shadow updates per thing and sends them from a background thread
+pub struct ShadowWriter {
+    inner: Arc<Inner>,
+    flusher: Option<JoinHandle<()>>,
+}
+
+/// Counts of the updates that passed through a [`ShadowWriter`]
+#[derive(Clone, Debug, Default, PartialEq)]
+pub struct ShadowWriterStats {
+    /// Updates passed to the writer
+    pub updates: u64,
+    /// Update requests sent to greengrass
+    pub requests: u64,
+    /// Update requests that failed
+    pub errors: u64,
+}
+
+struct Inner {
+    client: ShadowClient,
+    state: Mutex<State>,
+    /// Notified when an update is added, the settings change, or the writer is dropped
+    changed: Condvar,
+    /// Held while pending updates are taken and sent, so that updates for a thing are sent in order
+    sending: Mutex<()>,
+    updates: AtomicU64,
+    requests: AtomicU64,
+    errors: AtomicU64,
+}
+
+struct State {
+    window: Duration,
+    max_latency: Duration,
+    pending: HashMap<String, Pending>,
+    shutdown: bool,
+}
+
+struct Pending {
+    patch: Value,
+    first: Instant,
+    last: Instant,
+}
+
+impl Pending {
+    /// When the update should be sent
+    fn due(&self, window: Duration, max_latency: Duration) -> Instant {
+        cmp::min(self.last + window, self.first + max_latency)
+    }
+}
+
+impl ShadowWriter {
+    /// A writer that sends a thing's updates once it has had none for the window.
+    /// The maximum latency defaults to ten times the window.
+    pub fn new(client: ShadowClient, window: Duration) -> Self {
+        let inner = Arc::new(Inner {
+            client,
+            state: Mutex::new(State {
+                window,
+                max_latency: window * 10,
+                pending: HashMap::new(),
+                shutdown: false,
+            }),
+            changed: Condvar::new(),
+            sending: Mutex::new(()),
+            updates: AtomicU64::new(0),
+            requests: AtomicU64::new(0),
+            errors: AtomicU64::new(0),
+        });
+        let flusher = {
+            let inner = Arc::clone(&inner);
+            thread::Builder::new()
+                .name("gg-shadow-writer".to_owned())
+                .spawn(move || inner.run())
+                .expect("unable to start shadow writer thread")
+        };
+        ShadowWriter {
+            inner,
+            flusher: Some(flusher),
+        }
+    }
+
+    /// The longest an update waits before being sent, however often the thing is updated
+    pub fn with_max_latency(self, max_latency: Duration) -> Self {
+        self.inner.lock().max_latency = max_latency;
+        self.inner.changed.notify_all();
+        self
+    }
+
+    /// Merges the document into the thing's pending update.
+    /// Errors sending the update are logged and counted in [`ShadowWriter::stats`].
+    pub fn update<T: Serialize>(&self, thing_name: &str, doc: &T) -> GGResult<()> {
+        let doc = serde_json::to_value(doc).map_err(GGError::from)?;
+        let now = Instant::now();
+        {
+            let mut state = self.inner.lock();
+            match state.pending.get_mut(thing_name) {
+                Some(pending) => {
+                    json::merge_patch(&mut pending.patch, doc);
+                    pending.last = now;
+                }
+                None => {
+                    state.pending.insert(
+                        thing_name.to_owned(),
+                        Pending {
+                            patch: doc,
+                            first: now,
+                            last: now,
+                        },
+                    );
+                }
+            }
+        }
+        self.inner.updates.fetch_add(1, Ordering::Relaxed);
+        self.inner.changed.notify_all();
+        Ok(())
+    }
+
+    /// Sends every pending update now, returning the first error
+    pub fn flush(&self) -> GGResult<()> {
+        let _sending = self.inner.lock_sending();
+        let pending: Vec<_> = self.inner.lock().pending.drain().collect();
+        pending
+            .into_iter()
+            .map(|(thing_name, pending)| self.inner.send(&thing_name, &pending.patch))
+            .fold(Ok(()), |result, sent| result.and(sent))
+    }
+
+    /// The updates that passed through this writer so far
+    pub fn stats(&self) -> ShadowWriterStats {
+        ShadowWriterStats {
+            updates: self.inner.updates.load(Ordering::Relaxed),
+            requests: self.inner.requests.load(Ordering::Relaxed),
+            errors: self.inner.errors.load(Ordering::Relaxed),
+        }
+    }
+}
+
+impl Drop for ShadowWriter {
+    fn drop(&mut self) {
+        self.inner.lock().shutdown = true;
+        self.inner.changed.notify_all();
+        if let Some(flusher) = self.flusher.take() {
+            if flusher.join().is_err() {
+                error!("Shadow writer thread panicked");
+            }
+        }
+    }
+}
+
+impl Inner {
+    /// Sends updates as they come due until shutdown, when everything pending is sent
+    fn run(&self) {
+        loop {
+            let sending = self.lock_sending();
+            let mut state = self.lock();
+            let now = Instant::now();
+            let (window, max_latency) = (state.window, state.max_latency);
+            let due: Vec<String> = if state.shutdown {
+                state.pending.keys().cloned().collect()
+            } else {
+                state
+                    .pending
+                    .iter()
+                    .filter(|(_, pending)| pending.due(window, max_latency) <= now)
+                    .map(|(thing_name, _)| thing_name.clone())
+                    .collect()
+            };
+
+            if due.is_empty() {
+                if state.shutdown {
+                    return;
+                }
+                drop(sending);
+                let next = state
+                    .pending
+                    .values()
+                    .map(|pending| pending.due(window, max_latency))
+                    .min();
+                match next {
+                    Some(next) => {
+                        drop(
+                            self.changed
+                                .wait_timeout(state, next.saturating_duration_since(now))
+                                .expect("shadow writer lock poisoned"),
+                        );
+                    }
+                    None => {
+                        drop(
+                            self.changed
+                                .wait(state)
+                                .expect("shadow writer lock poisoned"),
+                        );
+                    }
+                }
+                continue;
+            }
+
+            let updates: Vec<_> = due
+                .into_iter()
+                .filter_map(|thing_name| {
+                    let pending = state.pending.remove(&thing_name)?;
+                    Some((thing_name, pending.patch))
+                })
+                .collect();
+            drop(state);
+            for (thing_name, patch) in updates {
+                // errors are logged and counted by send
+                let _ = self.send(&thing_name, &patch);
+            }
+        }
+    }
+
+    fn send(&self, thing_name: &str, patch: &Value) -> GGResult<()> {
+        self.requests.fetch_add(1, Ordering::Relaxed);
+        let result = self.client.update_thing_shadow(thing_name, patch);
+        if let Err(e) = &result {
+            self.errors.fetch_add(1, Ordering::Relaxed);
+            error!("Error sending shadow update for {}: {}", thing_name, e);
+        }
+        result
+    }
+
+    fn lock(&self) -> MutexGuard<'_, State> {
+        self.state.lock().expect("shadow writer lock poisoned")
+    }
+
+    fn lock_sending(&self) -> MutexGuard<'_, ()> {
+        self.sending.lock().expect("shadow writer lock poisoned")
+    }
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+    #[cfg(not(feature = "mock"))]
+    use crate::bindings::*;
+    use serde_json::json;
+
+    /// Waits for the writer to have sent the number of requests
+    fn wait_for_requests(writer: &ShadowWriter, requests: u64) {
+        let start = Instant::now();
+        while writer.stats().requests < requests {
+            assert!(
+                start.elapsed() < Duration::from_secs(5),
+                "timed out waiting for requests"
+            );
+            thread::sleep(Duration::from_millis(5));
+        }
+    }
+
+    #[cfg(not(feature = "mock"))]
+    #[test]
+    fn test_updates_are_merged() {
+        reset_test_state();
+        let writer = ShadowWriter::new(ShadowClient::default(), Duration::from_secs(60));
+        writer
+            .update(
+                "my_thing",
+                &json!({"state": {"reported": {"temp": 20, "fan": "on"}}}),
+            )
+            .unwrap();
+        writer
+            .update("my_thing", &json!({"state": {"reported": {"temp": 21}}}))
+            .unwrap();
+        writer
+            .update("my_thing", &json!({"state": {"reported": {"door": null}}}))
+            .unwrap();
+        writer.flush().unwrap();
+        GG_UPDATE_PAYLOAD.with(|rc| {
+            let sent = serde_json::from_str::<Value>(&rc.borrow()).unwrap();
+            assert_eq!(
+                sent,
+                json!({"state": {"reported": {"temp": 21, "fan": "on", "door": null}}})
+            );
+        });
+        GG_CLOSE_REQUEST_COUNT.with(|rc| assert_eq!(*rc.borrow(), 1));
+        assert_eq!(
+            writer.stats(),
+            ShadowWriterStats {
+                updates: 3,
+                requests: 1,
+                errors: 0
+            }
+        );
+    }
+
+    #[test]
+    fn test_sent_after_window() {
+        let writer = ShadowWriter::new(ShadowClient::default(), Duration::from_millis(20));
+        writer.update("thing_a", &json!({"a": 1})).unwrap();
+        writer.update("thing_b", &json!({"b": 1})).unwrap();
+        writer.update("thing_a", &json!({"a": 2})).unwrap();
+        wait_for_requests(&writer, 2);
+        thread::sleep(Duration::from_millis(50));
+        assert_eq!(writer.stats().requests, 2);
+    }
+
+    #[test]
+    fn test_max_latency() {
+        let writer = ShadowWriter::new(ShadowClient::default(), Duration::from_millis(50))
+            .with_max_latency(Duration::from_millis(100));
+        let start = Instant::now();
+        // updating more often than the window would never be sent without the max latency
+        while start.elapsed() < Duration::from_millis(300) {
+            writer.update("my_thing", &json!({"temp": 1})).unwrap();
+            thread::sleep(Duration::from_millis(10));
+        }
+        assert!(writer.stats().requests >= 2);
+    }
+
+    #[test]
+    fn test_flush_on_drop() {
+        let writer = ShadowWriter::new(ShadowClient::default(), Duration::from_secs(60));
+        let inner = Arc::clone(&writer.inner);
+        writer.update("my_thing", &json!({"temp": 1})).unwrap();
+        drop(writer);
+        assert_eq!(inner.requests.load(Ordering::Relaxed), 1);
+        assert!(inner.lock().pending.is_empty());
+    }
+}
@@ -0,0 +1,237 @@
+/*
+ * Copyright 2020-present, Nike, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the Apache-2.0 license found in
+ * the LICENSE file in the root of this source tree.
+ */
+
+/**
+ * @file greengrasssdk_sim.h
+ * @brief Controls for the in-memory simulator behind the stubbed SDK.
+ *
+ * The stubbed SDK behaves like a Greengrass core running in the same process:
+ * publishes are delivered to the handler registered with **gg_runtime_start()**
+ * when their topic matches a subscription, shadows are kept in memory, secrets
+ * are served from a table, and every request responds with real bytes.
+ *
+ * These functions seed and inspect that state from tests and benchmarks.
+ *
+ * Every function is safe to call from many threads. The handler is called
+ * without any lock held, so handlers run concurrently and may call back into
+ * the SDK. Requests are allocated by **gg_request_init()** and tracked until
+ * **gg_request_close()**: using or closing a request that is closed or was
+ * never initialized fails with GGE_INVALID_PARAMETER and is reported on
+ * stderr, and requests that are still open when the process exits are
+ * reported there too. Closing a request while another thread's call is using
+ * it is reported as well, and the request is freed once that call returns.
+ * With GG_SIM_STRICT set in the environment an invalid request or a close
+ * while in use aborts the process, and open requests at exit make it exit
+ * with a failure.
+ *
+ * Faults can be injected to make the simulator behave like a loaded core.
+ * They are configured with **gg_sim_configure()**, from a file of KEY=VALUE
+ * lines named by GG_SIM_CONFIG, or from environment variables of the same
+ * name, which are read by **gg_global_init()** after the file:
+ *
+ * - GG_SIM_SEED: seeds every random draw, so the same sequence of calls sees
+ *   the same faults on every run. Defaults to 0.
+ * - GG_SIM_LATENCY, GG_SIM_LATENCY_<API>: the latency added to every call, or
+ *   to calls of one API. One of none, constant:<d>, uniform:<min>:<max>,
+ *   normal:<mean>:<stddev> or exponential:<mean>, with durations such as
+ *   250us, 1.5ms or 2s. Bare numbers are milliseconds.
+ * - GG_SIM_FAILURE_RATE, GG_SIM_FAILURE_RATE_<API>: the fraction, from 0 to
+ *   1, of calls that fail with GGE_INTERNAL_FAILURE.
+ * - GG_SIM_QUEUE_CAPACITY: the number of messages the delivery queue holds.
+ *   0, the default, leaves it unbounded. A publish takes a slot for each
+ *   subscription it matches, or one when it matches none. When the queue is
+ *   full GG_QUEUE_FULL_POLICY_BEST_EFFORT delivers to as many subscriptions
+ *   as fit, and GG_QUEUE_FULL_POLICY_ALL_OR_ERROR delivers to none and
+ *   responds with GG_REQUEST_AGAIN and a 429 "queue full" error body.
+ * - GG_SIM_QUEUE_DRAIN_RATE: the messages per second the queue drains.
+ *   Defaults to 1000.
+ *
+ * <API> is one of PUBLISH, INVOKE, GET_SHADOW, UPDATE_SHADOW, DELETE_SHADOW
+ * or GET_SECRET. Settings for every API are applied before those for one API.
+ *
+ * Inbound events can be generated for the handler registered with
+ * **gg_runtime_start()**, to measure dispatch throughput and latency. Setting
+ * a count, duration or rate starts the generator with the runtime, on a new
+ * thread with GG_RT_OPT_ASYNC and otherwise on the calling thread, which
+ * **gg_runtime_start()** then returns to once the count or duration is reached:
+ *
+ * - GG_SIM_EVENTS_COUNT: the number of events. 0, the default, is unlimited.
+ * - GG_SIM_EVENTS_DURATION: how long to generate events for, as a duration.
+ *   0, the default, is unlimited.
+ * - GG_SIM_EVENTS_RATE: events per second. 0, the default, generates them as
+ *   fast as the handler returns.
+ * - GG_SIM_EVENTS_BURST: events sent back to back each time, at the rate on
+ *   average. Defaults to 1.
+ * - GG_SIM_EVENTS_ARRIVALS: uniform, the default, spaces bursts evenly, and
+ *   poisson spaces them randomly.
+ * - GG_SIM_EVENTS_PAYLOAD_SIZE: a distribution as for the latencies, of sizes
+ *   in bytes with an optional k or m suffix. Defaults to constant:256.
+ *   Payloads of 32 bytes or more are JSON objects with a seq field.
+ * - GG_SIM_EVENTS_TOPICS: a comma separated list of topics, one of which is
+ *   picked at random as the subject of each event's client context.
+ *   Defaults to gg-sim/events.
+ * - GG_SIM_EVENTS_FUNCTION_ARNS: a comma separated list of the function arns
+ *   picked from at random for each event.
+ * - GG_SIM_EVENTS_REPORT: 1 writes the event stats to stderr when the
+ *   generator finishes.
+ */
+#ifndef _GREENGRASS_SDK_SIM_H_
+#define _GREENGRASS_SDK_SIM_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "greengrasssdk.h"
+
+/**
+ * @brief Counts of the calls the simulator has handled
+ */
+typedef struct gg_sim_stats {
+    uint64_t publishes;
+    /** Publishes delivered to the handler, one for each matching subscription */
+    uint64_t deliveries;
+    uint64_t invokes;
+    uint64_t shadow_gets;
+    uint64_t shadow_updates;
+    uint64_t shadow_deletes;
+    uint64_t secret_gets;
+    uint64_t handler_responses;
+    uint64_t handler_errors;
+    /** Publishes that responded with GG_REQUEST_AGAIN */
+    uint64_t throttled;
+    /** Deliveries that did not fit in the queue */
+    uint64_t dropped;
+    /** Calls failed with GGE_INTERNAL_FAILURE */
+    uint64_t injected_failures;
+    /** Requests initialized */
+    uint64_t requests;
+    /** Requests initialized and not yet closed */
+    uint64_t open_requests;
+    /** Uses and closes of requests that were closed or never initialized */
+    uint64_t invalid_requests;
+} gg_sim_stats;
+
+/**
+ * @brief Counts and latencies of the generated events
+ */
+typedef struct gg_sim_event_stats {
+    uint64_t events;
+    uint64_t payload_bytes;
+    /** From the first event to the last, or to now while events are generated */
+    uint64_t elapsed_ns;
+    /** Percentiles of the time the handler took to return, for each event */
+    uint64_t handler_p50_ns;
+    uint64_t handler_p90_ns;
+    uint64_t handler_p99_ns;
+    uint64_t handler_max_ns;
+    /** Percentiles of how far behind its schedule each event was dispatched */
+    uint64_t lag_p50_ns;
+    uint64_t lag_p99_ns;
+    uint64_t lag_max_ns;
+} gg_sim_event_stats;
+
+/**
+ * @brief Stops generating events, then clears all subscriptions, shadows,
+ *        secrets, invoke responses and stats, empties the queue and reseeds
+ *        the fault injection
+ * @note Fault injection and event settings are kept.
+ */
+void gg_sim_reset(void);
+
+/**
+ * @brief Sets a fault injection or event setting, such as GG_SIM_LATENCY_PUBLISH
+ * @return GGE_INVALID_PARAMETER for an unknown key or invalid value
+ */
+gg_error gg_sim_configure(const char *key, const char *value);
+
+/**
+ * @brief Reads fault injection and event settings from a file of KEY=VALUE lines.
+ *        Blank lines and lines starting with # are ignored.
+ */
+gg_error gg_sim_load_config(const char *path);
+
+/**
+ * @brief Delivers publishes matching the topic filter to the registered handler
+ * @param topic_filter An MQTT topic filter, which may contain + and # wildcards
+ * @note Subscriptions can also be given as a comma separated list of filters
+ *       in the GG_SIM_SUBSCRIPTIONS environment variable, read by
+ *       **gg_global_init()**.
+ */
+gg_error gg_sim_subscribe(const char *topic_filter);
+
+gg_error gg_sim_unsubscribe(const char *topic_filter);
+
+/**
+ * @brief Calls the registered handler with the message, as if it was
+ *        published to the topic
+ */
+gg_error gg_sim_deliver(const char *topic, const void *payload,
+                        size_t payload_size);
+
+/**
+ * @brief Sets the message that **gg_lambda_handler_read()** reads on the
+ *        calling thread, without copying it
+ * @note The payload must outlive the reads.
+ */
+void gg_sim_set_handler_message(const void *payload, size_t payload_size);
+
+/**
+ * @brief Adds a secret, replacing any secret with the same id and version
+ * @param version_id The version, or NULL for a generated one
+ * @param version_stage The stage of the version, or NULL for AWSCURRENT
+ */
+gg_error gg_sim_set_secret(const char *secret_id, const char *version_id,
+                           const char *version_stage,
+                           const char *secret_string);
+
+/**
+ * @brief Replaces the shadow of the thing
+ * @param document A JSON shadow document with a state, or NULL to delete
+ *        the shadow
+ */
+gg_error gg_sim_set_shadow(const char *thing_name, const char *document);
+
+/**
+ * @brief Sets the response of invokes of the function, which otherwise
+ *        respond with their payload
+ * @param response The response, or NULL to go back to echoing the payload
+ */
+gg_error gg_sim_set_invoke_response(const char *function_arn,
+                                    const void *response,
+                                    size_t response_size);
+
+void gg_sim_get_stats(gg_sim_stats *stats);
+
+/**
+ * @brief Generates events for the handler registered with
+ *        **gg_runtime_start()** again, on a new thread as with
+ *        GG_RT_OPT_ASYNC, with the current settings
+ * @return GGE_INVALID_STATE without a handler or while events are generated
+ */
+gg_error gg_sim_start_events(void);
+
+/**
+ * @brief Waits for events started with GG_RT_OPT_ASYNC to reach their count
+ *        or duration
+ * @return GGE_INVALID_STATE if events are unlimited
+ */
+gg_error gg_sim_wait_events(void);
+
+/**
+ * @brief Stops generating events, waiting for the last to be handled
+ */
+void gg_sim_stop_events(void);
+
+void gg_sim_get_event_stats(gg_sim_event_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef _GREENGRASS_SDK_SIM_H_ */
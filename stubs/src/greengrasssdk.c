@@ -1,108 +1,1455 @@
+/*
+ * Copyright 2020-present, Nike, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the Apache-2.0 license found in
+ * the LICENSE file in the root of this source tree.
+ */
+
+/*
+ * An in-memory simulation of a Greengrass core, see greengrasssdk_sim.h
+ */
 #include "shared/greengrasssdk.h"
+#include "shared/greengrasssdk_sim.h"
+#include "sim_events.h"
+#include "sim_faults.h"
+#include "sim_json.h"
 
-gg_error gg_global_init(uint32_t opt) {
-    return GGE_SUCCESS;
+#include <ctype.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SIM_SECRET_ARN_PREFIX "arn:aws:secretsmanager:us-west-2:123456789012:secret:"
+#define SIM_DEFAULT_STAGE "AWSCURRENT"
+#define SIM_PREVIOUS_STAGE "AWSPREVIOUS"
+#define SIM_REQUEST_BUCKETS 256
+#define SIM_LEAK_REPORT_APIS 16
+
+struct _gg_request {
+    /** The response of the last call made with the request */
+    char *response;
+    size_t response_size;
+    size_t read_offset;
+    /** The API last called with the request, reported if it is never closed */
+    const char *last_api;
+    /** The calls using the request, which keep it from being freed */
+    unsigned in_use;
+    /** Closed while in use, so the last call using it frees it */
+    int closed;
+    /** The next live request in the same bucket */
+    struct _gg_request *next;
+};
+
+struct _gg_publish_options {
+    gg_queue_full_policy_options queue_full_policy;
+};
+
+typedef struct sim_subscription {
+    char *topic_filter;
+    struct sim_subscription *next;
+} sim_subscription;
+
+typedef struct sim_shadow {
+    char *thing_name;
+    sj_value *state;
+    unsigned long long version;
+    struct sim_shadow *next;
+} sim_shadow;
+
+typedef struct sim_secret {
+    char *secret_id;
+    char *version_id;
+    char *version_stage;
+    char *secret_string;
+    time_t created;
+    struct sim_secret *next;
+} sim_secret;
+
+typedef struct sim_invoke_response {
+    char *function_arn;
+    void *response;
+    size_t response_size;
+    struct sim_invoke_response *next;
+} sim_invoke_response;
+
+/** The message being handled by the current thread */
+typedef struct sim_message {
+    const char *payload;
+    size_t payload_size;
+    size_t read_offset;
+} sim_message;
+
+/**
+ * Guards the handler, subscriptions, shadows, secrets, invoke responses and
+ * stats. It is never held while the handler runs or latency is injected, so
+ * handlers on many threads run concurrently and may call back into the SDK.
+ */
+static pthread_mutex_t sim_lock = PTHREAD_MUTEX_INITIALIZER;
+static gg_lambda_handler sim_handler;
+static sim_subscription *sim_subscriptions;
+static sim_shadow *sim_shadows;
+static sim_secret *sim_secrets;
+static sim_invoke_response *sim_invoke_responses;
+static gg_sim_stats sim_stats;
+static unsigned long long sim_next_version_id;
+static int sim_log_enabled;
+static int sim_strict;
+
+/** Guards the live requests, hashed by address, and their counts */
+static pthread_mutex_t sim_requests_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct _gg_request *sim_requests[SIM_REQUEST_BUCKETS];
+static uint64_t sim_requests_opened;
+static uint64_t sim_requests_open;
+static uint64_t sim_requests_invalid;
+
+static _Thread_local sim_message sim_current_message;
+
+/***************************************
+**              Helpers               **
+***************************************/
+
+static char *copy_string(const char *str)
+{
+    size_t len = strlen(str) + 1;
+    char *copy = malloc(len);
+    if (copy) {
+        memcpy(copy, str, len);
+    }
+    return copy;
 }
 
-gg_error gg_log(gg_log_level level, const char *format, ...) 
+/** Replaces the response of the request with a copy of the data */
+static gg_error set_response(gg_request ggreq, const void *data, size_t size)
 {
+    char *response = malloc(size ? size : 1);
+    if (!response) {
+        return GGE_OUT_OF_MEMORY;
+    }
+    if (size) {
+        memcpy(response, data, size);
+    }
+    free(ggreq->response);
+    ggreq->response = response;
+    ggreq->response_size = size;
+    ggreq->read_offset = 0;
     return GGE_SUCCESS;
 }
 
-gg_error gg_request_init(gg_request *ggreq) 
+/** Sets the response to an error body in the form the core sends, leaving the request status alone */
+static gg_error set_error_body(gg_request ggreq, int code, const char *message)
+{
+    static const char format[] = "{\"code\":%d,\"message\":\"%s\",\"timestamp\":%lld}";
+    long long timestamp = (long long)time(NULL);
+    char body[256];
+    int len = snprintf(body, sizeof(body), format, code, message, timestamp);
+    if (len < 0) {
+        return GGE_INTERNAL_FAILURE;
+    }
+    if ((size_t)len < sizeof(body)) {
+        return set_response(ggreq, body, (size_t)len);
+    }
+
+    /* a long message doesn't fit, so it is formatted again into a buffer sized for it */
+    char *long_body = malloc((size_t)len + 1);
+    if (!long_body) {
+        return GGE_OUT_OF_MEMORY;
+    }
+    gg_error err = GGE_INTERNAL_FAILURE;
+    if (snprintf(long_body, (size_t)len + 1, format, code, message, timestamp) == len) {
+        err = set_response(ggreq, long_body, (size_t)len);
+    }
+    free(long_body);
+    return err;
+}
+
+/** Responds with the JSON error body greengrass uses, and GG_REQUEST_HANDLED */
+static gg_error set_error_response(gg_request ggreq, int code,
+                                   const char *message,
+                                   gg_request_result *result)
+{
+    result->request_status = GG_REQUEST_HANDLED;
+    return set_error_body(ggreq, code, message);
+}
+
+/** Adds one to a count in the stats */
+static void count(uint64_t *counter)
+{
+    pthread_mutex_lock(&sim_lock);
+    (*counter)++;
+    pthread_mutex_unlock(&sim_lock);
+}
+
+/** Sleeps for the latency injected into the API, and counts injected failures */
+static gg_error inject_faults(sim_api api)
+{
+    gg_error err = sim_faults_enter(api);
+    if (err != GGE_SUCCESS) {
+        count(&sim_stats.injected_failures);
+    }
+    return err;
+}
+
+/** Whether the topic matches the MQTT topic filter */
+static int topic_matches(const char *filter, const char *topic)
 {
+    while (*filter) {
+        if (filter[0] == '#') {
+            return 1;
+        }
+        if (filter[0] == '+') {
+            while (*topic && *topic != '/') {
+                topic++;
+            }
+            filter++;
+        } else if (*filter == *topic) {
+            filter++;
+            topic++;
+        } else if (*topic == '\0' && strcmp(filter, "/#") == 0) {
+            /* a/# also matches the parent a */
+            return 1;
+        } else {
+            return 0;
+        }
+    }
+    return *topic == '\0';
+}
+
+/***************************************
+**              Requests              **
+***************************************/
+
+static size_t request_bucket(gg_request ggreq)
+{
+    return ((uintptr_t)ggreq / sizeof(struct _gg_request)) % SIM_REQUEST_BUCKETS;
+}
+
+/** Unlinks the request from the live requests, returning 0 if it isn't live */
+static int remove_request(gg_request ggreq)
+{
+    for (gg_request *link = &sim_requests[request_bucket(ggreq)]; *link;
+            link = &(*link)->next) {
+        if (*link == ggreq) {
+            *link = ggreq->next;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/** Counts and reports a request that is closed or was never initialized */
+static gg_error invalid_request(gg_request ggreq, const char *api)
+{
+    pthread_mutex_lock(&sim_requests_lock);
+    sim_requests_invalid++;
+    pthread_mutex_unlock(&sim_requests_lock);
+    fprintf(stderr, "gg_sim: %s called with request %p, which is closed or was never initialized\n",
+            api, (void *)ggreq);
+    if (sim_strict) {
+        abort();
+    }
+    return GGE_INVALID_PARAMETER;
+}
+
+/** Checks that the request is live before the API uses it, which must release it once done */
+static gg_error use_request(gg_request ggreq, const char *api)
+{
+    pthread_mutex_lock(&sim_requests_lock);
+    gg_request live = sim_requests[request_bucket(ggreq)];
+    while (live && live != ggreq) {
+        live = live->next;
+    }
+    if (live) {
+        live->last_api = api;
+        live->in_use++;
+    }
+    pthread_mutex_unlock(&sim_requests_lock);
+    return live ? GGE_SUCCESS : invalid_request(ggreq, api);
+}
+
+static void free_request(gg_request ggreq)
+{
+    free(ggreq->response);
+    free(ggreq);
+}
+
+/** Ends a use of the request, freeing it if it was closed meanwhile */
+static void release_request(gg_request ggreq)
+{
+    pthread_mutex_lock(&sim_requests_lock);
+    int freeing = --ggreq->in_use == 0 && ggreq->closed;
+    pthread_mutex_unlock(&sim_requests_lock);
+    if (freeing) {
+        free_request(ggreq);
+    }
+}
+
+/** Reports the requests that were never closed when the process exits */
+__attribute__((destructor))
+static void report_leaked_requests(void)
+{
+    struct {
+        const char *api;
+        uint64_t count;
+    } apis[SIM_LEAK_REPORT_APIS] = { { 0 } };
+
+    pthread_mutex_lock(&sim_requests_lock);
+    uint64_t leaked = sim_requests_open;
+    for (size_t bucket = 0; bucket < SIM_REQUEST_BUCKETS; bucket++) {
+        for (gg_request ggreq = sim_requests[bucket]; ggreq; ggreq = ggreq->next) {
+            const char *api = ggreq->last_api ? ggreq->last_api : "gg_request_init";
+            /* the names are literals, so they are compared by address */
+            for (size_t i = 0; i < SIM_LEAK_REPORT_APIS; i++) {
+                if (!apis[i].api || apis[i].api == api) {
+                    apis[i].api = api;
+                    apis[i].count++;
+                    break;
+                }
+            }
+        }
+    }
+    pthread_mutex_unlock(&sim_requests_lock);
+
+    if (leaked == 0) {
+        return;
+    }
+    fprintf(stderr, "gg_sim: requests never closed: %llu\n", (unsigned long long)leaked);
+    for (size_t i = 0; i < SIM_LEAK_REPORT_APIS && apis[i].api; i++) {
+        fprintf(stderr, "gg_sim:   %llu last used by %s\n",
+                (unsigned long long)apis[i].count, apis[i].api);
+    }
+    if (sim_strict) {
+        _exit(EXIT_FAILURE);
+    }
+}
+
+/***************************************
+**            Global Methods          **
+***************************************/
+
+gg_error gg_global_init(uint32_t opt)
+{
+    /* the core takes no options yet */
+    (void)opt;
+
+    sim_log_enabled = getenv("GG_SIM_LOG") != NULL;
+    sim_strict = getenv("GG_SIM_STRICT") != NULL;
+
+    /* settings in the environment override those in the file */
+    const char *config = getenv("GG_SIM_CONFIG");
+    gg_error err = config ? gg_sim_load_config(config) : GGE_SUCCESS;
+    if (err != GGE_SUCCESS
+            || (err = sim_faults_load_env()) != GGE_SUCCESS
+            || (err = sim_events_load_env()) != GGE_SUCCESS) {
+        return err;
+    }
+
+    const char *subscriptions = getenv("GG_SIM_SUBSCRIPTIONS");
+    if (subscriptions) {
+        char *filters = copy_string(subscriptions);
+        if (!filters) {
+            return GGE_OUT_OF_MEMORY;
+        }
+        char *saveptr = NULL;
+        for (char *filter = strtok_r(filters, ",", &saveptr); filter;
+                filter = strtok_r(NULL, ",", &saveptr)) {
+            err = gg_sim_subscribe(filter);
+            if (err != GGE_SUCCESS) {
+                free(filters);
+                return err;
+            }
+        }
+        free(filters);
+    }
     return GGE_SUCCESS;
 }
 
-gg_error gg_request_close(gg_request ggreq) 
+gg_error gg_log(gg_log_level level, const char *format, ...)
 {
+    static const char *level_names[] = {
+        "NOTSET", "DEBUG", "INFO", "WARN", "ERROR", "FATAL"
+    };
+    if (!sim_log_enabled) {
+        return GGE_SUCCESS;
+    }
+    if (level <= GG_LOG_RESERVED_NOTSET || level >= GG_LOG_RESERVED_MAX) {
+        return GGE_INVALID_PARAMETER;
+    }
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "[%s] ", level_names[level]);
+    vfprintf(stderr, format, args);
+    fputc('\n', stderr);
+    va_end(args);
     return GGE_SUCCESS;
 }
 
-gg_error gg_request_read(gg_request ggreq, void *buffer, size_t buffer_size,
-                         size_t *amount_read) {
+gg_error gg_request_init(gg_request *ggreq)
+{
+    if (!ggreq) {
+        return GGE_INVALID_PARAMETER;
+    }
+    gg_request request = calloc(1, sizeof(struct _gg_request));
+    if (!request) {
+        return GGE_OUT_OF_MEMORY;
+    }
+    pthread_mutex_lock(&sim_requests_lock);
+    gg_request *bucket = &sim_requests[request_bucket(request)];
+    request->next = *bucket;
+    *bucket = request;
+    sim_requests_opened++;
+    sim_requests_open++;
+    pthread_mutex_unlock(&sim_requests_lock);
+    *ggreq = request;
+    return GGE_SUCCESS;
+}
 
+gg_error gg_request_close(gg_request ggreq)
+{
+    if (!ggreq) {
+        return GGE_INVALID_PARAMETER;
+    }
+    pthread_mutex_lock(&sim_requests_lock);
+    int live = remove_request(ggreq);
+    sim_requests_open -= live;
+    const char *api = NULL;
+    if (live && ggreq->in_use) {
+        ggreq->closed = 1;
+        api = ggreq->last_api;
+    }
+    pthread_mutex_unlock(&sim_requests_lock);
+    /* a second close must not free the request again */
+    if (!live) {
+        return invalid_request(ggreq, "gg_request_close");
+    }
+    if (api) {
+        /* the call using it frees it once it returns */
+        fprintf(stderr, "gg_sim: gg_request_close called with request %p while %s is using it\n",
+                (void *)ggreq, api);
+        if (sim_strict) {
+            abort();
+        }
+        return GGE_SUCCESS;
+    }
+    free_request(ggreq);
     return GGE_SUCCESS;
 }
 
-gg_error gg_runtime_start(gg_lambda_handler handler, uint32_t opt) 
+static void read_response(gg_request ggreq, void *buffer, size_t buffer_size,
+                          size_t *amount_read)
+{
+    size_t remaining = ggreq->response_size - ggreq->read_offset;
+    size_t read = remaining < buffer_size ? remaining : buffer_size;
+    if (read > 0) {
+        memcpy(buffer, ggreq->response + ggreq->read_offset, read);
+        ggreq->read_offset += read;
+    }
+    *amount_read = read;
+}
+
+gg_error gg_request_read(gg_request ggreq, void *buffer, size_t buffer_size,
+                         size_t *amount_read)
+{
+    if (!ggreq || !buffer || !amount_read) {
+        return GGE_INVALID_PARAMETER;
+    }
+    gg_error err = use_request(ggreq, "gg_request_read");
+    if (err == GGE_SUCCESS) {
+        read_response(ggreq, buffer, buffer_size, amount_read);
+        release_request(ggreq);
+    }
+    return err;
+}
+
+/***************************************
+**         Runtime Methods            **
+***************************************/
+
+gg_error gg_runtime_start(gg_lambda_handler handler, uint32_t opt)
 {
+    if (!handler) {
+        return GGE_INVALID_PARAMETER;
+    }
+    /* messages are delivered on the publishing thread, so only generated events need running */
+    pthread_mutex_lock(&sim_lock);
+    sim_handler = handler;
+    pthread_mutex_unlock(&sim_lock);
+    if (sim_events_enabled()) {
+        return sim_events_start(handler, opt & GG_RT_OPT_ASYNC);
+    }
     return GGE_SUCCESS;
 }
 
 gg_error gg_lambda_handler_read(void *buffer, size_t buffer_size,
-                                size_t *amount_read) 
+                                size_t *amount_read)
 {
+    if (!buffer || !amount_read) {
+        return GGE_INVALID_PARAMETER;
+    }
+    sim_message *message = &sim_current_message;
+    size_t remaining = message->payload_size - message->read_offset;
+    size_t read = remaining < buffer_size ? remaining : buffer_size;
+    if (read > 0) {
+        memcpy(buffer, message->payload + message->read_offset, read);
+        message->read_offset += read;
+    }
+    *amount_read = read;
     return GGE_SUCCESS;
 }
+
 gg_error gg_lambda_handler_write_response(const void *response,
                                           size_t response_size)
 {
+    /* there is no core to send the response to, so it is only counted */
+    (void)response;
+    (void)response_size;
+    count(&sim_stats.handler_responses);
     return GGE_SUCCESS;
 }
 
-gg_error gg_lambda_handler_write_error(const char *error_message) 
+gg_error gg_lambda_handler_write_error(const char *error_message)
 {
+    if (!error_message) {
+        return GGE_INVALID_PARAMETER;
+    }
+    count(&sim_stats.handler_errors);
     return GGE_SUCCESS;
 }
 
+/***************************************
+**     AWS Secrets Manager Methods    **
+***************************************/
+
+static sim_secret *find_secret(const char *secret_id, const char *version_id,
+                               const char *version_stage)
+{
+    for (sim_secret *secret = sim_secrets; secret; secret = secret->next) {
+        if (strcmp(secret->secret_id, secret_id) != 0) {
+            continue;
+        }
+        if (version_id) {
+            if (strcmp(secret->version_id, version_id) == 0) {
+                return secret;
+            }
+        } else if (secret->version_stage
+                && strcmp(secret->version_stage, version_stage) == 0) {
+            return secret;
+        }
+    }
+    return NULL;
+}
+
+/** Responds with the secret, called with the lock held */
+static gg_error respond_with_secret(gg_request ggreq, const char *secret_id,
+                                    const char *version_id,
+                                    const char *version_stage,
+                                    gg_request_result *result)
+{
+    sim_secret *secret = find_secret(secret_id, version_id,
+            version_stage ? version_stage : SIM_DEFAULT_STAGE);
+    if (!secret) {
+        return set_error_response(ggreq, 404,
+                "Secrets Manager can't find the specified secret.", result);
+    }
+
+    char created[32];
+    snprintf(created, sizeof(created), "%lld", (long long)secret->created);
+    sj_buffer body = { 0 };
+    int ok = sj_buffer_append_str(&body, "{\"ARN\":\"" SIM_SECRET_ARN_PREFIX)
+        && sj_buffer_append_escaped(&body, secret->secret_id)
+        && sj_buffer_append_str(&body, "\",\"Name\":")
+        && sj_buffer_append_quoted(&body, secret->secret_id)
+        && sj_buffer_append_str(&body, ",\"VersionId\":")
+        && sj_buffer_append_quoted(&body, secret->version_id)
+        && sj_buffer_append_str(&body, ",\"SecretString\":")
+        && sj_buffer_append_quoted(&body, secret->secret_string)
+        && sj_buffer_append_str(&body, ",\"VersionStages\":[")
+        && (!secret->version_stage
+            || sj_buffer_append_quoted(&body, secret->version_stage))
+        && sj_buffer_append_str(&body, "],\"CreatedDate\":")
+        && sj_buffer_append_str(&body, created)
+        && sj_buffer_append_str(&body, "}");
+    gg_error err = ok ? set_response(ggreq, body.data, body.len) : GGE_OUT_OF_MEMORY;
+    sj_buffer_free(&body);
+    result->request_status = GG_REQUEST_SUCCESS;
+    return err;
+}
+
+static gg_error get_secret_value(gg_request ggreq, const char *secret_id,
+                                 const char *version_id, const char *version_stage,
+                                 gg_request_result *result)
+{
+    count(&sim_stats.secret_gets);
+    gg_error err = inject_faults(SIM_API_GET_SECRET);
+    if (err != GGE_SUCCESS) {
+        return err;
+    }
+
+    pthread_mutex_lock(&sim_lock);
+    err = respond_with_secret(ggreq, secret_id, version_id, version_stage, result);
+    pthread_mutex_unlock(&sim_lock);
+    return err;
+}
+
 gg_error gg_get_secret_value(gg_request ggreq, const char *secret_id,
 		const char *version_id, const char *version_stage,
-		gg_request_result *result) 
+		gg_request_result *result)
 {
-    return GGE_SUCCESS;
+    if (!ggreq || !secret_id || !result) {
+        return GGE_INVALID_PARAMETER;
+    }
+    gg_error err = use_request(ggreq, "gg_get_secret_value");
+    if (err == GGE_SUCCESS) {
+        err = get_secret_value(ggreq, secret_id, version_id, version_stage, result);
+        release_request(ggreq);
+    }
+    return err;
+}
+
+/***************************************
+**           Lambda Methods           **
+***************************************/
+
+static gg_error invoke(gg_request ggreq, const gg_invoke_options *opts,
+                       gg_request_result *result)
+{
+    count(&sim_stats.invokes);
+    gg_error err = inject_faults(SIM_API_INVOKE);
+    if (err != GGE_SUCCESS) {
+        return err;
+    }
+    result->request_status = GG_REQUEST_SUCCESS;
+    if (opts->type == GG_INVOKE_EVENT) {
+        return set_response(ggreq, NULL, 0);
+    }
+
+    pthread_mutex_lock(&sim_lock);
+    for (sim_invoke_response *configured = sim_invoke_responses; configured;
+            configured = configured->next) {
+        if (strcmp(configured->function_arn, opts->function_arn) == 0) {
+            err = set_response(ggreq, configured->response,
+                    configured->response_size);
+            pthread_mutex_unlock(&sim_lock);
+            return err;
+        }
+    }
+    pthread_mutex_unlock(&sim_lock);
+    return set_response(ggreq, opts->payload, opts->payload ? opts->payload_size : 0);
 }
 
 gg_error gg_invoke(gg_request ggreq, const gg_invoke_options *opts,
-                   gg_request_result *result) 
+                   gg_request_result *result)
 {
-    return GGE_SUCCESS;
+    if (!ggreq || !opts || !opts->function_arn || !result) {
+        return GGE_INVALID_PARAMETER;
+    }
+    gg_error err = use_request(ggreq, "gg_invoke");
+    if (err == GGE_SUCCESS) {
+        err = invoke(ggreq, opts, result);
+        release_request(ggreq);
+    }
+    return err;
 }
 
-gg_error gg_publish_options_init(gg_publish_options *opts) 
+/***************************************
+**           AWS IoT Methods          **
+***************************************/
+
+gg_error gg_publish_options_init(gg_publish_options *opts)
 {
+    if (!opts) {
+        return GGE_INVALID_PARAMETER;
+    }
+    *opts = calloc(1, sizeof(struct _gg_publish_options));
+    if (!*opts) {
+        return GGE_OUT_OF_MEMORY;
+    }
+    (*opts)->queue_full_policy = GG_QUEUE_FULL_POLICY_BEST_EFFORT;
     return GGE_SUCCESS;
 }
 
 gg_error gg_publish_options_free(gg_publish_options opts)
 {
+    if (!opts) {
+        return GGE_INVALID_PARAMETER;
+    }
+    free(opts);
     return GGE_SUCCESS;
 }
 
 gg_error gg_publish_options_set_queue_full_policy(gg_publish_options opts,
-        gg_queue_full_policy_options policy) 
+        gg_queue_full_policy_options policy)
 {
+    if (!opts || policy >= GG_QUEUE_FULL_POLICY_RESERVED_MAX) {
+        return GGE_INVALID_PARAMETER;
+    }
+    opts->queue_full_policy = policy;
     return GGE_SUCCESS;
 }
 
+/**
+ * Calls the handler with the message once for each subscription matching the
+ * topic that the queue has room for. A topic without subscriptions still has
+ * one target, the route to the cloud.
+ */
+static gg_error deliver(const char *topic, const void *payload,
+                        size_t payload_size,
+                        gg_queue_full_policy_options policy,
+                        gg_request_status *status)
+{
+    pthread_mutex_lock(&sim_lock);
+    size_t targets = 0;
+    for (sim_subscription *subscription = sim_subscriptions; subscription;
+            subscription = subscription->next) {
+        targets += topic_matches(subscription->topic_filter, topic);
+    }
+    int has_handler = sim_handler != NULL;
+    pthread_mutex_unlock(&sim_lock);
+
+    size_t routes = targets ? targets : 1;
+    size_t accepted = sim_faults_enqueue(routes, policy);
+    *status = accepted == 0 && policy == GG_QUEUE_FULL_POLICY_ALL_OR_ERROR
+        ? GG_REQUEST_AGAIN
+        : GG_REQUEST_SUCCESS;
+    pthread_mutex_lock(&sim_lock);
+    sim_stats.dropped += routes - accepted;
+    sim_stats.throttled += *status == GG_REQUEST_AGAIN;
+    pthread_mutex_unlock(&sim_lock);
+    if (!has_handler) {
+        return GGE_SUCCESS;
+    }
+
+    /* every subscription routes to the one handler, which is called without the lock held */
+    for (size_t deliveries = targets < accepted ? targets : accepted;
+            deliveries > 0; deliveries--) {
+        gg_error err = gg_sim_deliver(topic, payload, payload_size);
+        if (err != GGE_SUCCESS) {
+            return err;
+        }
+    }
+    return GGE_SUCCESS;
+}
+
+static gg_error publish(gg_request ggreq, const char *topic,
+        const void *payload, size_t payload_size, const gg_publish_options opts,
+        gg_request_result *result)
+{
+    count(&sim_stats.publishes);
+    gg_error err = inject_faults(SIM_API_PUBLISH);
+    if (err != GGE_SUCCESS) {
+        return err;
+    }
+    gg_queue_full_policy_options policy = opts
+        ? opts->queue_full_policy
+        : GG_QUEUE_FULL_POLICY_BEST_EFFORT;
+    err = deliver(topic, payload, payload_size, policy, &result->request_status);
+    if (err != GGE_SUCCESS) {
+        return err;
+    }
+    if (result->request_status == GG_REQUEST_AGAIN) {
+        /* a throttled publish has an error body like any other failed request */
+        return set_error_body(ggreq, 429, "queue full");
+    }
+    return set_response(ggreq, NULL, 0);
+}
+
 gg_error gg_publish_with_options(gg_request ggreq, const char *topic,
         const void *payload, size_t payload_size, const gg_publish_options opts,
-        gg_request_result *result) 
+        gg_request_result *result)
 {
-    return GGE_SUCCESS;
+    if (!ggreq || !topic || (!payload && payload_size) || !result) {
+        return GGE_INVALID_PARAMETER;
+    }
+    gg_error err = use_request(ggreq, "gg_publish");
+    if (err == GGE_SUCCESS) {
+        err = publish(ggreq, topic, payload, payload_size, opts, result);
+        release_request(ggreq);
+    }
+    return err;
 }
 
 gg_error gg_publish(gg_request ggreq, const char *topic, const void *payload,
-                    size_t payload_size, gg_request_result *result) 
+                    size_t payload_size, gg_request_result *result)
 {
-    return GGE_SUCCESS;
+    return gg_publish_with_options(ggreq, topic, payload, payload_size, NULL,
+            result);
+}
+
+static sim_shadow *find_shadow(const char *thing_name)
+{
+    for (sim_shadow *shadow = sim_shadows; shadow; shadow = shadow->next) {
+        if (strcmp(shadow->thing_name, thing_name) == 0) {
+            return shadow;
+        }
+    }
+    return NULL;
+}
+
+static void remove_shadow(const char *thing_name)
+{
+    for (sim_shadow **link = &sim_shadows; *link; link = &(*link)->next) {
+        if (strcmp((*link)->thing_name, thing_name) == 0) {
+            sim_shadow *shadow = *link;
+            *link = shadow->next;
+            sj_free(shadow->state);
+            free(shadow->thing_name);
+            free(shadow);
+            return;
+        }
+    }
+}
+
+static sim_shadow *add_shadow(const char *thing_name)
+{
+    sim_shadow *shadow = calloc(1, sizeof(sim_shadow));
+    if (!shadow) {
+        return NULL;
+    }
+    shadow->thing_name = copy_string(thing_name);
+    shadow->state = sj_new(SJ_OBJECT);
+    if (!shadow->thing_name || !shadow->state) {
+        free(shadow->thing_name);
+        sj_free(shadow->state);
+        free(shadow);
+        return NULL;
+    }
+    shadow->next = sim_shadows;
+    sim_shadows = shadow;
+    return shadow;
+}
+
+/** Appends the shadow topic for the thing, e.g. $aws/things/my_thing/shadow/update/accepted */
+static int append_shadow_topic(sj_buffer *topic, const char *thing_name,
+                               const char *suffix)
+{
+    return sj_buffer_append_str(topic, "$aws/things/")
+        && sj_buffer_append_str(topic, thing_name)
+        && sj_buffer_append_str(topic, "/shadow/")
+        && sj_buffer_append_str(topic, suffix);
+}
+
+/** Publishes the body to the shadow topic, as the core does for accepted requests */
+static gg_error publish_shadow_event(const char *thing_name, const char *suffix,
+                                     const sj_buffer *body)
+{
+    sj_buffer topic = { 0 };
+    gg_request_status status;
+    gg_error err = append_shadow_topic(&topic, thing_name, suffix)
+        ? deliver(topic.data, body->data, body->len,
+                GG_QUEUE_FULL_POLICY_BEST_EFFORT, &status)
+        : GGE_OUT_OF_MEMORY;
+    sj_buffer_free(&topic);
+    return err;
+}
+
+/** Responds with the shadow document, called with the lock held */
+static gg_error respond_with_shadow(gg_request ggreq, const char *thing_name,
+                                    gg_request_result *result)
+{
+    sim_shadow *shadow = find_shadow(thing_name);
+    if (!shadow) {
+        return set_error_response(ggreq, 404, "No shadow exists with name", result);
+    }
+
+    char tail[96];
+    snprintf(tail, sizeof(tail), ",\"version\":%llu,\"timestamp\":%lld}",
+            shadow->version, (long long)time(NULL));
+    sj_buffer body = { 0 };
+    int ok = sj_buffer_append_str(&body, "{\"state\":")
+        && sj_write(&body, shadow->state)
+        && sj_buffer_append_str(&body, tail);
+    gg_error err = ok ? set_response(ggreq, body.data, body.len) : GGE_OUT_OF_MEMORY;
+    sj_buffer_free(&body);
+    result->request_status = GG_REQUEST_SUCCESS;
+    return err;
+}
+
+static gg_error get_shadow(gg_request ggreq, const char *thing_name,
+                           gg_request_result *result)
+{
+    count(&sim_stats.shadow_gets);
+    gg_error err = inject_faults(SIM_API_GET_SHADOW);
+    if (err != GGE_SUCCESS) {
+        return err;
+    }
+
+    pthread_mutex_lock(&sim_lock);
+    err = respond_with_shadow(ggreq, thing_name, result);
+    pthread_mutex_unlock(&sim_lock);
+    return err;
 }
 
 gg_error gg_get_thing_shadow(gg_request ggreq, const char *thing_name,
-                             gg_request_result *result) 
+                             gg_request_result *result)
 {
-    return GGE_SUCCESS;
+    if (!ggreq || !thing_name || !result) {
+        return GGE_INVALID_PARAMETER;
+    }
+    gg_error err = use_request(ggreq, "gg_get_thing_shadow");
+    if (err == GGE_SUCCESS) {
+        err = get_shadow(ggreq, thing_name, result);
+        release_request(ggreq);
+    }
+    return err;
 }
 
-gg_error gg_delete_thing_shadow(gg_request ggreq, const char *thing_name,
-                                gg_request_result *result) 
+/**
+ * Writes the delta document when the desired state differs from the reported
+ * state, otherwise leaves the body empty. Returns 0 if memory runs out.
+ */
+static int write_shadow_delta(const sim_shadow *shadow, const char *tail,
+                              const sj_value *client_token, sj_buffer *body)
 {
-    return GGE_SUCCESS;
+    sj_value *delta = sj_delta(sj_get(shadow->state, "desired"),
+            sj_get(shadow->state, "reported"));
+    if (!delta) {
+        return 0;
+    }
+    int ok = !delta->children
+        || (sj_buffer_append_str(body, "{\"state\":")
+            && sj_write(body, delta)
+            && sj_buffer_append_str(body, tail)
+            && (!client_token
+                || (sj_buffer_append_str(body, ",\"clientToken\":")
+                    && sj_write(body, client_token)))
+            && sj_buffer_append_str(body, "}"));
+    sj_free(delta);
+    return ok;
+}
+
+/**
+ * Merges the state of the update into the shadow and writes the accepted
+ * document to the body, and the delta document when the desired state still
+ * differs from the reported one, called with the lock held. A version conflict
+ * responds with an error and leaves both bodies empty.
+ */
+static gg_error apply_shadow_update(gg_request ggreq, const char *thing_name,
+                                    sj_value *update, sj_buffer *body,
+                                    sj_buffer *delta,
+                                    gg_request_result *result)
+{
+    sim_shadow *shadow = find_shadow(thing_name);
+    sj_value *expected = sj_get(update, "version");
+    if (expected && (expected->type != SJ_NUMBER || !shadow
+            || strtoull(expected->text, NULL, 10) != shadow->version)) {
+        return set_error_response(ggreq, 409, "Version conflict", result);
+    }
+    if (!shadow && !(shadow = add_shadow(thing_name))) {
+        return GGE_OUT_OF_MEMORY;
+    }
+    sj_value *state = sj_get(update, "state");
+    if (!sj_merge(shadow->state, state)) {
+        return GGE_OUT_OF_MEMORY;
+    }
+    shadow->version++;
+
+    /* the accepted document echoes the update with the new version */
+    sj_value *client_token = sj_get(update, "clientToken");
+    char tail[96];
+    snprintf(tail, sizeof(tail), ",\"version\":%llu,\"timestamp\":%lld",
+            shadow->version, (long long)time(NULL));
+    int ok = sj_buffer_append_str(body, "{\"state\":")
+        && sj_write(body, state)
+        && sj_buffer_append_str(body, tail)
+        && (!client_token
+            || (sj_buffer_append_str(body, ",\"clientToken\":")
+                && sj_write(body, client_token)))
+        && sj_buffer_append_str(body, "}")
+        && write_shadow_delta(shadow, tail, client_token, delta);
+    result->request_status = GG_REQUEST_SUCCESS;
+    return ok ? set_response(ggreq, body->data, body->len) : GGE_OUT_OF_MEMORY;
+}
+
+static gg_error update_shadow(gg_request ggreq, const char *thing_name,
+                              const char *update_payload,
+                              gg_request_result *result)
+{
+    count(&sim_stats.shadow_updates);
+    gg_error err = inject_faults(SIM_API_UPDATE_SHADOW);
+    if (err != GGE_SUCCESS) {
+        return err;
+    }
+
+    sj_value *update = sj_parse(update_payload, strlen(update_payload));
+    if (!update) {
+        return set_error_response(ggreq, 400, "Invalid JSON", result);
+    }
+    sj_value *state = sj_get(update, "state");
+    if (!state || state->type != SJ_OBJECT) {
+        sj_free(update);
+        return set_error_response(ggreq, 400, "Missing required node: state", result);
+    }
+
+    sj_buffer body = { 0 };
+    sj_buffer delta = { 0 };
+    pthread_mutex_lock(&sim_lock);
+    err = apply_shadow_update(ggreq, thing_name, update, &body, &delta, result);
+    pthread_mutex_unlock(&sim_lock);
+    sj_free(update);
+
+    if (err == GGE_SUCCESS && body.len > 0) {
+        err = publish_shadow_event(thing_name, "update/accepted", &body);
+    }
+    if (err == GGE_SUCCESS && delta.len > 0) {
+        err = publish_shadow_event(thing_name, "update/delta", &delta);
+    }
+    sj_buffer_free(&body);
+    sj_buffer_free(&delta);
+    return err;
 }
 
 gg_error gg_update_thing_shadow(gg_request ggreq, const char *thing_name,
                                 const char *update_payload,
-                                gg_request_result *result) 
+                                gg_request_result *result)
+{
+    if (!ggreq || !thing_name || !update_payload || !result) {
+        return GGE_INVALID_PARAMETER;
+    }
+    gg_error err = use_request(ggreq, "gg_update_thing_shadow");
+    if (err == GGE_SUCCESS) {
+        err = update_shadow(ggreq, thing_name, update_payload, result);
+        release_request(ggreq);
+    }
+    return err;
+}
+
+static gg_error delete_shadow(gg_request ggreq, const char *thing_name,
+                              gg_request_result *result)
+{
+    count(&sim_stats.shadow_deletes);
+    gg_error err = inject_faults(SIM_API_DELETE_SHADOW);
+    if (err != GGE_SUCCESS) {
+        return err;
+    }
+
+    pthread_mutex_lock(&sim_lock);
+    sim_shadow *shadow = find_shadow(thing_name);
+    if (!shadow) {
+        err = set_error_response(ggreq, 404, "No shadow exists with name", result);
+        pthread_mutex_unlock(&sim_lock);
+        return err;
+    }
+    char body_text[96];
+    int len = snprintf(body_text, sizeof(body_text),
+            "{\"version\":%llu,\"timestamp\":%lld}",
+            shadow->version, (long long)time(NULL));
+    remove_shadow(thing_name);
+    pthread_mutex_unlock(&sim_lock);
+
+    sj_buffer body = { 0 };
+    err = sj_buffer_append(&body, body_text, (size_t)len)
+        ? set_response(ggreq, body.data, body.len)
+        : GGE_OUT_OF_MEMORY;
+    if (err == GGE_SUCCESS) {
+        err = publish_shadow_event(thing_name, "delete/accepted", &body);
+    }
+    sj_buffer_free(&body);
+    result->request_status = GG_REQUEST_SUCCESS;
+    return err;
+}
+
+gg_error gg_delete_thing_shadow(gg_request ggreq, const char *thing_name,
+                                gg_request_result *result)
+{
+    if (!ggreq || !thing_name || !result) {
+        return GGE_INVALID_PARAMETER;
+    }
+    gg_error err = use_request(ggreq, "gg_delete_thing_shadow");
+    if (err == GGE_SUCCESS) {
+        err = delete_shadow(ggreq, thing_name, result);
+        release_request(ggreq);
+    }
+    return err;
+}
+
+/***************************************
+**        Simulator Controls          **
+***************************************/
+
+void gg_sim_reset(void)
+{
+    sim_events_stop();
+    sim_events_reset_stats();
+    pthread_mutex_lock(&sim_lock);
+    while (sim_subscriptions) {
+        sim_subscription *subscription = sim_subscriptions;
+        sim_subscriptions = subscription->next;
+        free(subscription->topic_filter);
+        free(subscription);
+    }
+    while (sim_shadows) {
+        remove_shadow(sim_shadows->thing_name);
+    }
+    while (sim_secrets) {
+        sim_secret *secret = sim_secrets;
+        sim_secrets = secret->next;
+        free(secret->secret_id);
+        free(secret->version_id);
+        free(secret->version_stage);
+        free(secret->secret_string);
+        free(secret);
+    }
+    while (sim_invoke_responses) {
+        sim_invoke_response *configured = sim_invoke_responses;
+        sim_invoke_responses = configured->next;
+        free(configured->function_arn);
+        free(configured->response);
+        free(configured);
+    }
+    memset(&sim_stats, 0, sizeof(sim_stats));
+    sim_next_version_id = 0;
+    pthread_mutex_unlock(&sim_lock);
+
+    /* live requests belong to the caller, so they stay open and counted */
+    pthread_mutex_lock(&sim_requests_lock);
+    sim_requests_opened = sim_requests_open;
+    sim_requests_invalid = 0;
+    pthread_mutex_unlock(&sim_requests_lock);
+    sim_faults_reset();
+}
+
+gg_error gg_sim_configure(const char *key, const char *value)
 {
+    if (key && strncmp(key, "GG_SIM_EVENTS_", strlen("GG_SIM_EVENTS_")) == 0) {
+        return sim_events_configure(key, value);
+    }
+    return sim_faults_configure(key, value);
+}
+
+static char *trim(char *text)
+{
+    while (isspace((unsigned char)*text)) {
+        text++;
+    }
+    char *end = text + strlen(text);
+    while (end > text && isspace((unsigned char)end[-1])) {
+        *--end = '\0';
+    }
+    return text;
+}
+
+gg_error gg_sim_load_config(const char *path)
+{
+    if (!path) {
+        return GGE_INVALID_PARAMETER;
+    }
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return GGE_INVALID_PARAMETER;
+    }
+    char line[512];
+    gg_error err = GGE_SUCCESS;
+    while (err == GGE_SUCCESS && fgets(line, sizeof(line), file)) {
+        char *setting = trim(line);
+        if (*setting == '\0' || *setting == '#') {
+            continue;
+        }
+        char *separator = strchr(setting, '=');
+        if (!separator) {
+            err = GGE_INVALID_PARAMETER;
+            break;
+        }
+        *separator = '\0';
+        err = gg_sim_configure(trim(setting), trim(separator + 1));
+    }
+    fclose(file);
+    return err;
+}
+
+/** Adds a subscription, called with the lock held */
+static gg_error add_subscription(const char *topic_filter)
+{
+    if (!topic_filter || !*topic_filter) {
+        return GGE_INVALID_PARAMETER;
+    }
+    sim_subscription *subscription = calloc(1, sizeof(sim_subscription));
+    if (!subscription || !(subscription->topic_filter = copy_string(topic_filter))) {
+        free(subscription);
+        return GGE_OUT_OF_MEMORY;
+    }
+    subscription->next = sim_subscriptions;
+    sim_subscriptions = subscription;
     return GGE_SUCCESS;
-}
\ No newline at end of file
+}
+
+gg_error gg_sim_subscribe(const char *topic_filter)
+{
+    pthread_mutex_lock(&sim_lock);
+    gg_error err = add_subscription(topic_filter);
+    pthread_mutex_unlock(&sim_lock);
+    return err;
+}
+
+/** Removes a subscription, called with the lock held */
+static gg_error remove_subscription(const char *topic_filter)
+{
+    if (!topic_filter) {
+        return GGE_INVALID_PARAMETER;
+    }
+    for (sim_subscription **link = &sim_subscriptions; *link; link = &(*link)->next) {
+        if (strcmp((*link)->topic_filter, topic_filter) == 0) {
+            sim_subscription *subscription = *link;
+            *link = subscription->next;
+            free(subscription->topic_filter);
+            free(subscription);
+            return GGE_SUCCESS;
+        }
+    }
+    return GGE_INVALID_PARAMETER;
+}
+
+gg_error gg_sim_unsubscribe(const char *topic_filter)
+{
+    pthread_mutex_lock(&sim_lock);
+    gg_error err = remove_subscription(topic_filter);
+    pthread_mutex_unlock(&sim_lock);
+    return err;
+}
+
+gg_error gg_sim_deliver(const char *topic, const void *payload,
+                        size_t payload_size)
+{
+    if (!topic || (!payload && payload_size)) {
+        return GGE_INVALID_PARAMETER;
+    }
+    pthread_mutex_lock(&sim_lock);
+    gg_lambda_handler handler = sim_handler;
+    pthread_mutex_unlock(&sim_lock);
+    if (!handler) {
+        return GGE_INVALID_STATE;
+    }
+
+    char *encoded = sim_subject_context(topic);
+    if (!encoded) {
+        return GGE_OUT_OF_MEMORY;
+    }
+
+    /* a handler may publish, so the message it is reading is restored afterwards */
+    sim_message outer = sim_current_message;
+    gg_sim_set_handler_message(payload, payload_size);
+    gg_lambda_context context = { SIM_FUNCTION_ARN, encoded };
+    handler(&context);
+    sim_current_message = outer;
+
+    free(encoded);
+    count(&sim_stats.deliveries);
+    return GGE_SUCCESS;
+}
+
+void gg_sim_set_handler_message(const void *payload, size_t payload_size)
+{
+    sim_current_message.payload = payload;
+    sim_current_message.payload_size = payload ? payload_size : 0;
+    sim_current_message.read_offset = 0;
+}
+
+/** Adds or replaces a secret, called with the lock held */
+static gg_error add_secret(const char *secret_id, const char *version_id,
+                           const char *version_stage,
+                           const char *secret_string)
+{
+    if (!secret_id || !secret_string) {
+        return GGE_INVALID_PARAMETER;
+    }
+    if (!version_stage) {
+        version_stage = SIM_DEFAULT_STAGE;
+    }
+
+    char generated[40];
+    if (!version_id) {
+        snprintf(generated, sizeof(generated), "00000000-0000-0000-0000-%012llu",
+                ++sim_next_version_id);
+        version_id = generated;
+    }
+
+    sim_secret *secret = find_secret(secret_id, version_id, NULL);
+    if (!secret) {
+        if (!(secret = calloc(1, sizeof(sim_secret)))) {
+            return GGE_OUT_OF_MEMORY;
+        }
+        if (!(secret->secret_id = copy_string(secret_id))
+                || !(secret->version_id = copy_string(version_id))) {
+            free(secret->secret_id);
+            free(secret);
+            return GGE_OUT_OF_MEMORY;
+        }
+        secret->next = sim_secrets;
+        sim_secrets = secret;
+    }
+    char *stage = copy_string(version_stage);
+    char *string = copy_string(secret_string);
+    if (!stage || !string) {
+        free(stage);
+        free(string);
+        return GGE_OUT_OF_MEMORY;
+    }
+
+    /* a stage is attached to one version, the version it moves from becomes the previous one */
+    sim_secret *staged = find_secret(secret_id, NULL, version_stage);
+    if (staged && staged != secret) {
+        free(staged->version_stage);
+        staged->version_stage = strcmp(version_stage, SIM_DEFAULT_STAGE) == 0
+            ? copy_string(SIM_PREVIOUS_STAGE)
+            : NULL;
+    }
+
+    free(secret->version_stage);
+    free(secret->secret_string);
+    secret->version_stage = stage;
+    secret->secret_string = string;
+    secret->created = time(NULL);
+    return GGE_SUCCESS;
+}
+
+gg_error gg_sim_set_secret(const char *secret_id, const char *version_id,
+                           const char *version_stage,
+                           const char *secret_string)
+{
+    pthread_mutex_lock(&sim_lock);
+    gg_error err = add_secret(secret_id, version_id, version_stage, secret_string);
+    pthread_mutex_unlock(&sim_lock);
+    return err;
+}
+
+/** Replaces or removes a shadow, called with the lock held */
+static gg_error replace_shadow(const char *thing_name, const char *document)
+{
+    if (!thing_name) {
+        return GGE_INVALID_PARAMETER;
+    }
+    if (!document) {
+        remove_shadow(thing_name);
+        return GGE_SUCCESS;
+    }
+
+    sj_value *parsed = sj_parse(document, strlen(document));
+    sj_value *state = sj_get(parsed, "state");
+    if (!state || state->type != SJ_OBJECT) {
+        sj_free(parsed);
+        return GGE_INVALID_PARAMETER;
+    }
+    sim_shadow *shadow = find_shadow(thing_name);
+    if (!shadow && !(shadow = add_shadow(thing_name))) {
+        sj_free(parsed);
+        return GGE_OUT_OF_MEMORY;
+    }
+    sj_value *copy = sj_clone(state);
+    sj_free(parsed);
+    if (!copy) {
+        return GGE_OUT_OF_MEMORY;
+    }
+    free(copy->key);
+    copy->key = NULL;
+    sj_free(shadow->state);
+    shadow->state = copy;
+    shadow->version++;
+    return GGE_SUCCESS;
+}
+
+gg_error gg_sim_set_shadow(const char *thing_name, const char *document)
+{
+    pthread_mutex_lock(&sim_lock);
+    gg_error err = replace_shadow(thing_name, document);
+    pthread_mutex_unlock(&sim_lock);
+    return err;
+}
+
+/** Replaces or removes an invoke response, called with the lock held */
+static gg_error replace_invoke_response(const char *function_arn,
+                                        const void *response,
+                                        size_t response_size)
+{
+    if (!function_arn || (!response && response_size)) {
+        return GGE_INVALID_PARAMETER;
+    }
+    for (sim_invoke_response **link = &sim_invoke_responses; *link;
+            link = &(*link)->next) {
+        if (strcmp((*link)->function_arn, function_arn) == 0) {
+            sim_invoke_response *configured = *link;
+            *link = configured->next;
+            free(configured->function_arn);
+            free(configured->response);
+            free(configured);
+            break;
+        }
+    }
+    if (!response) {
+        return GGE_SUCCESS;
+    }
+
+    sim_invoke_response *configured = calloc(1, sizeof(sim_invoke_response));
+    if (!configured) {
+        return GGE_OUT_OF_MEMORY;
+    }
+    configured->function_arn = copy_string(function_arn);
+    configured->response = malloc(response_size ? response_size : 1);
+    if (!configured->function_arn || !configured->response) {
+        free(configured->function_arn);
+        free(configured->response);
+        free(configured);
+        return GGE_OUT_OF_MEMORY;
+    }
+    memcpy(configured->response, response, response_size);
+    configured->response_size = response_size;
+    configured->next = sim_invoke_responses;
+    sim_invoke_responses = configured;
+    return GGE_SUCCESS;
+}
+
+gg_error gg_sim_set_invoke_response(const char *function_arn,
+                                    const void *response,
+                                    size_t response_size)
+{
+    pthread_mutex_lock(&sim_lock);
+    gg_error err = replace_invoke_response(function_arn, response, response_size);
+    pthread_mutex_unlock(&sim_lock);
+    return err;
+}
+
+void gg_sim_get_stats(gg_sim_stats *stats)
+{
+    if (!stats) {
+        return;
+    }
+    pthread_mutex_lock(&sim_lock);
+    *stats = sim_stats;
+    pthread_mutex_unlock(&sim_lock);
+    pthread_mutex_lock(&sim_requests_lock);
+    stats->requests = sim_requests_opened;
+    stats->open_requests = sim_requests_open;
+    stats->invalid_requests = sim_requests_invalid;
+    pthread_mutex_unlock(&sim_requests_lock);
+}
+
+gg_error gg_sim_start_events(void)
+{
+    pthread_mutex_lock(&sim_lock);
+    gg_lambda_handler handler = sim_handler;
+    pthread_mutex_unlock(&sim_lock);
+    if (!handler) {
+        return GGE_INVALID_STATE;
+    }
+    return sim_events_start(handler, 1);
+}
+
+gg_error gg_sim_wait_events(void)
+{
+    return sim_events_wait();
+}
+
+void gg_sim_stop_events(void)
+{
+    sim_events_stop();
+}
+
+void gg_sim_get_event_stats(gg_sim_event_stats *stats)
+{
+    if (stats) {
+        sim_events_get_stats(stats);
+    }
+}
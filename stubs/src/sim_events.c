@@ -0,0 +1,571 @@
+/*
+ * Copyright 2020-present, Nike, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the Apache-2.0 license found in
+ * the LICENSE file in the root of this source tree.
+ */
+
+#include "sim_events.h"
+#include "sim_faults.h"
+#include "sim_histogram.h"
+#include "sim_json.h"
+#include "sim_random.h"
+
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define SIM_KEY_PREFIX "GG_SIM_EVENTS_"
+#define SIM_DEFAULT_TOPIC "gg-sim/events"
+#define SIM_MAX_PAYLOAD_SIZE (16 * 1024 * 1024)
+/** Long sleeps are broken up so that stopping doesn't wait for them */
+#define SIM_MAX_SLEEP_NS 100000000ULL
+/** Mixed into GG_SIM_SEED so events don't draw the same numbers as the faults */
+#define SIM_EVENTS_SEED_MIX 0x5EED0E7E47ULL
+
+typedef struct sim_list {
+    char **items;
+    size_t len;
+} sim_list;
+
+/**
+ * Guards the settings and the generator state. The settings can't be changed
+ * while events are generated, so the generator reads them without the lock.
+ */
+static pthread_mutex_t generator_lock = PTHREAD_MUTEX_INITIALIZER;
+/** Signalled when events stop being generated */
+static pthread_cond_t generator_done = PTHREAD_COND_INITIALIZER;
+
+static uint64_t event_count;
+static uint64_t event_duration_ns;
+static double event_rate;
+static uint64_t event_burst = 1;
+static int event_poisson;
+static sim_dist payload_sizes = { SIM_DIST_CONSTANT, 256, 0 };
+static sim_list topics;
+static sim_list function_arns;
+static int report;
+
+/** Whether events are being generated, on the generator thread or the thread that started them */
+static int generating;
+static pthread_t generating_thread;
+static pthread_t generator;
+/** Whether the generator thread was started and no one has joined it yet */
+static int generator_joinable;
+static atomic_int stopping;
+
+/** Guards the stats, which are read while the generator records them */
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t events;
+static uint64_t payload_bytes;
+static uint64_t started_ns;
+static uint64_t finished_ns;
+static sim_histogram handler_latency;
+static sim_histogram lag;
+
+/** What the generator thread was started with */
+typedef struct sim_generator_args {
+    gg_lambda_handler handler;
+} sim_generator_args;
+
+static sim_generator_args generator_args;
+
+static uint64_t now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+static char *base64_encode(const char *data, size_t len)
+{
+    static const char alphabet[] =
+            "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    char *encoded = malloc(4 * ((len + 2) / 3) + 1);
+    if (!encoded) {
+        return NULL;
+    }
+    char *out = encoded;
+    for (size_t i = 0; i < len; i += 3) {
+        uint32_t group = (uint32_t)(unsigned char)data[i] << 16;
+        if (i + 1 < len) {
+            group |= (uint32_t)(unsigned char)data[i + 1] << 8;
+        }
+        if (i + 2 < len) {
+            group |= (unsigned char)data[i + 2];
+        }
+        *out++ = alphabet[(group >> 18) & 0x3F];
+        *out++ = alphabet[(group >> 12) & 0x3F];
+        *out++ = i + 1 < len ? alphabet[(group >> 6) & 0x3F] : '=';
+        *out++ = i + 2 < len ? alphabet[group & 0x3F] : '=';
+    }
+    *out = '\0';
+    return encoded;
+}
+
+char *sim_subject_context(const char *topic)
+{
+    /* greengrass puts the subject of a subscription in the client context */
+    sj_buffer context = { 0 };
+    char *encoded = NULL;
+    if (sj_buffer_append_str(&context, "{\"custom\":{\"subject\":")
+            && sj_buffer_append_quoted(&context, topic)
+            && sj_buffer_append_str(&context, "}}")) {
+        encoded = base64_encode(context.data, context.len);
+    }
+    sj_buffer_free(&context);
+    return encoded;
+}
+
+/***************************************
+**            Settings                **
+***************************************/
+
+static void list_free(sim_list *list)
+{
+    for (size_t i = 0; i < list->len; i++) {
+        free(list->items[i]);
+    }
+    free(list->items);
+    list->items = NULL;
+    list->len = 0;
+}
+
+/** Splits a comma separated list, skipping empty items */
+static int list_parse(const char *text, sim_list *list)
+{
+    sim_list parsed = { NULL, 0 };
+    const char *start = text;
+    while (1) {
+        const char *end = strchr(start, ',');
+        size_t len = end ? (size_t)(end - start) : strlen(start);
+        if (len > 0) {
+            char **items = realloc(parsed.items, (parsed.len + 1) * sizeof(char *));
+            char *item = malloc(len + 1);
+            if (items) {
+                parsed.items = items;
+            }
+            if (!items || !item) {
+                free(item);
+                list_free(&parsed);
+                return 0;
+            }
+            memcpy(item, start, len);
+            item[len] = '\0';
+            parsed.items[parsed.len++] = item;
+        }
+        if (!end) {
+            break;
+        }
+        start = end + 1;
+    }
+    list_free(list);
+    *list = parsed;
+    return 1;
+}
+
+static int parse_uint(const char *text, uint64_t *value)
+{
+    char *end = NULL;
+    errno = 0;
+    unsigned long long parsed = strtoull(text, &end, 10);
+    if (errno || end == text || *end != '\0' || *text == '-') {
+        return 0;
+    }
+    *value = parsed;
+    return 1;
+}
+
+/** Parses a size in bytes, with an optional k or m suffix */
+static int parse_size(const char *text, double *bytes)
+{
+    char *end = NULL;
+    errno = 0;
+    double value = strtod(text, &end);
+    if (errno || end == text || value < 0) {
+        return 0;
+    }
+    if (*end == 'k' || *end == 'K') {
+        value *= 1024;
+        end++;
+    } else if (*end == 'm' || *end == 'M') {
+        value *= 1024 * 1024;
+        end++;
+    }
+    if (*end != '\0' || value > SIM_MAX_PAYLOAD_SIZE) {
+        return 0;
+    }
+    *bytes = value;
+    return 1;
+}
+
+gg_error sim_events_configure(const char *key, const char *value)
+{
+    if (!key || !value) {
+        return GGE_INVALID_PARAMETER;
+    }
+    pthread_mutex_lock(&generator_lock);
+    if (generating) {
+        pthread_mutex_unlock(&generator_lock);
+        return GGE_INVALID_STATE;
+    }
+
+    int ok = 0;
+    if (strcmp(key, SIM_KEY_PREFIX "COUNT") == 0) {
+        ok = parse_uint(value, &event_count);
+    } else if (strcmp(key, SIM_KEY_PREFIX "DURATION") == 0) {
+        double micros;
+        if ((ok = sim_parse_duration(value, &micros))) {
+            event_duration_ns = (uint64_t)(micros * 1000.0);
+        }
+    } else if (strcmp(key, SIM_KEY_PREFIX "RATE") == 0) {
+        char *end = NULL;
+        errno = 0;
+        double rate = strtod(value, &end);
+        if ((ok = !errno && end != value && *end == '\0' && rate >= 0)) {
+            event_rate = rate;
+        }
+    } else if (strcmp(key, SIM_KEY_PREFIX "BURST") == 0) {
+        uint64_t burst;
+        if ((ok = parse_uint(value, &burst) && burst > 0)) {
+            event_burst = burst;
+        }
+    } else if (strcmp(key, SIM_KEY_PREFIX "ARRIVALS") == 0) {
+        if (strcmp(value, "uniform") == 0 || strcmp(value, "poisson") == 0) {
+            event_poisson = strcmp(value, "poisson") == 0;
+            ok = 1;
+        }
+    } else if (strcmp(key, SIM_KEY_PREFIX "PAYLOAD_SIZE") == 0) {
+        ok = sim_dist_parse(value, parse_size, &payload_sizes);
+    } else if (strcmp(key, SIM_KEY_PREFIX "TOPICS") == 0) {
+        ok = list_parse(value, &topics);
+    } else if (strcmp(key, SIM_KEY_PREFIX "FUNCTION_ARNS") == 0) {
+        ok = list_parse(value, &function_arns);
+    } else if (strcmp(key, SIM_KEY_PREFIX "REPORT") == 0) {
+        uint64_t enabled;
+        if ((ok = parse_uint(value, &enabled))) {
+            report = enabled != 0;
+        }
+    }
+    pthread_mutex_unlock(&generator_lock);
+    return ok ? GGE_SUCCESS : GGE_INVALID_PARAMETER;
+}
+
+gg_error sim_events_load_env(void)
+{
+    static const char *keys[] = {
+        SIM_KEY_PREFIX "COUNT",
+        SIM_KEY_PREFIX "DURATION",
+        SIM_KEY_PREFIX "RATE",
+        SIM_KEY_PREFIX "BURST",
+        SIM_KEY_PREFIX "ARRIVALS",
+        SIM_KEY_PREFIX "PAYLOAD_SIZE",
+        SIM_KEY_PREFIX "TOPICS",
+        SIM_KEY_PREFIX "FUNCTION_ARNS",
+        SIM_KEY_PREFIX "REPORT"
+    };
+    for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+        const char *value = getenv(keys[i]);
+        gg_error err = value ? sim_events_configure(keys[i], value) : GGE_SUCCESS;
+        if (err != GGE_SUCCESS) {
+            return err;
+        }
+    }
+    return GGE_SUCCESS;
+}
+
+int sim_events_enabled(void)
+{
+    pthread_mutex_lock(&generator_lock);
+    int enabled = event_count > 0 || event_duration_ns > 0 || event_rate > 0;
+    pthread_mutex_unlock(&generator_lock);
+    return enabled;
+}
+
+/***************************************
+**            Generator               **
+***************************************/
+
+/** Sleeps until the monotonic time, or until the generator is stopped */
+static void sleep_until(uint64_t deadline_ns)
+{
+    uint64_t now;
+    while (!atomic_load(&stopping) && (now = now_ns()) < deadline_ns) {
+        uint64_t remaining = deadline_ns - now;
+        if (remaining > SIM_MAX_SLEEP_NS) {
+            remaining = SIM_MAX_SLEEP_NS;
+        }
+        struct timespec delay = {
+            (time_t)(remaining / 1000000000ULL),
+            (long)(remaining % 1000000000ULL)
+        };
+        nanosleep(&delay, NULL);
+    }
+}
+
+/**
+ * Writes a payload of the size into the buffer, a JSON object with the
+ * sequence number padded out with x when it is big enough
+ */
+static void fill_payload(char *payload, size_t size, uint64_t seq)
+{
+    if (size == 0) {
+        return;
+    }
+    memset(payload, 'x', size);
+    char prefix[48];
+    int len = snprintf(prefix, sizeof(prefix), "{\"seq\":%llu,\"data\":\"",
+            (unsigned long long)seq);
+    if (size >= 32 && (size_t)len + 2 <= size) {
+        memcpy(payload, prefix, (size_t)len);
+        memcpy(payload + size - 2, "\"}", 2);
+    }
+}
+
+static void print_report(void)
+{
+    gg_sim_event_stats stats;
+    sim_events_get_stats(&stats);
+    double seconds = stats.elapsed_ns / 1e9;
+    fprintf(stderr,
+            "gg-sim events: %llu events, %llu bytes in %.3fs (%.0f/s) | "
+            "handler us p50 %.1f p90 %.1f p99 %.1f max %.1f | "
+            "lag us p50 %.1f p99 %.1f max %.1f\n",
+            (unsigned long long)stats.events,
+            (unsigned long long)stats.payload_bytes, seconds,
+            seconds > 0 ? stats.events / seconds : 0,
+            stats.handler_p50_ns / 1e3, stats.handler_p90_ns / 1e3,
+            stats.handler_p99_ns / 1e3, stats.handler_max_ns / 1e3,
+            stats.lag_p50_ns / 1e3, stats.lag_p99_ns / 1e3,
+            stats.lag_max_ns / 1e3);
+}
+
+/** Prepares the client context of each topic once, so that it isn't counted in the dispatch time */
+static char **prepare_contexts(size_t *count)
+{
+    static const char *default_topic = SIM_DEFAULT_TOPIC;
+    const char **names = topics.len ? (const char **)topics.items : &default_topic;
+    *count = topics.len ? topics.len : 1;
+    char **contexts = calloc(*count, sizeof(char *));
+    for (size_t i = 0; contexts && i < *count; i++) {
+        if (!(contexts[i] = sim_subject_context(names[i]))) {
+            while (i > 0) {
+                free(contexts[--i]);
+            }
+            free(contexts);
+            return NULL;
+        }
+    }
+    return contexts;
+}
+
+static gg_error generate_events(gg_lambda_handler handler)
+{
+    size_t context_count;
+    char **contexts = prepare_contexts(&context_count);
+    size_t payload_capacity = 0;
+    char *payload = NULL;
+    if (!contexts) {
+        return GGE_OUT_OF_MEMORY;
+    }
+
+    sim_rng rng;
+    sim_rng_seed(&rng, sim_faults_seed() ^ SIM_EVENTS_SEED_MIX);
+    gg_error err = GGE_SUCCESS;
+    uint64_t start = now_ns();
+    uint64_t scheduled = start;
+    uint64_t seq = 0;
+    pthread_mutex_lock(&stats_lock);
+    started_ns = start;
+    finished_ns = 0;
+    pthread_mutex_unlock(&stats_lock);
+
+    while (!atomic_load(&stopping)
+            && (event_count == 0 || seq < event_count)
+            && (event_duration_ns == 0 || now_ns() - start < event_duration_ns)) {
+        if (event_rate > 0) {
+            sleep_until(scheduled);
+        }
+        for (uint64_t i = 0; i < event_burst && !atomic_load(&stopping)
+                && (event_count == 0 || seq < event_count); i++) {
+            size_t size = (size_t)sim_dist_sample(&payload_sizes, &rng);
+            if (size > payload_capacity) {
+                char *grown = realloc(payload, size);
+                if (!grown) {
+                    err = GGE_OUT_OF_MEMORY;
+                    goto done;
+                }
+                payload = grown;
+                payload_capacity = size;
+            }
+            fill_payload(payload, size, seq);
+            gg_lambda_context context = {
+                function_arns.len
+                    ? function_arns.items[sim_rng_next(&rng) % function_arns.len]
+                    : SIM_FUNCTION_ARN,
+                contexts[sim_rng_next(&rng) % context_count]
+            };
+
+            uint64_t dispatched = now_ns();
+            gg_sim_set_handler_message(payload, size);
+            handler(&context);
+            uint64_t returned = now_ns();
+
+            pthread_mutex_lock(&stats_lock);
+            events++;
+            payload_bytes += size;
+            sim_histogram_record(&handler_latency, returned - dispatched);
+            sim_histogram_record(&lag, event_rate > 0 && dispatched > scheduled
+                    ? dispatched - scheduled
+                    : 0);
+            pthread_mutex_unlock(&stats_lock);
+            seq++;
+        }
+        if (event_rate > 0) {
+            double gap = event_burst / event_rate * 1e9;
+            if (event_poisson) {
+                gap *= -log(1.0 - sim_rng_uniform(&rng));
+            }
+            scheduled += (uint64_t)gap;
+        }
+    }
+
+done:
+    pthread_mutex_lock(&stats_lock);
+    finished_ns = now_ns();
+    pthread_mutex_unlock(&stats_lock);
+    for (size_t i = 0; i < context_count; i++) {
+        free(contexts[i]);
+    }
+    free(contexts);
+    free(payload);
+    if (report) {
+        print_report();
+    }
+    return err;
+}
+
+/** Generates the events, then lets the settings be changed and the generator be started again */
+static gg_error generate(gg_lambda_handler handler)
+{
+    gg_error err = generate_events(handler);
+    pthread_mutex_lock(&generator_lock);
+    generating = 0;
+    pthread_cond_broadcast(&generator_done);
+    pthread_mutex_unlock(&generator_lock);
+    return err;
+}
+
+static void *generator_main(void *arg)
+{
+    generate(((sim_generator_args *)arg)->handler);
+    return NULL;
+}
+
+/**
+ * Waits for events to stop being generated, with the lock held. The thread
+ * that claims the generator thread joins it, any others wait for it to finish.
+ * The handler itself doesn't wait, since it would be waiting for itself.
+ */
+static void wait_for_generator(void)
+{
+    if (generating && pthread_equal(generating_thread, pthread_self())) {
+        return;
+    }
+    if (generator_joinable) {
+        pthread_t thread = generator;
+        generator_joinable = 0;
+        pthread_mutex_unlock(&generator_lock);
+        pthread_join(thread, NULL);
+        pthread_mutex_lock(&generator_lock);
+    }
+    while (generating) {
+        pthread_cond_wait(&generator_done, &generator_lock);
+    }
+}
+
+gg_error sim_events_start(gg_lambda_handler handler, int async)
+{
+    pthread_mutex_lock(&generator_lock);
+    if (!generating) {
+        /* a generator thread that reached its count is joined before the next starts */
+        wait_for_generator();
+    }
+    if (generating) {
+        pthread_mutex_unlock(&generator_lock);
+        return GGE_INVALID_STATE;
+    }
+    atomic_store(&stopping, 0);
+    generating = 1;
+    if (!async) {
+        generating_thread = pthread_self();
+        pthread_mutex_unlock(&generator_lock);
+        return generate(handler);
+    }
+    generator_args.handler = handler;
+    if (pthread_create(&generator, NULL, generator_main, &generator_args) != 0) {
+        generating = 0;
+        pthread_mutex_unlock(&generator_lock);
+        return GGE_INTERNAL_FAILURE;
+    }
+    generating_thread = generator;
+    generator_joinable = 1;
+    pthread_mutex_unlock(&generator_lock);
+    return GGE_SUCCESS;
+}
+
+void sim_events_stop(void)
+{
+    pthread_mutex_lock(&generator_lock);
+    atomic_store(&stopping, 1);
+    wait_for_generator();
+    pthread_mutex_unlock(&generator_lock);
+}
+
+gg_error sim_events_wait(void)
+{
+    gg_error err = GGE_SUCCESS;
+    pthread_mutex_lock(&generator_lock);
+    if (generating && event_count == 0 && event_duration_ns == 0) {
+        err = GGE_INVALID_STATE;
+    } else {
+        wait_for_generator();
+    }
+    pthread_mutex_unlock(&generator_lock);
+    return err;
+}
+
+void sim_events_get_stats(gg_sim_event_stats *stats)
+{
+    pthread_mutex_lock(&stats_lock);
+    stats->events = events;
+    stats->payload_bytes = payload_bytes;
+    stats->elapsed_ns = started_ns == 0 ? 0
+        : (finished_ns ? finished_ns : now_ns()) - started_ns;
+    stats->handler_p50_ns = sim_histogram_percentile(&handler_latency, 50);
+    stats->handler_p90_ns = sim_histogram_percentile(&handler_latency, 90);
+    stats->handler_p99_ns = sim_histogram_percentile(&handler_latency, 99);
+    stats->handler_max_ns = handler_latency.max;
+    stats->lag_p50_ns = sim_histogram_percentile(&lag, 50);
+    stats->lag_p99_ns = sim_histogram_percentile(&lag, 99);
+    stats->lag_max_ns = lag.max;
+    pthread_mutex_unlock(&stats_lock);
+}
+
+void sim_events_reset_stats(void)
+{
+    pthread_mutex_lock(&stats_lock);
+    events = 0;
+    payload_bytes = 0;
+    started_ns = 0;
+    finished_ns = 0;
+    memset(&handler_latency, 0, sizeof(handler_latency));
+    memset(&lag, 0, sizeof(lag));
+    pthread_mutex_unlock(&stats_lock);
+}
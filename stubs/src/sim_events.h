@@ -0,0 +1,49 @@
+/*
+ * Copyright 2020-present, Nike, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the Apache-2.0 license found in
+ * the LICENSE file in the root of this source tree.
+ */
+
+/**
+ * The inbound event generator, which stands in for the events a core sends to
+ * the handler registered with gg_runtime_start.
+ */
+#ifndef _SIM_EVENTS_H_
+#define _SIM_EVENTS_H_
+
+#include "shared/greengrasssdk_sim.h"
+
+/** The function arn handlers are called with, unless events are generated for other functions */
+#define SIM_FUNCTION_ARN "arn:aws:lambda:us-west-2:123456789012:function:gg-sim:1"
+
+/** Sets one setting, see greengrasssdk_sim.h for the keys and values */
+gg_error sim_events_configure(const char *key, const char *value);
+
+/** Reads the settings from the environment */
+gg_error sim_events_load_env(void);
+
+/** Whether a count, duration or rate of events has been configured */
+int sim_events_enabled(void);
+
+/**
+ * Generates events for the handler until the count or duration is reached.
+ * When async they are generated on a new thread and this returns straight away.
+ */
+gg_error sim_events_start(gg_lambda_handler handler, int async);
+
+/** Stops generating events, waiting for the generator thread to exit */
+void sim_events_stop(void);
+
+/** Waits for the generator thread to reach its count or duration */
+gg_error sim_events_wait(void);
+
+void sim_events_get_stats(gg_sim_event_stats *stats);
+
+void sim_events_reset_stats(void);
+
+/** The base64 encoded client context greengrass sends with a message published to the topic */
+char *sim_subject_context(const char *topic);
+
+#endif /* #ifndef _SIM_EVENTS_H_ */
@@ -0,0 +1,260 @@
+/*
+ * Copyright 2020-present, Nike, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the Apache-2.0 license found in
+ * the LICENSE file in the root of this source tree.
+ */
+
+#include "sim_faults.h"
+#include "sim_random.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define SIM_KEY_PREFIX "GG_SIM_"
+#define SIM_DEFAULT_DRAIN_RATE 1000.0
+
+static const char *api_names[SIM_API_COUNT] = {
+    "PUBLISH",
+    "INVOKE",
+    "GET_SHADOW",
+    "UPDATE_SHADOW",
+    "DELETE_SHADOW",
+    "GET_SECRET"
+};
+
+/** Guards the settings, the generator and the queue. Never held while sleeping */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t seed;
+static sim_rng rng;
+/** Latencies in microseconds */
+static sim_dist latencies[SIM_API_COUNT];
+static double failure_rates[SIM_API_COUNT];
+
+/** A capacity of 0 leaves the queue unbounded */
+static size_t queue_capacity;
+static double queue_drain_rate = SIM_DEFAULT_DRAIN_RATE;
+static double queue_depth;
+static struct timespec queue_drained;
+
+/***************************************
+**            Settings                **
+***************************************/
+
+static int parse_rate(const char *text, double *rate)
+{
+    char *end = NULL;
+    errno = 0;
+    double value = strtod(text, &end);
+    if (errno || end == text || *end != '\0' || value < 0 || value > 1) {
+        return 0;
+    }
+    *rate = value;
+    return 1;
+}
+
+/** The API named by the key's suffix after the prefix, or SIM_API_COUNT for all of them */
+static int parse_api(const char *key, const char *prefix, sim_api *api)
+{
+    size_t len = strlen(prefix);
+    if (strncmp(key, prefix, len) != 0) {
+        return 0;
+    }
+    if (key[len] == '\0') {
+        *api = SIM_API_COUNT;
+        return 1;
+    }
+    if (key[len] != '_') {
+        return 0;
+    }
+    for (int i = 0; i < SIM_API_COUNT; i++) {
+        if (strcmp(key + len + 1, api_names[i]) == 0) {
+            *api = (sim_api)i;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/** Applies one setting, called with the lock held */
+static gg_error configure(const char *key, const char *value)
+{
+    if (!key || !value) {
+        return GGE_INVALID_PARAMETER;
+    }
+
+    sim_api api;
+    if (parse_api(key, SIM_KEY_PREFIX "LATENCY", &api)) {
+        sim_dist latency;
+        if (!sim_dist_parse(value, sim_parse_duration, &latency)) {
+            return GGE_INVALID_PARAMETER;
+        }
+        for (int i = 0; i < SIM_API_COUNT; i++) {
+            if (api == SIM_API_COUNT || api == (sim_api)i) {
+                latencies[i] = latency;
+            }
+        }
+        return GGE_SUCCESS;
+    }
+    if (parse_api(key, SIM_KEY_PREFIX "FAILURE_RATE", &api)) {
+        double rate;
+        if (!parse_rate(value, &rate)) {
+            return GGE_INVALID_PARAMETER;
+        }
+        for (int i = 0; i < SIM_API_COUNT; i++) {
+            if (api == SIM_API_COUNT || api == (sim_api)i) {
+                failure_rates[i] = rate;
+            }
+        }
+        return GGE_SUCCESS;
+    }
+
+    char *end = NULL;
+    errno = 0;
+    if (strcmp(key, SIM_KEY_PREFIX "SEED") == 0) {
+        unsigned long long parsed = strtoull(value, &end, 10);
+        if (errno || end == value || *end != '\0') {
+            return GGE_INVALID_PARAMETER;
+        }
+        seed = parsed;
+        sim_rng_seed(&rng, seed);
+        return GGE_SUCCESS;
+    }
+    if (strcmp(key, SIM_KEY_PREFIX "QUEUE_CAPACITY") == 0) {
+        unsigned long long parsed = strtoull(value, &end, 10);
+        if (errno || end == value || *end != '\0') {
+            return GGE_INVALID_PARAMETER;
+        }
+        queue_capacity = (size_t)parsed;
+        queue_depth = 0;
+        return GGE_SUCCESS;
+    }
+    if (strcmp(key, SIM_KEY_PREFIX "QUEUE_DRAIN_RATE") == 0) {
+        double parsed = strtod(value, &end);
+        if (errno || end == value || *end != '\0' || parsed < 0) {
+            return GGE_INVALID_PARAMETER;
+        }
+        queue_drain_rate = parsed;
+        return GGE_SUCCESS;
+    }
+    return GGE_INVALID_PARAMETER;
+}
+
+gg_error sim_faults_configure(const char *key, const char *value)
+{
+    pthread_mutex_lock(&lock);
+    gg_error err = configure(key, value);
+    pthread_mutex_unlock(&lock);
+    return err;
+}
+
+/** Applies the setting from the environment, if it is set */
+static gg_error configure_from_env(const char *key)
+{
+    const char *value = getenv(key);
+    return value ? sim_faults_configure(key, value) : GGE_SUCCESS;
+}
+
+gg_error sim_faults_load_env(void)
+{
+    gg_error err = GGE_SUCCESS;
+    /* the settings for every API are applied before those for a single API */
+    static const char *keys[] = {
+        SIM_KEY_PREFIX "SEED",
+        SIM_KEY_PREFIX "QUEUE_CAPACITY",
+        SIM_KEY_PREFIX "QUEUE_DRAIN_RATE",
+        SIM_KEY_PREFIX "LATENCY",
+        SIM_KEY_PREFIX "FAILURE_RATE"
+    };
+    for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+        if ((err = configure_from_env(keys[i])) != GGE_SUCCESS) {
+            return err;
+        }
+    }
+    for (int i = 0; i < SIM_API_COUNT; i++) {
+        char key[64];
+        snprintf(key, sizeof(key), SIM_KEY_PREFIX "LATENCY_%s", api_names[i]);
+        if ((err = configure_from_env(key)) != GGE_SUCCESS) {
+            return err;
+        }
+        snprintf(key, sizeof(key), SIM_KEY_PREFIX "FAILURE_RATE_%s", api_names[i]);
+        if ((err = configure_from_env(key)) != GGE_SUCCESS) {
+            return err;
+        }
+    }
+    return GGE_SUCCESS;
+}
+
+void sim_faults_reset(void)
+{
+    pthread_mutex_lock(&lock);
+    sim_rng_seed(&rng, seed);
+    queue_depth = 0;
+    pthread_mutex_unlock(&lock);
+}
+
+uint64_t sim_faults_seed(void)
+{
+    pthread_mutex_lock(&lock);
+    uint64_t value = seed;
+    pthread_mutex_unlock(&lock);
+    return value;
+}
+
+/***************************************
+**            Injection               **
+***************************************/
+
+gg_error sim_faults_enter(sim_api api)
+{
+    /* both draws are made up front, so callers sleep concurrently */
+    pthread_mutex_lock(&lock);
+    double micros = sim_dist_sample(&latencies[api], &rng);
+    int failed = failure_rates[api] > 0 && sim_rng_uniform(&rng) < failure_rates[api];
+    pthread_mutex_unlock(&lock);
+
+    if (micros > 0) {
+        struct timespec delay;
+        delay.tv_sec = (time_t)(micros / 1000000.0);
+        delay.tv_nsec = (long)((micros - delay.tv_sec * 1000000.0) * 1000.0);
+        while (nanosleep(&delay, &delay) != 0 && errno == EINTR) {
+        }
+    }
+    return failed ? GGE_INTERNAL_FAILURE : GGE_SUCCESS;
+}
+
+size_t sim_faults_enqueue(size_t targets, gg_queue_full_policy_options policy)
+{
+    pthread_mutex_lock(&lock);
+    if (queue_capacity == 0) {
+        pthread_mutex_unlock(&lock);
+        return targets;
+    }
+
+    /* the core drains the queue at a steady rate */
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double elapsed = (now.tv_sec - queue_drained.tv_sec)
+        + (now.tv_nsec - queue_drained.tv_nsec) / 1e9;
+    queue_drained = now;
+    queue_depth -= elapsed * queue_drain_rate;
+    if (queue_depth < 0) {
+        queue_depth = 0;
+    }
+
+    double space = (double)queue_capacity - queue_depth;
+    size_t free_slots = space > 0 ? (size_t)space : 0;
+    size_t accepted = targets < free_slots ? targets : free_slots;
+    if (policy == GG_QUEUE_FULL_POLICY_ALL_OR_ERROR && accepted < targets) {
+        accepted = 0;
+    }
+    queue_depth += (double)accepted;
+    pthread_mutex_unlock(&lock);
+    return accepted;
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright 2020-present, Nike, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the Apache-2.0 license found in
+ * the LICENSE file in the root of this source tree.
+ */
+
+/**
+ * Fault injection for the simulator: latency drawn from a distribution for
+ * each API, a bounded delivery queue, and random internal failures.
+ *
+ * Every random draw comes from a single generator seeded with GG_SIM_SEED,
+ * so the same sequence of calls sees the same faults on every run. The
+ * functions are safe to call from many threads.
+ */
+#ifndef _SIM_FAULTS_H_
+#define _SIM_FAULTS_H_
+
+#include "shared/greengrasssdk.h"
+
+#include <stdint.h>
+
+typedef enum sim_api {
+    SIM_API_PUBLISH,
+    SIM_API_INVOKE,
+    SIM_API_GET_SHADOW,
+    SIM_API_UPDATE_SHADOW,
+    SIM_API_DELETE_SHADOW,
+    SIM_API_GET_SECRET,
+
+    SIM_API_COUNT
+} sim_api;
+
+/** Sets one setting, see greengrasssdk_sim.h for the keys and values */
+gg_error sim_faults_configure(const char *key, const char *value);
+
+/** Reads the settings from the environment */
+gg_error sim_faults_load_env(void);
+
+/** Reseeds the generator and empties the queue, keeping the settings */
+void sim_faults_reset(void);
+
+/** The GG_SIM_SEED setting */
+uint64_t sim_faults_seed(void);
+
+/** Sleeps for the latency of the API and decides whether the call fails */
+gg_error sim_faults_enter(sim_api api);
+
+/**
+ * Queues a message for the number of targets, returning how many were
+ * accepted. Under GG_QUEUE_FULL_POLICY_ALL_OR_ERROR that is all or none.
+ */
+size_t sim_faults_enqueue(size_t targets, gg_queue_full_policy_options policy);
+
+#endif /* #ifndef _SIM_FAULTS_H_ */
@@ -0,0 +1,87 @@
+/*
+ * Copyright 2020-present, Nike, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the Apache-2.0 license found in
+ * the LICENSE file in the root of this source tree.
+ */
+
+#include "sim_histogram.h"
+
+/** The position of the highest set bit, value must not be 0 */
+static int highest_bit(uint64_t value)
+{
+    int bit = 0;
+    while (value >>= 1) {
+        bit++;
+    }
+    return bit;
+}
+
+static int bucket_index(uint64_t value)
+{
+    if (value < SIM_HISTOGRAM_LINEAR) {
+        return (int)value;
+    }
+    /* the top 5 bits pick the bucket within the value's power of two */
+    int shift = highest_bit(value) - 4;
+    int sub_bucket = (int)(value >> shift) - SIM_HISTOGRAM_SUB_BUCKETS;
+    return SIM_HISTOGRAM_LINEAR + (shift - 1) * SIM_HISTOGRAM_SUB_BUCKETS + sub_bucket;
+}
+
+/** The middle of the values counted in the bucket */
+static uint64_t bucket_value(int index)
+{
+    if (index < SIM_HISTOGRAM_LINEAR) {
+        return (uint64_t)index;
+    }
+    int shift = (index - SIM_HISTOGRAM_LINEAR) / SIM_HISTOGRAM_SUB_BUCKETS + 1;
+    int sub_bucket = (index - SIM_HISTOGRAM_LINEAR) % SIM_HISTOGRAM_SUB_BUCKETS;
+    uint64_t lowest = (uint64_t)(SIM_HISTOGRAM_SUB_BUCKETS + sub_bucket) << shift;
+    return lowest + (((uint64_t)1 << shift) >> 1);
+}
+
+void sim_histogram_record(sim_histogram *histogram, uint64_t value)
+{
+    histogram->counts[bucket_index(value)]++;
+    if (histogram->count == 0 || value < histogram->min) {
+        histogram->min = value;
+    }
+    if (value > histogram->max) {
+        histogram->max = value;
+    }
+    histogram->count++;
+    histogram->sum += (double)value;
+}
+
+uint64_t sim_histogram_percentile(const sim_histogram *histogram, double percentile)
+{
+    if (histogram->count == 0) {
+        return 0;
+    }
+    uint64_t rank = (uint64_t)(percentile / 100.0 * (double)histogram->count + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+    if (rank >= histogram->count) {
+        return histogram->max;
+    }
+    uint64_t seen = 0;
+    for (int i = 0; i < SIM_HISTOGRAM_BUCKETS; i++) {
+        seen += histogram->counts[i];
+        if (seen >= rank) {
+            uint64_t value = bucket_value(i);
+            /* the bucket's middle can fall outside what was actually recorded */
+            if (value < histogram->min) {
+                return histogram->min;
+            }
+            return value > histogram->max ? histogram->max : value;
+        }
+    }
+    return histogram->max;
+}
+
+double sim_histogram_mean(const sim_histogram *histogram)
+{
+    return histogram->count ? histogram->sum / (double)histogram->count : 0;
+}
@@ -0,0 +1,40 @@
+/*
+ * Copyright 2020-present, Nike, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the Apache-2.0 license found in
+ * the LICENSE file in the root of this source tree.
+ */
+
+/**
+ * A fixed size log-linear histogram of latencies, for reporting percentiles
+ * without keeping every sample. Values are bucketed with a relative error of
+ * at most 1/16.
+ */
+#ifndef _SIM_HISTOGRAM_H_
+#define _SIM_HISTOGRAM_H_
+
+#include <stdint.h>
+
+/** Values below this are counted exactly */
+#define SIM_HISTOGRAM_LINEAR 32
+/** Buckets per power of two above the linear range */
+#define SIM_HISTOGRAM_SUB_BUCKETS 16
+#define SIM_HISTOGRAM_BUCKETS (SIM_HISTOGRAM_LINEAR + 60 * SIM_HISTOGRAM_SUB_BUCKETS)
+
+typedef struct sim_histogram {
+    uint64_t counts[SIM_HISTOGRAM_BUCKETS];
+    uint64_t count;
+    uint64_t min;
+    uint64_t max;
+    double sum;
+} sim_histogram;
+
+void sim_histogram_record(sim_histogram *histogram, uint64_t value);
+
+/** The value at the percentile, from 0 to 100, or 0 when nothing was recorded */
+uint64_t sim_histogram_percentile(const sim_histogram *histogram, double percentile);
+
+double sim_histogram_mean(const sim_histogram *histogram);
+
+#endif /* #ifndef _SIM_HISTOGRAM_H_ */
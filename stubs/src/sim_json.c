@@ -0,0 +1,521 @@
+/*
+ * Copyright 2020-present, Nike, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the Apache-2.0 license found in
+ * the LICENSE file in the root of this source tree.
+ */
+
+#include "sim_json.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Nesting deeper than this is rejected rather than risking the stack */
+#define SJ_MAX_DEPTH 64
+
+typedef struct sj_parser {
+    const char *text;
+    size_t len;
+    size_t pos;
+} sj_parser;
+
+static sj_value *parse_value(sj_parser *parser, int depth);
+
+static char *copy_range(const char *start, size_t len)
+{
+    char *copy = malloc(len + 1);
+    if (copy) {
+        memcpy(copy, start, len);
+        copy[len] = '\0';
+    }
+    return copy;
+}
+
+static void skip_whitespace(sj_parser *parser)
+{
+    while (parser->pos < parser->len) {
+        char c = parser->text[parser->pos];
+        if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+            return;
+        }
+        parser->pos++;
+    }
+}
+
+static int consume(sj_parser *parser, char expected)
+{
+    skip_whitespace(parser);
+    if (parser->pos < parser->len && parser->text[parser->pos] == expected) {
+        parser->pos++;
+        return 1;
+    }
+    return 0;
+}
+
+static int consume_literal(sj_parser *parser, const char *literal)
+{
+    size_t len = strlen(literal);
+    if (parser->len - parser->pos >= len
+            && memcmp(parser->text + parser->pos, literal, len) == 0) {
+        parser->pos += len;
+        return 1;
+    }
+    return 0;
+}
+
+/** Parses a string, returning its escaped contents */
+static char *parse_string(sj_parser *parser)
+{
+    if (!consume(parser, '"')) {
+        return NULL;
+    }
+    size_t start = parser->pos;
+    while (parser->pos < parser->len) {
+        char c = parser->text[parser->pos];
+        if (c == '"') {
+            char *contents = copy_range(parser->text + start, parser->pos - start);
+            parser->pos++;
+            return contents;
+        }
+        if ((unsigned char)c < 0x20) {
+            return NULL;
+        }
+        /* skip the escaped character, the escape itself is kept as is */
+        parser->pos += c == '\\' ? 2 : 1;
+    }
+    return NULL;
+}
+
+static char *parse_number(sj_parser *parser)
+{
+    size_t start = parser->pos;
+    while (parser->pos < parser->len
+            && strchr("+-0123456789.eE", parser->text[parser->pos])) {
+        parser->pos++;
+    }
+    if (parser->pos == start) {
+        return NULL;
+    }
+    return copy_range(parser->text + start, parser->pos - start);
+}
+
+/** Parses the members or elements up to the closing character into the container */
+static int parse_children(sj_parser *parser, sj_value *container, char close, int depth)
+{
+    sj_value **tail = &container->children;
+    if (consume(parser, close)) {
+        return 1;
+    }
+    do {
+        char *key = NULL;
+        if (container->type == SJ_OBJECT) {
+            skip_whitespace(parser);
+            key = parse_string(parser);
+            if (!key || !consume(parser, ':')) {
+                free(key);
+                return 0;
+            }
+        }
+        sj_value *child = parse_value(parser, depth + 1);
+        if (!child) {
+            free(key);
+            return 0;
+        }
+        child->key = key;
+        *tail = child;
+        tail = &child->next;
+    } while (consume(parser, ','));
+    return consume(parser, close);
+}
+
+static sj_value *parse_value(sj_parser *parser, int depth)
+{
+    if (depth > SJ_MAX_DEPTH) {
+        return NULL;
+    }
+    skip_whitespace(parser);
+    if (parser->pos >= parser->len) {
+        return NULL;
+    }
+
+    sj_value *value = NULL;
+    char c = parser->text[parser->pos];
+    if (c == '{' || c == '[') {
+        parser->pos++;
+        value = sj_new(c == '{' ? SJ_OBJECT : SJ_ARRAY);
+        if (value && !parse_children(parser, value, c == '{' ? '}' : ']', depth)) {
+            sj_free(value);
+            value = NULL;
+        }
+    } else if (c == '"') {
+        char *text = parse_string(parser);
+        if (text && (value = sj_new(SJ_STRING))) {
+            value->text = text;
+        } else {
+            free(text);
+        }
+    } else if (consume_literal(parser, "null")) {
+        value = sj_new(SJ_NULL);
+    } else if (consume_literal(parser, "true")) {
+        value = sj_new(SJ_TRUE);
+    } else if (consume_literal(parser, "false")) {
+        value = sj_new(SJ_FALSE);
+    } else {
+        char *text = parse_number(parser);
+        if (text && (value = sj_new(SJ_NUMBER))) {
+            value->text = text;
+        } else {
+            free(text);
+        }
+    }
+    return value;
+}
+
+sj_value *sj_parse(const char *text, size_t len)
+{
+    sj_parser parser = { text, len, 0 };
+    sj_value *value = parse_value(&parser, 0);
+    skip_whitespace(&parser);
+    if (value && parser.pos != parser.len) {
+        sj_free(value);
+        return NULL;
+    }
+    return value;
+}
+
+sj_value *sj_new(sj_type type)
+{
+    sj_value *value = calloc(1, sizeof(sj_value));
+    if (value) {
+        value->type = type;
+    }
+    return value;
+}
+
+sj_value *sj_new_uint(unsigned long long number)
+{
+    char text[32];
+    snprintf(text, sizeof(text), "%llu", number);
+    sj_value *value = sj_new(SJ_NUMBER);
+    if (value && !(value->text = copy_range(text, strlen(text)))) {
+        sj_free(value);
+        return NULL;
+    }
+    return value;
+}
+
+/** Frees the value's contents, leaving its key and siblings alone */
+static void free_contents(sj_value *value)
+{
+    sj_value *child = value->children;
+    while (child) {
+        sj_value *next = child->next;
+        child->next = NULL;
+        sj_free(child);
+        child = next;
+    }
+    free(value->text);
+    value->text = NULL;
+    value->children = NULL;
+}
+
+void sj_free(sj_value *value)
+{
+    while (value) {
+        sj_value *next = value->next;
+        free_contents(value);
+        free(value->key);
+        free(value);
+        value = next;
+    }
+}
+
+sj_value *sj_clone(const sj_value *value)
+{
+    sj_value *clone = sj_new(value->type);
+    if (!clone) {
+        return NULL;
+    }
+    if (value->text && !(clone->text = copy_range(value->text, strlen(value->text)))) {
+        goto fail;
+    }
+    if (value->key && !(clone->key = copy_range(value->key, strlen(value->key)))) {
+        goto fail;
+    }
+    sj_value **tail = &clone->children;
+    for (const sj_value *child = value->children; child; child = child->next) {
+        if (!(*tail = sj_clone(child))) {
+            goto fail;
+        }
+        tail = &(*tail)->next;
+    }
+    return clone;
+
+fail:
+    sj_free(clone);
+    return NULL;
+}
+
+sj_value *sj_get(const sj_value *object, const char *key)
+{
+    if (!object || object->type != SJ_OBJECT) {
+        return NULL;
+    }
+    for (sj_value *member = object->children; member; member = member->next) {
+        if (strcmp(member->key, key) == 0) {
+            return member;
+        }
+    }
+    return NULL;
+}
+
+/** Unlinks the member with the key from the object and frees it */
+static void remove_member(sj_value *object, const char *key)
+{
+    for (sj_value **link = &object->children; *link; link = &(*link)->next) {
+        if (strcmp((*link)->key, key) == 0) {
+            sj_value *member = *link;
+            *link = member->next;
+            member->next = NULL;
+            sj_free(member);
+            return;
+        }
+    }
+}
+
+void sj_set(sj_value *object, const char *key, sj_value *value)
+{
+    remove_member(object, key);
+    free(value->key);
+    value->key = copy_range(key, strlen(key));
+    sj_value **tail = &object->children;
+    while (*tail) {
+        tail = &(*tail)->next;
+    }
+    *tail = value;
+}
+
+int sj_merge(sj_value *target, const sj_value *patch)
+{
+    if (patch->type != SJ_OBJECT) {
+        sj_value *clone = sj_clone(patch);
+        if (!clone) {
+            return 0;
+        }
+        free_contents(target);
+        target->type = clone->type;
+        target->text = clone->text;
+        target->children = clone->children;
+        clone->text = NULL;
+        clone->children = NULL;
+        sj_free(clone);
+        return 1;
+    }
+
+    if (target->type != SJ_OBJECT) {
+        free_contents(target);
+        target->type = SJ_OBJECT;
+    }
+    for (const sj_value *member = patch->children; member; member = member->next) {
+        if (member->type == SJ_NULL) {
+            remove_member(target, member->key);
+            continue;
+        }
+        sj_value *existing = sj_get(target, member->key);
+        if (!existing) {
+            /* merged into an empty object so that nested nulls are dropped */
+            if (!(existing = sj_new(SJ_OBJECT))) {
+                return 0;
+            }
+            sj_set(target, member->key, existing);
+            if (!existing->key) {
+                return 0;
+            }
+        }
+        if (!sj_merge(existing, member)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static size_t count_children(const sj_value *value)
+{
+    size_t count = 0;
+    for (const sj_value *child = value->children; child; child = child->next) {
+        count++;
+    }
+    return count;
+}
+
+/** Compares the values, with the members of objects in any order */
+static int equal(const sj_value *a, const sj_value *b)
+{
+    if (a->type != b->type) {
+        return 0;
+    }
+    switch (a->type) {
+    case SJ_NUMBER:
+    case SJ_STRING:
+        return strcmp(a->text, b->text) == 0;
+    case SJ_ARRAY: {
+        const sj_value *x = a->children;
+        const sj_value *y = b->children;
+        for (; x && y; x = x->next, y = y->next) {
+            if (!equal(x, y)) {
+                return 0;
+            }
+        }
+        return !x && !y;
+    }
+    case SJ_OBJECT:
+        if (count_children(a) != count_children(b)) {
+            return 0;
+        }
+        for (const sj_value *member = a->children; member; member = member->next) {
+            const sj_value *other = sj_get(b, member->key);
+            if (!other || !equal(member, other)) {
+                return 0;
+            }
+        }
+        return 1;
+    default:
+        return 1;
+    }
+}
+
+sj_value *sj_delta(const sj_value *desired, const sj_value *reported)
+{
+    sj_value *delta = sj_new(SJ_OBJECT);
+    if (!delta || !desired || desired->type != SJ_OBJECT) {
+        return delta;
+    }
+    for (const sj_value *member = desired->children; member; member = member->next) {
+        const sj_value *current = sj_get(reported, member->key);
+        sj_value *difference;
+        if (member->type == SJ_OBJECT && current && current->type == SJ_OBJECT) {
+            if (!(difference = sj_delta(member, current))) {
+                goto fail;
+            }
+            if (!difference->children) {
+                sj_free(difference);
+                continue;
+            }
+        } else if (current && equal(member, current)) {
+            continue;
+        } else if (!(difference = sj_clone(member))) {
+            goto fail;
+        }
+        sj_set(delta, member->key, difference);
+        if (!difference->key) {
+            goto fail;
+        }
+    }
+    return delta;
+
+fail:
+    sj_free(delta);
+    return NULL;
+}
+
+int sj_buffer_append(sj_buffer *buffer, const char *data, size_t len)
+{
+    if (buffer->len + len + 1 > buffer->cap) {
+        size_t cap = buffer->cap ? buffer->cap : 256;
+        while (cap < buffer->len + len + 1) {
+            cap *= 2;
+        }
+        char *data_grown = realloc(buffer->data, cap);
+        if (!data_grown) {
+            return 0;
+        }
+        buffer->data = data_grown;
+        buffer->cap = cap;
+    }
+    memcpy(buffer->data + buffer->len, data, len);
+    buffer->len += len;
+    buffer->data[buffer->len] = '\0';
+    return 1;
+}
+
+int sj_buffer_append_str(sj_buffer *buffer, const char *str)
+{
+    return sj_buffer_append(buffer, str, strlen(str));
+}
+
+int sj_buffer_append_escaped(sj_buffer *buffer, const char *str)
+{
+    for (const char *c = str; *c; c++) {
+        char escaped[8];
+        switch (*c) {
+        case '"': strcpy(escaped, "\\\""); break;
+        case '\\': strcpy(escaped, "\\\\"); break;
+        case '\n': strcpy(escaped, "\\n"); break;
+        case '\r': strcpy(escaped, "\\r"); break;
+        case '\t': strcpy(escaped, "\\t"); break;
+        default:
+            if ((unsigned char)*c < 0x20) {
+                snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned char)*c);
+            } else {
+                escaped[0] = *c;
+                escaped[1] = '\0';
+            }
+        }
+        if (!sj_buffer_append_str(buffer, escaped)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int sj_buffer_append_quoted(sj_buffer *buffer, const char *str)
+{
+    return sj_buffer_append(buffer, "\"", 1)
+        && sj_buffer_append_escaped(buffer, str)
+        && sj_buffer_append(buffer, "\"", 1);
+}
+
+int sj_write(sj_buffer *buffer, const sj_value *value)
+{
+    switch (value->type) {
+    case SJ_NULL: return sj_buffer_append_str(buffer, "null");
+    case SJ_TRUE: return sj_buffer_append_str(buffer, "true");
+    case SJ_FALSE: return sj_buffer_append_str(buffer, "false");
+    case SJ_NUMBER: return sj_buffer_append_str(buffer, value->text);
+    case SJ_STRING:
+        return sj_buffer_append(buffer, "\"", 1)
+            && sj_buffer_append_str(buffer, value->text)
+            && sj_buffer_append(buffer, "\"", 1);
+    case SJ_ARRAY:
+    case SJ_OBJECT:
+        if (!sj_buffer_append(buffer, value->type == SJ_OBJECT ? "{" : "[", 1)) {
+            return 0;
+        }
+        for (const sj_value *child = value->children; child; child = child->next) {
+            if (child != value->children && !sj_buffer_append(buffer, ",", 1)) {
+                return 0;
+            }
+            if (value->type == SJ_OBJECT
+                    && !(sj_buffer_append(buffer, "\"", 1)
+                        && sj_buffer_append_str(buffer, child->key)
+                        && sj_buffer_append(buffer, "\":", 2))) {
+                return 0;
+            }
+            if (!sj_write(buffer, child)) {
+                return 0;
+            }
+        }
+        return sj_buffer_append(buffer, value->type == SJ_OBJECT ? "}" : "]", 1);
+    }
+    return 0;
+}
+
+void sj_buffer_free(sj_buffer *buffer)
+{
+    free(buffer->data);
+    buffer->data = NULL;
+    buffer->len = 0;
+    buffer->cap = 0;
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright 2020-present, Nike, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the Apache-2.0 license found in
+ * the LICENSE file in the root of this source tree.
+ */
+
+/**
+ * A minimal JSON document model, just enough for the simulator to store
+ * shadow documents and apply updates to them.
+ *
+ * Strings and keys are kept in their escaped form, exactly as they were
+ * parsed, and are written back out unchanged.
+ */
+#ifndef _SIM_JSON_H_
+#define _SIM_JSON_H_
+
+#include <stddef.h>
+
+typedef enum sj_type {
+    SJ_NULL,
+    SJ_TRUE,
+    SJ_FALSE,
+    SJ_NUMBER,
+    SJ_STRING,
+    SJ_ARRAY,
+    SJ_OBJECT
+} sj_type;
+
+typedef struct sj_value {
+    sj_type type;
+    /** The literal of a number, or the escaped contents of a string */
+    char *text;
+    /** The escaped key when this value is a member of an object */
+    char *key;
+    /** The first element or member of an array or object */
+    struct sj_value *children;
+    struct sj_value *next;
+} sj_value;
+
+/** A growable output buffer */
+typedef struct sj_buffer {
+    char *data;
+    size_t len;
+    size_t cap;
+} sj_buffer;
+
+/** Parses the text, returning NULL if it isn't valid JSON or memory runs out */
+sj_value *sj_parse(const char *text, size_t len);
+
+void sj_free(sj_value *value);
+
+sj_value *sj_new(sj_type type);
+
+/** Creates a number from an unsigned integer */
+sj_value *sj_new_uint(unsigned long long number);
+
+sj_value *sj_clone(const sj_value *value);
+
+/** The member of the object with the key, or NULL */
+sj_value *sj_get(const sj_value *object, const char *key);
+
+/** Sets the member of the object, replacing and freeing any existing member with the key */
+void sj_set(sj_value *object, const char *key, sj_value *value);
+
+/**
+ * Applies a shadow style update to the target. Objects are merged member by
+ * member, null removes a member and any other value replaces the target.
+ */
+int sj_merge(sj_value *target, const sj_value *patch);
+
+/**
+ * The members of the desired state that differ from the reported state, the
+ * way the shadow delta is worked out. Objects are compared member by member
+ * and any other value as a whole. Returns an empty object when nothing
+ * differs, or NULL if memory runs out.
+ */
+sj_value *sj_delta(const sj_value *desired, const sj_value *reported);
+
+/** Appends the value as JSON. Returns 0 if memory runs out */
+int sj_write(sj_buffer *buffer, const sj_value *value);
+
+int sj_buffer_append(sj_buffer *buffer, const char *data, size_t len);
+
+int sj_buffer_append_str(sj_buffer *buffer, const char *str);
+
+/** Appends the string escaped for use inside a JSON string */
+int sj_buffer_append_escaped(sj_buffer *buffer, const char *str);
+
+/** Appends the string as a quoted JSON string */
+int sj_buffer_append_quoted(sj_buffer *buffer, const char *str);
+
+void sj_buffer_free(sj_buffer *buffer);
+
+#endif /* #ifndef _SIM_JSON_H_ */
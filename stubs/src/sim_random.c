@@ -0,0 +1,121 @@
+/*
+ * Copyright 2020-present, Nike, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the Apache-2.0 license found in
+ * the LICENSE file in the root of this source tree.
+ */
+
+#include "sim_random.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+void sim_rng_seed(sim_rng *rng, uint64_t seed)
+{
+    rng->state = seed;
+}
+
+uint64_t sim_rng_next(sim_rng *rng)
+{
+    uint64_t z = (rng->state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+double sim_rng_uniform(sim_rng *rng)
+{
+    return (sim_rng_next(rng) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+int sim_dist_parse(const char *text, sim_value_parser parse_value, sim_dist *dist)
+{
+    char copy[128];
+    if (strlen(text) >= sizeof(copy)) {
+        return 0;
+    }
+    strcpy(copy, text);
+
+    char *saveptr = NULL;
+    char *name = strtok_r(copy, ":", &saveptr);
+    char *first = strtok_r(NULL, ":", &saveptr);
+    char *second = strtok_r(NULL, ":", &saveptr);
+    if (!name || strtok_r(NULL, ":", &saveptr)) {
+        return 0;
+    }
+
+    sim_dist parsed = { SIM_DIST_NONE, 0, 0 };
+    if (strcmp(name, "none") == 0 && !first) {
+        *dist = parsed;
+        return 1;
+    }
+    if (!first || !parse_value(first, &parsed.a)
+            || (second && !parse_value(second, &parsed.b))) {
+        return 0;
+    }
+    if (strcmp(name, "constant") == 0 && !second) {
+        parsed.distribution = SIM_DIST_CONSTANT;
+    } else if (strcmp(name, "uniform") == 0 && second && parsed.b >= parsed.a) {
+        parsed.distribution = SIM_DIST_UNIFORM;
+    } else if (strcmp(name, "normal") == 0 && second) {
+        parsed.distribution = SIM_DIST_NORMAL;
+    } else if (strcmp(name, "exponential") == 0 && !second) {
+        parsed.distribution = SIM_DIST_EXPONENTIAL;
+    } else {
+        return 0;
+    }
+    *dist = parsed;
+    return 1;
+}
+
+double sim_dist_sample(const sim_dist *dist, sim_rng *rng)
+{
+    double sample = 0;
+    switch (dist->distribution) {
+    case SIM_DIST_NONE:
+        return 0;
+    case SIM_DIST_CONSTANT:
+        return dist->a;
+    case SIM_DIST_UNIFORM:
+        sample = dist->a + (dist->b - dist->a) * sim_rng_uniform(rng);
+        break;
+    case SIM_DIST_NORMAL: {
+        /* Box-Muller, 1 - u keeps the log away from 0 */
+        double u1 = 1.0 - sim_rng_uniform(rng);
+        double u2 = sim_rng_uniform(rng);
+        sample = dist->a + dist->b * sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+        break;
+    }
+    case SIM_DIST_EXPONENTIAL:
+        sample = -dist->a * log(1.0 - sim_rng_uniform(rng));
+        break;
+    }
+    return sample > 0 ? sample : 0;
+}
+
+int sim_parse_duration(const char *text, double *micros)
+{
+    char *end = NULL;
+    errno = 0;
+    double value = strtod(text, &end);
+    if (errno || end == text || value < 0) {
+        return 0;
+    }
+    if (strcmp(end, "us") == 0) {
+        *micros = value;
+    } else if (strcmp(end, "ms") == 0 || *end == '\0') {
+        *micros = value * 1000.0;
+    } else if (strcmp(end, "s") == 0) {
+        *micros = value * 1000000.0;
+    } else {
+        return 0;
+    }
+    return 1;
+}
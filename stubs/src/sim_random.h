@@ -0,0 +1,60 @@
+/*
+ * Copyright 2020-present, Nike, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the Apache-2.0 license found in
+ * the LICENSE file in the root of this source tree.
+ */
+
+/**
+ * Seeded random numbers and the distributions the simulator draws latencies
+ * and payload sizes from.
+ */
+#ifndef _SIM_RANDOM_H_
+#define _SIM_RANDOM_H_
+
+#include <stdint.h>
+
+/** A splitmix64 generator, small and good enough for picking faults and events */
+typedef struct sim_rng {
+    uint64_t state;
+} sim_rng;
+
+typedef enum sim_distribution {
+    SIM_DIST_NONE,
+    SIM_DIST_CONSTANT,
+    SIM_DIST_UNIFORM,
+    SIM_DIST_NORMAL,
+    SIM_DIST_EXPONENTIAL
+} sim_distribution;
+
+/** A distribution with its parameters, e.g. the min and max of a uniform distribution */
+typedef struct sim_dist {
+    sim_distribution distribution;
+    double a;
+    double b;
+} sim_dist;
+
+/** Parses a single parameter of a distribution. Returns 0 if it is invalid */
+typedef int (*sim_value_parser)(const char *text, double *value);
+
+void sim_rng_seed(sim_rng *rng, uint64_t seed);
+
+uint64_t sim_rng_next(sim_rng *rng);
+
+/** A uniform double in [0, 1) */
+double sim_rng_uniform(sim_rng *rng);
+
+/**
+ * Parses none, constant:<v>, uniform:<min>:<max>, normal:<mean>:<stddev>
+ * or exponential:<mean>. Returns 0 if the text is invalid.
+ */
+int sim_dist_parse(const char *text, sim_value_parser parse_value, sim_dist *dist);
+
+/** Draws a sample, clamped to be at least 0 */
+double sim_dist_sample(const sim_dist *dist, sim_rng *rng);
+
+/** Parses a duration such as 250us, 1.5ms or 2s into microseconds. Bare numbers are milliseconds */
+int sim_parse_duration(const char *text, double *micros);
+
+#endif /* #ifndef _SIM_RANDOM_H_ */
@@ -0,0 +1,271 @@
+/*
+ * Copyright 2020-present, Nike, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the Apache-2.0 license found in
+ * the LICENSE file in the root of this source tree.
+ */
+
+#include "sim_trace.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+const char *sim_trace_api_names[SIM_TRACE_API_COUNT] = {
+    "publish",
+    "invoke",
+    "get_shadow",
+    "update_shadow",
+    "delete_shadow",
+    "get_secret",
+    "event",
+    "log"
+};
+
+uint64_t sim_trace_now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+/***************************************
+**              Writing               **
+***************************************/
+
+static void write_varint(FILE *file, uint64_t value)
+{
+    unsigned char bytes[10];
+    size_t len = 0;
+    do {
+        bytes[len] = value & 0x7F;
+        value >>= 7;
+        if (value) {
+            bytes[len] |= 0x80;
+        }
+        len++;
+    } while (value);
+    fwrite(bytes, 1, len, file);
+}
+
+/** FNV-1a */
+static uint32_t hash_name(const char *name)
+{
+    uint32_t hash = 2166136261u;
+    for (const unsigned char *c = (const unsigned char *)name; *c; c++) {
+        hash = (hash ^ *c) * 16777619u;
+    }
+    return hash;
+}
+
+/** The id of the name, defining it in the trace the first time it is seen. 0 once the table is full */
+static uint32_t intern_name(sim_trace_writer *writer, const char *name)
+{
+    uint32_t slot = hash_name(name) % SIM_TRACE_MAX_NAMES;
+    while (writer->names[slot]) {
+        if (strcmp(writer->names[slot], name) == 0) {
+            return writer->name_ids[slot];
+        }
+        slot = (slot + 1) % SIM_TRACE_MAX_NAMES;
+    }
+    /* keep a free slot so that lookups always end */
+    if (writer->name_count + 1 >= SIM_TRACE_MAX_NAMES) {
+        return 0;
+    }
+    size_t len = strlen(name);
+    if (!(writer->names[slot] = malloc(len + 1))) {
+        return 0;
+    }
+    memcpy(writer->names[slot], name, len + 1);
+    writer->name_ids[slot] = ++writer->name_count;
+
+    fputc(SIM_TRACE_STRING, writer->file);
+    write_varint(writer->file, len);
+    fwrite(name, 1, len, writer->file);
+    return writer->name_ids[slot];
+}
+
+int sim_trace_open(sim_trace_writer *writer, const char *path)
+{
+    memset(writer, 0, sizeof(*writer));
+    if (!(writer->file = fopen(path, "wb"))) {
+        return 0;
+    }
+    pthread_mutex_init(&writer->lock, NULL);
+    writer->start_ns = sim_trace_now_ns();
+    fwrite(SIM_TRACE_MAGIC, 1, 8, writer->file);
+    fputc(SIM_TRACE_VERSION, writer->file);
+    return 1;
+}
+
+void sim_trace_write(sim_trace_writer *writer, sim_trace_call *call,
+                     uint64_t start_ns, const char *name)
+{
+    pthread_mutex_lock(&writer->lock);
+    if (writer->file) {
+        call->start_us = start_ns > writer->start_ns
+            ? (start_ns - writer->start_ns) / 1000
+            : 0;
+        call->name = name ? intern_name(writer, name) : 0;
+        fputc(SIM_TRACE_CALL, writer->file);
+        fputc(call->api, writer->file);
+        write_varint(writer->file, call->start_us);
+        write_varint(writer->file, call->duration_ns);
+        fputc(call->err, writer->file);
+        fputc(call->request_status, writer->file);
+        write_varint(writer->file, call->name);
+        write_varint(writer->file, call->request_size);
+        write_varint(writer->file, call->response_size);
+        fputc(call->option, writer->file);
+    }
+    pthread_mutex_unlock(&writer->lock);
+}
+
+void sim_trace_close(sim_trace_writer *writer)
+{
+    pthread_mutex_lock(&writer->lock);
+    if (writer->file) {
+        fclose(writer->file);
+        writer->file = NULL;
+    }
+    for (size_t i = 0; i < SIM_TRACE_MAX_NAMES; i++) {
+        free(writer->names[i]);
+        writer->names[i] = NULL;
+    }
+    pthread_mutex_unlock(&writer->lock);
+}
+
+/***************************************
+**              Reading               **
+***************************************/
+
+static int read_byte(FILE *file, uint8_t *value)
+{
+    int c = fgetc(file);
+    if (c == EOF) {
+        return 0;
+    }
+    *value = (uint8_t)c;
+    return 1;
+}
+
+static int read_varint(FILE *file, uint64_t *value)
+{
+    *value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int c = fgetc(file);
+        if (c == EOF) {
+            return 0;
+        }
+        *value |= (uint64_t)(c & 0x7F) << shift;
+        if (!(c & 0x80)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int read_call(FILE *file, sim_trace_call *call)
+{
+    uint64_t name;
+    return read_byte(file, &call->api)
+        && read_varint(file, &call->start_us)
+        && read_varint(file, &call->duration_ns)
+        && read_byte(file, &call->err)
+        && read_byte(file, &call->request_status)
+        && read_varint(file, &name)
+        && read_varint(file, &call->request_size)
+        && read_varint(file, &call->response_size)
+        && read_byte(file, &call->option)
+        && call->api < SIM_TRACE_API_COUNT
+        && (call->name = (uint32_t)name) == name;
+}
+
+static int read_name(FILE *file, sim_trace *trace)
+{
+    uint64_t len;
+    if (!read_varint(file, &len) || len > 65536) {
+        return 0;
+    }
+    char **names = realloc(trace->names, (trace->name_count + 1) * sizeof(char *));
+    if (!names) {
+        return 0;
+    }
+    trace->names = names;
+    char *name = malloc(len + 1);
+    if (!name || fread(name, 1, len, file) != len) {
+        free(name);
+        return 0;
+    }
+    name[len] = '\0';
+    trace->names[trace->name_count++] = name;
+    return 1;
+}
+
+int sim_trace_read(const char *path, sim_trace *trace)
+{
+    memset(trace, 0, sizeof(*trace));
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return 0;
+    }
+
+    char magic[8];
+    uint8_t version;
+    int ok = fread(magic, 1, 8, file) == 8
+        && memcmp(magic, SIM_TRACE_MAGIC, 8) == 0
+        && read_byte(file, &version)
+        && version == SIM_TRACE_VERSION
+        && (trace->names = calloc(1, sizeof(char *)));
+    trace->name_count = ok ? 1 : 0;
+
+    size_t capacity = 0;
+    uint8_t kind;
+    while (ok && read_byte(file, &kind)) {
+        if (kind == SIM_TRACE_STRING) {
+            ok = read_name(file, trace);
+            continue;
+        }
+        if (kind != SIM_TRACE_CALL) {
+            ok = 0;
+            break;
+        }
+        if (trace->call_count == capacity) {
+            capacity = capacity ? capacity * 2 : 1024;
+            sim_trace_call *calls = realloc(trace->calls, capacity * sizeof(sim_trace_call));
+            if (!calls) {
+                ok = 0;
+                break;
+            }
+            trace->calls = calls;
+        }
+        sim_trace_call *call = &trace->calls[trace->call_count];
+        ok = read_call(file, call) && call->name < trace->name_count;
+        trace->call_count += ok;
+    }
+    /* a lambda that was killed leaves a partly written record, the ones before it are kept */
+    if (!ok && trace->names && feof(file)) {
+        ok = 1;
+    }
+    fclose(file);
+    if (!ok) {
+        sim_trace_free(trace);
+    }
+    return ok;
+}
+
+void sim_trace_free(sim_trace *trace)
+{
+    for (size_t i = 0; i < trace->name_count; i++) {
+        free(trace->names[i]);
+    }
+    free(trace->names);
+    free(trace->calls);
+    memset(trace, 0, sizeof(*trace));
+}
+
+const char *sim_trace_name(const sim_trace *trace, const sim_trace_call *call)
+{
+    return call->name ? trace->names[call->name] : NULL;
+}
@@ -0,0 +1,116 @@
+/*
+ * Copyright 2020-present, Nike, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the Apache-2.0 license found in
+ * the LICENSE file in the root of this source tree.
+ */
+
+/**
+ * A compact binary trace of the calls made to the SDK, written by the
+ * gg-sdk-trace interposer and read by gg-replay.
+ *
+ * A trace starts with the 8 byte magic "GGTRACE" and a version byte,
+ * followed by records that start with a kind byte:
+ *
+ * - SIM_TRACE_STRING: varint length, bytes. Defines the next name, the
+ *   first being name 1.
+ * - SIM_TRACE_CALL: api byte, varint start in microseconds from the start of
+ *   the trace, varint duration in nanoseconds, gg_error byte, request status
+ *   byte, varint name (0 for none), varint request size, varint response
+ *   size, option byte.
+ *
+ * Varints are unsigned LEB128. Payloads aren't recorded, only their sizes.
+ */
+#ifndef _SIM_TRACE_H_
+#define _SIM_TRACE_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define SIM_TRACE_MAGIC "GGTRACE"
+#define SIM_TRACE_VERSION 1
+
+#define SIM_TRACE_STRING 0
+#define SIM_TRACE_CALL 1
+
+/** The request status or option of a call that doesn't have one */
+#define SIM_TRACE_NONE 0xFF
+
+/** The size of the table of names, more distinct names than this are not recorded */
+#define SIM_TRACE_MAX_NAMES 4096
+
+typedef enum sim_trace_api {
+    /** The option is the queue full policy, or SIM_TRACE_NONE without publish options */
+    SIM_TRACE_PUBLISH,
+    /** The option is the invoke type */
+    SIM_TRACE_INVOKE,
+    SIM_TRACE_GET_SHADOW,
+    SIM_TRACE_UPDATE_SHADOW,
+    SIM_TRACE_DELETE_SHADOW,
+    SIM_TRACE_GET_SECRET,
+    /** An event handled by the lambda handler, named by its function arn */
+    SIM_TRACE_EVENT,
+    /** The option is the log level */
+    SIM_TRACE_LOG,
+
+    SIM_TRACE_API_COUNT
+} sim_trace_api;
+
+typedef struct sim_trace_call {
+    uint8_t api;
+    uint8_t err;
+    uint8_t request_status;
+    uint8_t option;
+    uint32_t name;
+    uint64_t start_us;
+    uint64_t duration_ns;
+    uint64_t request_size;
+    uint64_t response_size;
+} sim_trace_call;
+
+typedef struct sim_trace_writer {
+    FILE *file;
+    /** Guards writes and the name table, calls are recorded from many threads */
+    pthread_mutex_t lock;
+    uint64_t start_ns;
+    char *names[SIM_TRACE_MAX_NAMES];
+    uint32_t name_ids[SIM_TRACE_MAX_NAMES];
+    uint32_t name_count;
+} sim_trace_writer;
+
+/** A trace read into memory */
+typedef struct sim_trace {
+    sim_trace_call *calls;
+    size_t call_count;
+    /** Names by id, names[0] is NULL */
+    char **names;
+    size_t name_count;
+} sim_trace;
+
+extern const char *sim_trace_api_names[SIM_TRACE_API_COUNT];
+
+uint64_t sim_trace_now_ns(void);
+
+/** Creates the trace file. Returns 0 if it can't be written */
+int sim_trace_open(sim_trace_writer *writer, const char *path);
+
+/** Records a call. Its start_us is taken from start_ns, and its name from the name, which may be NULL */
+void sim_trace_write(sim_trace_writer *writer, sim_trace_call *call,
+                     uint64_t start_ns, const char *name);
+
+void sim_trace_close(sim_trace_writer *writer);
+
+/**
+ * Reads a trace, returning 0 if it can't be read or is malformed. A trace
+ * that ends part way through a record is read up to that record.
+ */
+int sim_trace_read(const char *path, sim_trace *trace);
+
+void sim_trace_free(sim_trace *trace);
+
+/** The name of the call, or NULL */
+const char *sim_trace_name(const sim_trace *trace, const sim_trace_call *call);
+
+#endif /* #ifndef _SIM_TRACE_H_ */
@@ -0,0 +1,482 @@
+/*
+ * Copyright 2020-present, Nike, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the Apache-2.0 license found in
+ * the LICENSE file in the root of this source tree.
+ */
+
+/**
+ * Records the calls a lambda makes to the Greengrass SDK.
+ *
+ * Preloaded in front of the SDK, the real one on a core or the simulator,
+ * this library wraps the SDK's functions and writes each call to the trace
+ * file named by GG_TRACE_FILE:
+ *
+ *     GG_TRACE_FILE=/tmp/lambda.trace LD_PRELOAD=libgg-sdk-trace.so ./lambda
+ *
+ * A call that fills a request is written when the request is closed, so
+ * that the size of the response read from it is known. Without
+ * GG_TRACE_FILE the calls are passed straight through, except that gg_log
+ * messages are still formatted here, as the SDK has no va_list variant of it.
+ */
+#define _GNU_SOURCE
+
+#include "shared/greengrasssdk.h"
+#include "sim_trace.h"
+
+#include <dlfcn.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TRACE_MAX_PENDING 256
+#define TRACE_MAX_OPTIONS 64
+/** Longer log messages are formatted on the heap */
+#define TRACE_LOG_BUFFER 1024
+
+/** A call waiting for its request to be closed */
+typedef struct pending_call {
+    gg_request ggreq;
+    sim_trace_call call;
+    uint64_t start_ns;
+    char *name;
+} pending_call;
+
+static struct {
+    gg_error (*request_close)(gg_request);
+    gg_error (*request_read)(gg_request, void *, size_t, size_t *);
+    gg_error (*runtime_start)(gg_lambda_handler, uint32_t);
+    gg_error (*lambda_handler_read)(void *, size_t, size_t *);
+    gg_error (*get_secret_value)(gg_request, const char *, const char *,
+                                 const char *, gg_request_result *);
+    gg_error (*invoke)(gg_request, const gg_invoke_options *, gg_request_result *);
+    gg_error (*publish_options_free)(gg_publish_options);
+    gg_error (*publish_options_set_queue_full_policy)(gg_publish_options,
+                                                      gg_queue_full_policy_options);
+    gg_error (*publish_with_options)(gg_request, const char *, const void *, size_t,
+                                     const gg_publish_options, gg_request_result *);
+    gg_error (*publish)(gg_request, const char *, const void *, size_t,
+                        gg_request_result *);
+    gg_error (*get_thing_shadow)(gg_request, const char *, gg_request_result *);
+    gg_error (*update_thing_shadow)(gg_request, const char *, const char *,
+                                    gg_request_result *);
+    gg_error (*delete_thing_shadow)(gg_request, const char *, gg_request_result *);
+    gg_error (*log)(gg_log_level, const char *, ...);
+} real;
+
+static sim_trace_writer writer;
+static int tracing;
+
+/** Guards the pending calls and the publish options */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pending_call pending[TRACE_MAX_PENDING];
+static struct {
+    gg_publish_options opts;
+    gg_queue_full_policy_options policy;
+} options[TRACE_MAX_OPTIONS];
+
+static gg_lambda_handler user_handler;
+static _Thread_local uint64_t handler_bytes_read;
+
+/**
+ * Set while a publish is recorded, so that an SDK whose gg_publish calls
+ * gg_publish_with_options through its exported symbol isn't recorded twice
+ */
+static _Thread_local int in_publish;
+
+/***************************************
+**             Lifecycle              **
+***************************************/
+
+#define RESOLVE(field, symbol) \
+    *(void **)(&real.field) = dlsym(RTLD_NEXT, symbol)
+
+__attribute__((constructor))
+static void trace_load(void)
+{
+    RESOLVE(request_close, "gg_request_close");
+    RESOLVE(request_read, "gg_request_read");
+    RESOLVE(runtime_start, "gg_runtime_start");
+    RESOLVE(lambda_handler_read, "gg_lambda_handler_read");
+    RESOLVE(get_secret_value, "gg_get_secret_value");
+    RESOLVE(invoke, "gg_invoke");
+    RESOLVE(publish_options_free, "gg_publish_options_free");
+    RESOLVE(publish_options_set_queue_full_policy, "gg_publish_options_set_queue_full_policy");
+    RESOLVE(publish_with_options, "gg_publish_with_options");
+    RESOLVE(publish, "gg_publish");
+    RESOLVE(get_thing_shadow, "gg_get_thing_shadow");
+    RESOLVE(update_thing_shadow, "gg_update_thing_shadow");
+    RESOLVE(delete_thing_shadow, "gg_delete_thing_shadow");
+    RESOLVE(log, "gg_log");
+
+    const char *path = getenv("GG_TRACE_FILE");
+    if (path && *path) {
+        tracing = sim_trace_open(&writer, path);
+        if (!tracing) {
+            fprintf(stderr, "gg-sdk-trace: could not create %s\n", path);
+        }
+    }
+}
+
+__attribute__((destructor))
+static void trace_unload(void)
+{
+    if (!tracing) {
+        return;
+    }
+    /* calls whose request was never closed are written without a response */
+    pthread_mutex_lock(&lock);
+    for (size_t i = 0; i < TRACE_MAX_PENDING; i++) {
+        if (pending[i].ggreq) {
+            sim_trace_write(&writer, &pending[i].call, pending[i].start_ns, pending[i].name);
+            free(pending[i].name);
+            pending[i].ggreq = NULL;
+        }
+    }
+    pthread_mutex_unlock(&lock);
+    tracing = 0;
+    sim_trace_close(&writer);
+}
+
+/***************************************
+**             Recording              **
+***************************************/
+
+static uint8_t request_status(gg_error err, const gg_request_result *result)
+{
+    return err == GGE_SUCCESS && result
+        ? (uint8_t)result->request_status
+        : SIM_TRACE_NONE;
+}
+
+/** Holds the call until its request is closed, writing it now if it can't be held */
+static void record_request(gg_request ggreq, sim_trace_call *call,
+                           uint64_t start_ns, const char *name)
+{
+    call->duration_ns = sim_trace_now_ns() - start_ns;
+
+    pthread_mutex_lock(&lock);
+    pending_call *slot = NULL;
+    for (size_t i = 0; i < TRACE_MAX_PENDING; i++) {
+        if (pending[i].ggreq == ggreq) {
+            /* a request reused before being closed */
+            sim_trace_write(&writer, &pending[i].call, pending[i].start_ns, pending[i].name);
+            free(pending[i].name);
+            pending[i].ggreq = NULL;
+        }
+        if (!slot && !pending[i].ggreq) {
+            slot = &pending[i];
+        }
+    }
+    char *copy = name ? strdup(name) : NULL;
+    if (slot && (copy || !name)) {
+        slot->ggreq = ggreq;
+        slot->call = *call;
+        slot->start_ns = start_ns;
+        slot->name = copy;
+        pthread_mutex_unlock(&lock);
+        return;
+    }
+    pthread_mutex_unlock(&lock);
+    free(copy);
+    sim_trace_write(&writer, call, start_ns, name);
+}
+
+static void record(sim_trace_call *call, uint64_t start_ns, const char *name)
+{
+    call->duration_ns = sim_trace_now_ns() - start_ns;
+    sim_trace_write(&writer, call, start_ns, name);
+}
+
+/***************************************
+**         Request Methods            **
+***************************************/
+
+gg_error gg_request_read(gg_request ggreq, void *buffer, size_t buffer_size,
+                         size_t *amount_read)
+{
+    gg_error err = real.request_read(ggreq, buffer, buffer_size, amount_read);
+    if (tracing && err == GGE_SUCCESS && amount_read) {
+        pthread_mutex_lock(&lock);
+        for (size_t i = 0; i < TRACE_MAX_PENDING; i++) {
+            if (pending[i].ggreq == ggreq) {
+                pending[i].call.response_size += *amount_read;
+                break;
+            }
+        }
+        pthread_mutex_unlock(&lock);
+    }
+    return err;
+}
+
+gg_error gg_request_close(gg_request ggreq)
+{
+    if (tracing) {
+        pending_call closed = { 0 };
+        pthread_mutex_lock(&lock);
+        for (size_t i = 0; i < TRACE_MAX_PENDING; i++) {
+            if (pending[i].ggreq == ggreq) {
+                closed = pending[i];
+                pending[i].ggreq = NULL;
+                break;
+            }
+        }
+        pthread_mutex_unlock(&lock);
+        if (closed.ggreq) {
+            sim_trace_write(&writer, &closed.call, closed.start_ns, closed.name);
+            free(closed.name);
+        }
+    }
+    return real.request_close(ggreq);
+}
+
+/***************************************
+**           Runtime Methods          **
+***************************************/
+
+static void traced_handler(const gg_lambda_context *cxt)
+{
+    uint64_t start_ns = sim_trace_now_ns();
+    handler_bytes_read = 0;
+    user_handler(cxt);
+
+    sim_trace_call call = { 0 };
+    call.api = SIM_TRACE_EVENT;
+    call.err = GGE_SUCCESS;
+    call.request_status = SIM_TRACE_NONE;
+    call.option = SIM_TRACE_NONE;
+    call.request_size = handler_bytes_read;
+    record(&call, start_ns, cxt ? cxt->function_arn : NULL);
+}
+
+gg_error gg_runtime_start(gg_lambda_handler handler, uint32_t opt)
+{
+    if (!tracing || !handler) {
+        return real.runtime_start(handler, opt);
+    }
+    user_handler = handler;
+    return real.runtime_start(traced_handler, opt);
+}
+
+gg_error gg_lambda_handler_read(void *buffer, size_t buffer_size,
+                                size_t *amount_read)
+{
+    gg_error err = real.lambda_handler_read(buffer, buffer_size, amount_read);
+    if (err == GGE_SUCCESS && amount_read) {
+        handler_bytes_read += *amount_read;
+    }
+    return err;
+}
+
+/***************************************
+**             SDK Methods            **
+***************************************/
+
+gg_error gg_log(gg_log_level level, const char *format, ...)
+{
+    /* the real gg_log has no va_list variant, so the message is formatted here */
+    char buffer[TRACE_LOG_BUFFER];
+    char *message = buffer;
+    char *allocated = NULL;
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (len < 0) {
+        buffer[0] = '\0';
+    } else if ((size_t)len >= sizeof(buffer) && (allocated = malloc((size_t)len + 1))) {
+        va_start(args, format);
+        vsnprintf(allocated, (size_t)len + 1, format, args);
+        va_end(args);
+        message = allocated;
+    }
+
+    uint64_t start_ns = sim_trace_now_ns();
+    gg_error err = real.log(level, "%s", message);
+    free(allocated);
+    if (tracing) {
+        sim_trace_call call = { 0 };
+        call.api = SIM_TRACE_LOG;
+        call.err = (uint8_t)err;
+        call.request_status = SIM_TRACE_NONE;
+        call.option = (uint8_t)level;
+        call.request_size = len > 0 ? (uint64_t)len : 0;
+        record(&call, start_ns, NULL);
+    }
+    return err;
+}
+
+gg_error gg_get_secret_value(gg_request ggreq, const char *secret_id,
+		const char *version_id, const char *version_stage,
+		gg_request_result *result)
+{
+    uint64_t start_ns = sim_trace_now_ns();
+    gg_error err = real.get_secret_value(ggreq, secret_id, version_id, version_stage, result);
+    if (tracing) {
+        sim_trace_call call = { 0 };
+        call.api = SIM_TRACE_GET_SECRET;
+        call.err = (uint8_t)err;
+        call.request_status = request_status(err, result);
+        call.option = SIM_TRACE_NONE;
+        record_request(ggreq, &call, start_ns, secret_id);
+    }
+    return err;
+}
+
+gg_error gg_invoke(gg_request ggreq, const gg_invoke_options *opts,
+                   gg_request_result *result)
+{
+    uint64_t start_ns = sim_trace_now_ns();
+    gg_error err = real.invoke(ggreq, opts, result);
+    if (tracing) {
+        sim_trace_call call = { 0 };
+        call.api = SIM_TRACE_INVOKE;
+        call.err = (uint8_t)err;
+        call.request_status = request_status(err, result);
+        call.option = opts ? (uint8_t)opts->type : SIM_TRACE_NONE;
+        call.request_size = opts ? opts->payload_size : 0;
+        record_request(ggreq, &call, start_ns, opts ? opts->function_arn : NULL);
+    }
+    return err;
+}
+
+gg_error gg_publish_options_free(gg_publish_options opts)
+{
+    pthread_mutex_lock(&lock);
+    for (size_t i = 0; i < TRACE_MAX_OPTIONS; i++) {
+        if (options[i].opts == opts) {
+            options[i].opts = NULL;
+        }
+    }
+    pthread_mutex_unlock(&lock);
+    return real.publish_options_free(opts);
+}
+
+gg_error gg_publish_options_set_queue_full_policy(gg_publish_options opts,
+        gg_queue_full_policy_options policy)
+{
+    gg_error err = real.publish_options_set_queue_full_policy(opts, policy);
+    if (tracing && err == GGE_SUCCESS) {
+        pthread_mutex_lock(&lock);
+        size_t free_slot = TRACE_MAX_OPTIONS;
+        size_t i;
+        for (i = 0; i < TRACE_MAX_OPTIONS && options[i].opts != opts; i++) {
+            if (free_slot == TRACE_MAX_OPTIONS && !options[i].opts) {
+                free_slot = i;
+            }
+        }
+        if (i == TRACE_MAX_OPTIONS) {
+            i = free_slot;
+        }
+        if (i < TRACE_MAX_OPTIONS) {
+            options[i].opts = opts;
+            options[i].policy = policy;
+        }
+        pthread_mutex_unlock(&lock);
+    }
+    return err;
+}
+
+gg_error gg_publish_with_options(gg_request ggreq, const char *topic,
+        const void *payload, size_t payload_size, const gg_publish_options opts,
+        gg_request_result *result)
+{
+    if (!tracing || in_publish) {
+        return real.publish_with_options(ggreq, topic, payload, payload_size, opts, result);
+    }
+    uint64_t start_ns = sim_trace_now_ns();
+    in_publish = 1;
+    gg_error err = real.publish_with_options(ggreq, topic, payload, payload_size, opts, result);
+    in_publish = 0;
+
+    sim_trace_call call = { 0 };
+    call.api = SIM_TRACE_PUBLISH;
+    call.err = (uint8_t)err;
+    call.request_status = request_status(err, result);
+    /* options without a policy set use the default */
+    call.option = GG_QUEUE_FULL_POLICY_BEST_EFFORT;
+    call.request_size = payload_size;
+    pthread_mutex_lock(&lock);
+    for (size_t i = 0; i < TRACE_MAX_OPTIONS; i++) {
+        if (options[i].opts && options[i].opts == opts) {
+            call.option = (uint8_t)options[i].policy;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&lock);
+    record_request(ggreq, &call, start_ns, topic);
+    return err;
+}
+
+gg_error gg_publish(gg_request ggreq, const char *topic, const void *payload,
+                    size_t payload_size, gg_request_result *result)
+{
+    if (!tracing || in_publish) {
+        return real.publish(ggreq, topic, payload, payload_size, result);
+    }
+    uint64_t start_ns = sim_trace_now_ns();
+    in_publish = 1;
+    gg_error err = real.publish(ggreq, topic, payload, payload_size, result);
+    in_publish = 0;
+
+    sim_trace_call call = { 0 };
+    call.api = SIM_TRACE_PUBLISH;
+    call.err = (uint8_t)err;
+    call.request_status = request_status(err, result);
+    call.option = SIM_TRACE_NONE;
+    call.request_size = payload_size;
+    record_request(ggreq, &call, start_ns, topic);
+    return err;
+}
+
+/** Records one of the shadow calls */
+static void record_shadow(sim_trace_api api, gg_request ggreq, const char *thing_name,
+                          size_t request_size, uint64_t start_ns, gg_error err,
+                          const gg_request_result *result)
+{
+    sim_trace_call call = { 0 };
+    call.api = (uint8_t)api;
+    call.err = (uint8_t)err;
+    call.request_status = request_status(err, result);
+    call.option = SIM_TRACE_NONE;
+    call.request_size = request_size;
+    record_request(ggreq, &call, start_ns, thing_name);
+}
+
+gg_error gg_get_thing_shadow(gg_request ggreq, const char *thing_name,
+                             gg_request_result *result)
+{
+    uint64_t start_ns = sim_trace_now_ns();
+    gg_error err = real.get_thing_shadow(ggreq, thing_name, result);
+    if (tracing) {
+        record_shadow(SIM_TRACE_GET_SHADOW, ggreq, thing_name, 0, start_ns, err, result);
+    }
+    return err;
+}
+
+gg_error gg_update_thing_shadow(gg_request ggreq, const char *thing_name,
+                                const char *update_payload,
+                                gg_request_result *result)
+{
+    uint64_t start_ns = sim_trace_now_ns();
+    gg_error err = real.update_thing_shadow(ggreq, thing_name, update_payload, result);
+    if (tracing) {
+        record_shadow(SIM_TRACE_UPDATE_SHADOW, ggreq, thing_name,
+                      update_payload ? strlen(update_payload) : 0, start_ns, err, result);
+    }
+    return err;
+}
+
+gg_error gg_delete_thing_shadow(gg_request ggreq, const char *thing_name,
+                                gg_request_result *result)
+{
+    uint64_t start_ns = sim_trace_now_ns();
+    gg_error err = real.delete_thing_shadow(ggreq, thing_name, result);
+    if (tracing) {
+        record_shadow(SIM_TRACE_DELETE_SHADOW, ggreq, thing_name, 0, start_ns, err, result);
+    }
+    return err;
+}
@@ -0,0 +1,567 @@
+/*
+ * Copyright 2020-present, Nike, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the Apache-2.0 license found in
+ * the LICENSE file in the root of this source tree.
+ */
+
+/**
+ * Tests of the simulator behind the stubbed SDK, and the JSON, histogram and
+ * random helpers it is built on. Run with ctest, or directly to see each
+ * failed check.
+ */
+#include "shared/greengrasssdk_sim.h"
+#include "sim_histogram.h"
+#include "sim_json.h"
+#include "sim_random.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static int failures;
+
+#define CHECK(condition)                                                   \
+    do {                                                                   \
+        if (!(condition)) {                                                \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__,         \
+                    __LINE__, #condition);                                 \
+            failures++;                                                    \
+        }                                                                  \
+    } while (0)
+
+#define CHECK_STR(actual, expected) CHECK(strcmp((actual), (expected)) == 0)
+
+/***************************************
+**              Helpers               **
+***************************************/
+
+static int handled;
+static char handled_message[4096];
+
+static void handler(const gg_lambda_context *context)
+{
+    size_t read;
+    size_t total = 0;
+    (void)context;
+    do {
+        gg_lambda_handler_read(handled_message + total,
+                               sizeof(handled_message) - 1 - total, &read);
+        total += read;
+    } while (read && total < sizeof(handled_message) - 1);
+    handled_message[total] = '\0';
+    handled++;
+}
+
+/** Reads the whole response of a request, in small chunks to exercise partial reads */
+static void read_response(gg_request ggreq, char *out, size_t size)
+{
+    size_t read;
+    size_t total = 0;
+    do {
+        gg_request_read(ggreq, out + total, total + 5 < size ? 5 : size - 1 - total, &read);
+        total += read;
+    } while (read && total < size - 1);
+    out[total] = '\0';
+}
+
+/** Writes a parsed document back out, to compare it with the expected text */
+static void write_json(const sj_value *value, char *out, size_t size)
+{
+    sj_buffer buffer = {0};
+    sj_write(&buffer, value);
+    snprintf(out, size, "%.*s", (int)buffer.len, buffer.data);
+    sj_buffer_free(&buffer);
+}
+
+/***************************************
+**                JSON                **
+***************************************/
+
+static void test_json_round_trip(void)
+{
+    const char *text = "{\"a\":[1,-2.5e3,true,false,null],\"b\":{\"c\":\"x\\\"y\\u00e9\"}}";
+    char out[256];
+    sj_value *value = sj_parse(text, strlen(text));
+    CHECK(value != NULL);
+    write_json(value, out, sizeof(out));
+    CHECK_STR(out, text);
+    CHECK(sj_get(value, "b") && sj_get(value, "b")->type == SJ_OBJECT);
+    CHECK(sj_get(value, "missing") == NULL);
+    sj_free(value);
+
+    const char *invalid[] = {"", "{", "{\"a\"}", "[1,]", "tru", "\"open", "{} extra"};
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        sj_value *parsed = sj_parse(invalid[i], strlen(invalid[i]));
+        CHECK(parsed == NULL);
+        sj_free(parsed);
+    }
+}
+
+static void test_json_merge(void)
+{
+    const char *target_text = "{\"reported\":{\"a\":1,\"b\":{\"c\":2,\"d\":3},\"e\":[1]}}";
+    const char *patch_text = "{\"reported\":{\"a\":null,\"b\":{\"c\":4},\"e\":[2,3],\"f\":\"new\"}}";
+    char out[256];
+    sj_value *target = sj_parse(target_text, strlen(target_text));
+    sj_value *patch = sj_parse(patch_text, strlen(patch_text));
+    CHECK(target && patch);
+    CHECK(sj_merge(target, patch));
+    write_json(target, out, sizeof(out));
+    CHECK_STR(out, "{\"reported\":{\"b\":{\"c\":4,\"d\":3},\"e\":[2,3],\"f\":\"new\"}}");
+
+    sj_set(target, "version", sj_new_uint(7));
+    sj_value *clone = sj_clone(target);
+    write_json(clone, out, sizeof(out));
+    CHECK_STR(out, "{\"reported\":{\"b\":{\"c\":4,\"d\":3},\"e\":[2,3],\"f\":\"new\"},\"version\":7}");
+    sj_free(clone);
+    sj_free(patch);
+    sj_free(target);
+}
+
+static void test_json_delta(void)
+{
+    const char *desired_text = "{\"a\":1,\"b\":{\"c\":2,\"d\":3},\"e\":[1,2],\"f\":{\"g\":1,\"h\":2}}";
+    const char *reported_text = "{\"a\":1,\"b\":{\"c\":2,\"d\":4},\"e\":[2,1],\"f\":{\"h\":2,\"g\":1}}";
+    char out[256];
+    sj_value *desired = sj_parse(desired_text, strlen(desired_text));
+    sj_value *reported = sj_parse(reported_text, strlen(reported_text));
+    CHECK(desired && reported);
+
+    sj_value *delta = sj_delta(desired, reported);
+    write_json(delta, out, sizeof(out));
+    CHECK_STR(out, "{\"b\":{\"d\":3},\"e\":[1,2]}");
+    sj_free(delta);
+
+    delta = sj_delta(desired, desired);
+    write_json(delta, out, sizeof(out));
+    CHECK_STR(out, "{}");
+    sj_free(delta);
+
+    /* nothing is reported yet */
+    delta = sj_delta(desired, NULL);
+    write_json(delta, out, sizeof(out));
+    CHECK_STR(out, desired_text);
+    sj_free(delta);
+    sj_free(reported);
+    sj_free(desired);
+}
+
+/***************************************
+**        Histogram and random        **
+***************************************/
+
+static void test_histogram(void)
+{
+    sim_histogram histogram;
+    memset(&histogram, 0, sizeof(histogram));
+    CHECK(sim_histogram_percentile(&histogram, 50) == 0);
+
+    for (uint64_t value = 1; value <= 10000; value++) {
+        sim_histogram_record(&histogram, value);
+    }
+    CHECK(histogram.count == 10000);
+    CHECK(histogram.min == 1 && histogram.max == 10000);
+    CHECK(sim_histogram_mean(&histogram) > 5000 && sim_histogram_mean(&histogram) < 5001);
+    uint64_t p50 = sim_histogram_percentile(&histogram, 50);
+    uint64_t p99 = sim_histogram_percentile(&histogram, 99);
+    CHECK(p50 >= 5000 - 5000 / 16 && p50 <= 5000 + 5000 / 16);
+    CHECK(p99 >= 9900 - 9900 / 16 && p99 <= 10000);
+    CHECK(sim_histogram_percentile(&histogram, 100) == 10000);
+
+    /* small values are counted exactly */
+    memset(&histogram, 0, sizeof(histogram));
+    sim_histogram_record(&histogram, 3);
+    sim_histogram_record(&histogram, 7);
+    CHECK(sim_histogram_percentile(&histogram, 0) == 3);
+    CHECK(sim_histogram_percentile(&histogram, 100) == 7);
+}
+
+static void test_random(void)
+{
+    sim_rng first;
+    sim_rng second;
+    sim_rng_seed(&first, 42);
+    sim_rng_seed(&second, 42);
+    for (int i = 0; i < 16; i++) {
+        CHECK(sim_rng_next(&first) == sim_rng_next(&second));
+        double uniform = sim_rng_uniform(&first);
+        CHECK(uniform >= 0 && uniform < 1);
+        sim_rng_uniform(&second);
+    }
+
+    double micros;
+    CHECK(sim_parse_duration("250us", &micros) && micros == 250);
+    CHECK(sim_parse_duration("1.5ms", &micros) && micros == 1500);
+    CHECK(sim_parse_duration("2s", &micros) && micros == 2000000);
+    CHECK(sim_parse_duration("3", &micros) && micros == 3000);
+    CHECK(!sim_parse_duration("3 fortnights", &micros));
+
+    sim_dist dist;
+    CHECK(sim_dist_parse("uniform:1ms:2ms", sim_parse_duration, &dist));
+    for (int i = 0; i < 16; i++) {
+        double sample = sim_dist_sample(&dist, &first);
+        CHECK(sample >= 1000 && sample <= 2000);
+    }
+    CHECK(sim_dist_parse("constant:5ms", sim_parse_duration, &dist));
+    CHECK(sim_dist_sample(&dist, &first) == 5000);
+    CHECK(sim_dist_parse("none", sim_parse_duration, &dist));
+    CHECK(sim_dist_sample(&dist, &first) == 0);
+    CHECK(!sim_dist_parse("uniform:2ms:1ms", sim_parse_duration, &dist));
+    CHECK(!sim_dist_parse("gamma:1", sim_parse_duration, &dist));
+}
+
+/***************************************
+**             Simulator              **
+***************************************/
+
+static void test_publish(void)
+{
+    gg_request ggreq;
+    gg_request_result result;
+    gg_sim_reset();
+    gg_sim_subscribe("sensors/+/temp");
+    gg_sim_subscribe("$aws/things/#");
+    handled = 0;
+
+    gg_request_init(&ggreq);
+    CHECK(gg_publish(ggreq, "sensors/a/temp", "21.5", 4, &result) == GGE_SUCCESS);
+    CHECK(result.request_status == GG_REQUEST_SUCCESS);
+    gg_request_close(ggreq);
+    CHECK(handled == 1);
+    CHECK_STR(handled_message, "21.5");
+
+    gg_request_init(&ggreq);
+    gg_publish(ggreq, "sensors/a/humidity", "40", 2, &result);
+    gg_request_close(ggreq);
+    CHECK(handled == 1);
+
+    gg_sim_unsubscribe("sensors/+/temp");
+    gg_request_init(&ggreq);
+    gg_publish(ggreq, "sensors/a/temp", "22", 2, &result);
+    gg_request_close(ggreq);
+    CHECK(handled == 1);
+
+    gg_sim_stats stats;
+    gg_sim_get_stats(&stats);
+    CHECK(stats.publishes == 3);
+    CHECK(stats.deliveries == 1);
+}
+
+static void test_publish_queue_full(void)
+{
+    gg_request ggreq;
+    gg_request_result result;
+    char response[256];
+    gg_publish_options options;
+    gg_sim_reset();
+    gg_sim_subscribe("queued");
+    CHECK(gg_sim_configure("GG_SIM_QUEUE_CAPACITY", "2") == GGE_SUCCESS);
+    CHECK(gg_sim_configure("GG_SIM_QUEUE_DRAIN_RATE", "0") == GGE_SUCCESS);
+    gg_publish_options_init(&options);
+    gg_publish_options_set_queue_full_policy(options, GG_QUEUE_FULL_POLICY_ALL_OR_ERROR);
+
+    gg_request_status statuses[3];
+    for (int i = 0; i < 3; i++) {
+        gg_request_init(&ggreq);
+        gg_publish_with_options(ggreq, "queued", "p", 1, options, &result);
+        statuses[i] = result.request_status;
+        read_response(ggreq, response, sizeof(response));
+        gg_request_close(ggreq);
+    }
+    CHECK(statuses[0] == GG_REQUEST_SUCCESS && statuses[1] == GG_REQUEST_SUCCESS);
+    CHECK(statuses[2] == GG_REQUEST_AGAIN);
+    CHECK(strstr(response, "{\"code\":429,\"message\":\"queue full\",") == response);
+
+    gg_sim_stats stats;
+    gg_sim_get_stats(&stats);
+    CHECK(stats.throttled == 1);
+    gg_publish_options_free(options);
+    gg_sim_configure("GG_SIM_QUEUE_CAPACITY", "0");
+}
+
+static void test_shadow(void)
+{
+    gg_request ggreq;
+    gg_request_result result;
+    char response[1024];
+    gg_sim_reset();
+
+    gg_request_init(&ggreq);
+    gg_get_thing_shadow(ggreq, "thing", &result);
+    read_response(ggreq, response, sizeof(response));
+    gg_request_close(ggreq);
+    CHECK(result.request_status == GG_REQUEST_HANDLED);
+    CHECK(strstr(response, "\"code\":404") != NULL);
+
+    gg_request_init(&ggreq);
+    gg_update_thing_shadow(ggreq, "thing", "{\"state\":{\"reported\":{\"a\":1,\"b\":2}}}", &result);
+    read_response(ggreq, response, sizeof(response));
+    gg_request_close(ggreq);
+    CHECK(result.request_status == GG_REQUEST_SUCCESS);
+    CHECK(strstr(response, "\"version\":1") != NULL);
+
+    gg_request_init(&ggreq);
+    gg_update_thing_shadow(ggreq, "thing", "{\"state\":{\"reported\":{\"a\":null}},\"version\":1}", &result);
+    gg_request_close(ggreq);
+    CHECK(result.request_status == GG_REQUEST_SUCCESS);
+
+    /* the version is now 2 */
+    gg_request_init(&ggreq);
+    gg_update_thing_shadow(ggreq, "thing", "{\"state\":{},\"version\":1}", &result);
+    read_response(ggreq, response, sizeof(response));
+    gg_request_close(ggreq);
+    CHECK(result.request_status == GG_REQUEST_HANDLED);
+    CHECK(strstr(response, "\"code\":409") != NULL);
+
+    gg_request_init(&ggreq);
+    gg_update_thing_shadow(ggreq, "thing", "{not json", &result);
+    read_response(ggreq, response, sizeof(response));
+    gg_request_close(ggreq);
+    CHECK(strstr(response, "\"code\":400") != NULL);
+
+    gg_request_init(&ggreq);
+    gg_get_thing_shadow(ggreq, "thing", &result);
+    read_response(ggreq, response, sizeof(response));
+    gg_request_close(ggreq);
+    CHECK(strstr(response, "{\"state\":{\"reported\":{\"b\":2}},\"version\":2,") == response);
+
+    gg_request_init(&ggreq);
+    gg_delete_thing_shadow(ggreq, "thing", &result);
+    gg_request_close(ggreq);
+    CHECK(result.request_status == GG_REQUEST_SUCCESS);
+
+    CHECK(gg_sim_set_shadow("seeded", "{\"state\":{\"desired\":{\"x\":1}}}") == GGE_SUCCESS);
+    CHECK(gg_sim_set_shadow("seeded", "[]") == GGE_INVALID_PARAMETER);
+    gg_request_init(&ggreq);
+    gg_get_thing_shadow(ggreq, "seeded", &result);
+    read_response(ggreq, response, sizeof(response));
+    gg_request_close(ggreq);
+    CHECK(strstr(response, "\"desired\":{\"x\":1}") != NULL);
+
+    /* a desired state that differs from the reported one publishes a delta */
+    gg_sim_subscribe("$aws/things/seeded/shadow/update/delta");
+    handled = 0;
+    gg_request_init(&ggreq);
+    gg_update_thing_shadow(ggreq, "seeded",
+            "{\"state\":{\"reported\":{\"x\":1,\"y\":1}},\"clientToken\":\"t\"}", &result);
+    gg_request_close(ggreq);
+    CHECK(handled == 0);
+
+    gg_request_init(&ggreq);
+    gg_update_thing_shadow(ggreq, "seeded", "{\"state\":{\"desired\":{\"y\":2}},\"clientToken\":\"t\"}", &result);
+    gg_request_close(ggreq);
+    CHECK(result.request_status == GG_REQUEST_SUCCESS);
+    CHECK(handled == 1);
+    CHECK(strstr(handled_message, "{\"state\":{\"y\":2},\"version\":3,") == handled_message);
+    CHECK(strstr(handled_message, "\"clientToken\":\"t\"}") != NULL);
+}
+
+static void test_secret(void)
+{
+    gg_request ggreq;
+    gg_request_result result;
+    char response[1024];
+    gg_sim_reset();
+    gg_sim_set_secret("secret", NULL, NULL, "first");
+    gg_sim_set_secret("secret", NULL, NULL, "second");
+
+    gg_request_init(&ggreq);
+    gg_get_secret_value(ggreq, "secret", NULL, NULL, &result);
+    read_response(ggreq, response, sizeof(response));
+    gg_request_close(ggreq);
+    CHECK(strstr(response, "\"SecretString\":\"second\"") != NULL);
+
+    gg_request_init(&ggreq);
+    gg_get_secret_value(ggreq, "secret", NULL, "AWSPREVIOUS", &result);
+    read_response(ggreq, response, sizeof(response));
+    gg_request_close(ggreq);
+    CHECK(strstr(response, "\"SecretString\":\"first\"") != NULL);
+
+    gg_request_init(&ggreq);
+    gg_get_secret_value(ggreq, "missing", NULL, NULL, &result);
+    read_response(ggreq, response, sizeof(response));
+    gg_request_close(ggreq);
+    CHECK(result.request_status == GG_REQUEST_HANDLED);
+    CHECK(strstr(response, "\"code\":404") != NULL);
+}
+
+static void test_invoke(void)
+{
+    gg_request ggreq;
+    gg_request_result result;
+    char response[64];
+    gg_invoke_options options = {
+        "arn:function", NULL, "1", GG_INVOKE_REQUEST_RESPONSE, "ping", 4
+    };
+    gg_sim_reset();
+
+    gg_request_init(&ggreq);
+    gg_invoke(ggreq, &options, &result);
+    read_response(ggreq, response, sizeof(response));
+    gg_request_close(ggreq);
+    CHECK_STR(response, "ping");
+
+    gg_sim_set_invoke_response("arn:function", "pong", 4);
+    gg_request_init(&ggreq);
+    gg_invoke(ggreq, &options, &result);
+    read_response(ggreq, response, sizeof(response));
+    gg_request_close(ggreq);
+    CHECK_STR(response, "pong");
+}
+
+static void test_faults(void)
+{
+    gg_request ggreq;
+    gg_request_result result;
+    char runs[2][33] = {{0}};
+    CHECK(gg_sim_configure("GG_SIM_FAILURE_RATE", "0.5") == GGE_SUCCESS);
+    CHECK(gg_sim_configure("GG_SIM_FAILURE_RATE", "2") == GGE_INVALID_PARAMETER);
+    CHECK(gg_sim_configure("GG_SIM_LATENCY", "uniform:5ms:1ms") == GGE_INVALID_PARAMETER);
+    CHECK(gg_sim_configure("GG_SIM_UNKNOWN", "1") == GGE_INVALID_PARAMETER);
+
+    /* the same seed fails the same calls */
+    for (int run = 0; run < 2; run++) {
+        gg_sim_reset();
+        for (int i = 0; i < 32; i++) {
+            gg_request_init(&ggreq);
+            gg_error err = gg_publish(ggreq, "faults", "p", 1, &result);
+            runs[run][i] = err == GGE_INTERNAL_FAILURE ? 'F' : '.';
+            gg_request_close(ggreq);
+        }
+    }
+    CHECK_STR(runs[0], runs[1]);
+    CHECK(strchr(runs[0], 'F') != NULL && strchr(runs[0], '.') != NULL);
+    gg_sim_configure("GG_SIM_FAILURE_RATE", "0");
+}
+
+static void test_requests(void)
+{
+    gg_request ggreq;
+    gg_request_result result;
+    gg_sim_stats before;
+    gg_sim_stats after;
+    gg_sim_reset();
+    gg_sim_get_stats(&before);
+
+    gg_request_init(&ggreq);
+    CHECK(gg_request_close(ggreq) == GGE_SUCCESS);
+    CHECK(gg_request_close(ggreq) == GGE_INVALID_PARAMETER);
+    CHECK(gg_publish(ggreq, "closed", "p", 1, &result) == GGE_INVALID_PARAMETER);
+
+    gg_sim_get_stats(&after);
+    CHECK(after.requests == before.requests + 1);
+    CHECK(after.open_requests == 0);
+    CHECK(after.invalid_requests == before.invalid_requests + 2);
+}
+
+typedef struct publish_call {
+    gg_request ggreq;
+    gg_error err;
+} publish_call;
+
+static void *publish_slowly(void *arg)
+{
+    publish_call *call = arg;
+    gg_request_result result;
+    call->err = gg_publish(call->ggreq, "in-use", "p", 1, &result);
+    return NULL;
+}
+
+static void test_close_in_use(void)
+{
+    publish_call call;
+    pthread_t thread;
+    struct timespec delay = { 0, 20 * 1000 * 1000 };
+    gg_sim_reset();
+    CHECK(gg_sim_configure("GG_SIM_LATENCY_PUBLISH", "constant:200ms") == GGE_SUCCESS);
+
+    /* closed while the publish waits out its latency, so it is freed once the publish returns */
+    gg_request_init(&call.ggreq);
+    pthread_create(&thread, NULL, publish_slowly, &call);
+    nanosleep(&delay, NULL);
+    CHECK(gg_request_close(call.ggreq) == GGE_SUCCESS);
+    pthread_join(thread, NULL);
+    CHECK(call.err == GGE_SUCCESS);
+    CHECK(gg_request_close(call.ggreq) == GGE_INVALID_PARAMETER);
+    gg_sim_configure("GG_SIM_LATENCY_PUBLISH", "none");
+}
+
+static void *stop_events(void *arg)
+{
+    (void)arg;
+    gg_sim_stop_events();
+    return NULL;
+}
+
+static void test_events(void)
+{
+    gg_sim_event_stats stats;
+    pthread_t thread;
+    gg_sim_reset();
+    handled = 0;
+    CHECK(gg_sim_configure("GG_SIM_EVENTS_COUNT", "50") == GGE_SUCCESS);
+    CHECK(gg_sim_configure("GG_SIM_EVENTS_PAYLOAD_SIZE", "constant:64") == GGE_SUCCESS);
+
+    /* without GG_RT_OPT_ASYNC the events are generated before returning */
+    CHECK(gg_runtime_start(handler, 0) == GGE_SUCCESS);
+    CHECK(handled == 50);
+    CHECK(strstr(handled_message, "\"seq\":") != NULL);
+    gg_sim_get_event_stats(&stats);
+    CHECK(stats.events == 50);
+    CHECK(stats.payload_bytes == 50 * 64);
+
+    gg_sim_reset();
+    handled = 0;
+    CHECK(gg_runtime_start(handler, GG_RT_OPT_ASYNC) == GGE_SUCCESS);
+    CHECK(gg_sim_wait_events() == GGE_SUCCESS);
+    CHECK(handled == 50);
+
+    /* the registered handler is driven again without restarting the runtime */
+    CHECK(gg_sim_start_events() == GGE_SUCCESS);
+    CHECK(gg_sim_wait_events() == GGE_SUCCESS);
+    CHECK(handled == 100);
+
+    /* unlimited events stopped from two threads at once */
+    CHECK(gg_sim_configure("GG_SIM_EVENTS_COUNT", "0") == GGE_SUCCESS);
+    CHECK(gg_sim_configure("GG_SIM_EVENTS_RATE", "1000") == GGE_SUCCESS);
+    CHECK(gg_sim_start_events() == GGE_SUCCESS);
+    CHECK(gg_sim_configure("GG_SIM_EVENTS_RATE", "10") == GGE_INVALID_STATE);
+    CHECK(gg_sim_wait_events() == GGE_INVALID_STATE);
+    pthread_create(&thread, NULL, stop_events, NULL);
+    gg_sim_stop_events();
+    pthread_join(thread, NULL);
+    CHECK(gg_sim_configure("GG_SIM_EVENTS_RATE", "0") == GGE_SUCCESS);
+    gg_sim_configure("GG_SIM_EVENTS_COUNT", "0");
+    gg_sim_reset();
+}
+
+int main(void)
+{
+    gg_global_init(0);
+    gg_runtime_start(handler, 0);
+
+    test_json_round_trip();
+    test_json_merge();
+    test_json_delta();
+    test_histogram();
+    test_random();
+    test_publish();
+    test_publish_queue_full();
+    test_shadow();
+    test_secret();
+    test_invoke();
+    test_faults();
+    test_requests();
+    test_close_in_use();
+    test_events();
+
+    if (failures) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
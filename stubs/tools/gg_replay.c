@@ -0,0 +1,391 @@
+/*
+ * Copyright 2020-present, Nike, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the Apache-2.0 license found in
+ * the LICENSE file in the root of this source tree.
+ */
+
+/**
+ * Replays a trace recorded by gg-sdk-trace against the simulator and
+ * reports the latency of each API next to the latency that was recorded.
+ *
+ *     gg-replay [-s speed] [-c config] trace
+ *
+ * Calls are issued at their recorded times divided by the speed, a speed of
+ * 0 issuing them back to back. The config file is read with
+ * gg_sim_load_config, so replays can add latency, failures and a bounded
+ * queue. Payloads are synthesized with the recorded sizes, events are
+ * delivered to a handler that reads them, and the secrets and shadows that
+ * the trace reads are created before the replay starts.
+ *
+ * The replay is serial. The trace doesn't record which thread made each
+ * call, so calls that overlapped when they were recorded are issued one
+ * after another, and a call that takes longer than the gap to the next
+ * delays it, which is reported as schedule lag. A lambda that calls the SDK
+ * from many threads replays with less concurrency than it was recorded with.
+ */
+#include "shared/greengrasssdk.h"
+#include "shared/greengrasssdk_sim.h"
+#include "sim_histogram.h"
+#include "sim_trace.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define REPLAY_EVENT_TOPIC "gg-replay/events"
+#define REPLAY_SECRET "replayed secret"
+#define REPLAY_SHADOW "{\"state\":{\"reported\":{\"replayed\":true}}}"
+
+typedef struct replay_stats {
+    sim_histogram replayed;
+    sim_histogram recorded;
+    uint64_t errors;
+    /** Calls whose error or request status differs from the recording */
+    uint64_t mismatches;
+} replay_stats;
+
+static replay_stats stats[SIM_TRACE_API_COUNT];
+static sim_histogram lag;
+
+static char *payload;
+static size_t payload_capacity;
+static char *response;
+static size_t response_capacity;
+
+/***************************************
+**              Payloads              **
+***************************************/
+
+static int reserve(char **buffer, size_t *capacity, size_t size)
+{
+    if (size + 1 <= *capacity) {
+        return 1;
+    }
+    char *grown = realloc(*buffer, size + 1);
+    if (!grown) {
+        return 0;
+    }
+    *buffer = grown;
+    *capacity = size + 1;
+    return 1;
+}
+
+/** A string of the size, valid JSON where the size allows */
+static const char *make_payload(size_t size)
+{
+    if (!reserve(&payload, &payload_capacity, size)) {
+        return NULL;
+    }
+    memset(payload, 'x', size);
+    if (size >= 2) {
+        payload[0] = '"';
+        payload[size - 1] = '"';
+    }
+    payload[size] = '\0';
+    return payload;
+}
+
+/** A shadow update of about the size, which must have a state to be accepted */
+static const char *make_shadow_update(size_t size)
+{
+    static const char prefix[] = "{\"state\":{\"reported\":{\"pad\":\"";
+    static const char suffix[] = "\"}}}";
+    size_t overhead = sizeof(prefix) - 1 + sizeof(suffix) - 1;
+    size_t padding = size > overhead ? size - overhead : 0;
+    if (!reserve(&payload, &payload_capacity, overhead + padding)) {
+        return NULL;
+    }
+    memcpy(payload, prefix, sizeof(prefix) - 1);
+    memset(payload + sizeof(prefix) - 1, 'x', padding);
+    memcpy(payload + sizeof(prefix) - 1 + padding, suffix, sizeof(suffix));
+    return payload;
+}
+
+/***************************************
+**              Replay                **
+***************************************/
+
+static void replay_handler(const gg_lambda_context *cxt)
+{
+    (void)cxt;
+    char buffer[4096];
+    size_t amount_read = 0;
+    do {
+        if (gg_lambda_handler_read(buffer, sizeof(buffer), &amount_read) != GGE_SUCCESS) {
+            return;
+        }
+    } while (amount_read > 0);
+}
+
+/** Reads the whole response, as the recorded lambda did */
+static gg_error read_response(gg_request ggreq, size_t expected)
+{
+    if (!reserve(&response, &response_capacity, expected > 4096 ? expected : 4096)) {
+        return GGE_OUT_OF_MEMORY;
+    }
+    size_t amount_read = 0;
+    gg_error err;
+    do {
+        err = gg_request_read(ggreq, response, response_capacity, &amount_read);
+    } while (err == GGE_SUCCESS && amount_read > 0);
+    return err;
+}
+
+/** Creates what the trace reads, so that replayed reads find it */
+static void seed_simulator(const sim_trace *trace)
+{
+    for (size_t i = 0; i < trace->call_count; i++) {
+        const sim_trace_call *call = &trace->calls[i];
+        const char *name = sim_trace_name(trace, call);
+        if (!name || call->request_status != GG_REQUEST_SUCCESS) {
+            continue;
+        }
+        if (call->api == SIM_TRACE_GET_SECRET) {
+            gg_sim_set_secret(name, NULL, NULL, REPLAY_SECRET);
+        } else if (call->api == SIM_TRACE_GET_SHADOW || call->api == SIM_TRACE_DELETE_SHADOW) {
+            gg_sim_set_shadow(name, REPLAY_SHADOW);
+        }
+    }
+}
+
+static gg_error issue(const sim_trace *trace, const sim_trace_call *call,
+                      gg_publish_options *policies, gg_request_result *result)
+{
+    const char *name = sim_trace_name(trace, call);
+    result->request_status = (gg_request_status)SIM_TRACE_NONE;
+
+    if (call->api == SIM_TRACE_EVENT) {
+        const char *message = make_payload(call->request_size);
+        return message
+            ? gg_sim_deliver(REPLAY_EVENT_TOPIC, message, call->request_size)
+            : GGE_OUT_OF_MEMORY;
+    }
+    if (call->api == SIM_TRACE_LOG) {
+        const char *message = make_payload(call->request_size);
+        return message
+            ? gg_log((gg_log_level)call->option, "%s", message)
+            : GGE_OUT_OF_MEMORY;
+    }
+
+    gg_request ggreq = NULL;
+    gg_error err = gg_request_init(&ggreq);
+    if (err != GGE_SUCCESS) {
+        return err;
+    }
+    const char *data = call->api == SIM_TRACE_UPDATE_SHADOW
+        ? make_shadow_update(call->request_size)
+        : make_payload(call->request_size);
+    if (!data) {
+        gg_request_close(ggreq);
+        return GGE_OUT_OF_MEMORY;
+    }
+
+    switch (call->api) {
+    case SIM_TRACE_PUBLISH:
+        if (call->option < GG_QUEUE_FULL_POLICY_RESERVED_MAX) {
+            err = gg_publish_with_options(ggreq, name ? name : "", data,
+                    call->request_size, policies[call->option], result);
+        } else {
+            err = gg_publish(ggreq, name ? name : "", data, call->request_size, result);
+        }
+        break;
+    case SIM_TRACE_INVOKE: {
+        gg_invoke_options opts = { 0 };
+        opts.function_arn = name ? name : "";
+        opts.type = call->option < GG_INVOKE_RESERVED_MAX
+            ? (gg_invoke_type)call->option
+            : GG_INVOKE_REQUEST_RESPONSE;
+        opts.payload = data;
+        opts.payload_size = call->request_size;
+        err = gg_invoke(ggreq, &opts, result);
+        break;
+    }
+    case SIM_TRACE_GET_SHADOW:
+        err = gg_get_thing_shadow(ggreq, name ? name : "", result);
+        break;
+    case SIM_TRACE_UPDATE_SHADOW:
+        err = gg_update_thing_shadow(ggreq, name ? name : "", data, result);
+        break;
+    case SIM_TRACE_DELETE_SHADOW:
+        err = gg_delete_thing_shadow(ggreq, name ? name : "", result);
+        break;
+    case SIM_TRACE_GET_SECRET:
+        err = gg_get_secret_value(ggreq, name ? name : "", NULL, NULL, result);
+        break;
+    default:
+        err = GGE_INVALID_PARAMETER;
+        break;
+    }
+    if (err == GGE_SUCCESS) {
+        err = read_response(ggreq, call->response_size);
+    }
+    gg_request_close(ggreq);
+    return err;
+}
+
+static void sleep_until(uint64_t deadline_ns)
+{
+    uint64_t now = sim_trace_now_ns();
+    if (deadline_ns <= now) {
+        return;
+    }
+    uint64_t wait = deadline_ns - now;
+    struct timespec delay;
+    delay.tv_sec = (time_t)(wait / 1000000000ULL);
+    delay.tv_nsec = (long)(wait % 1000000000ULL);
+    while (nanosleep(&delay, &delay) != 0 && errno == EINTR) {
+    }
+}
+
+static int by_start(const void *a, const void *b)
+{
+    const sim_trace_call *left = a;
+    const sim_trace_call *right = b;
+    return (left->start_us > right->start_us) - (left->start_us < right->start_us);
+}
+
+/** Issues the calls one at a time, on the calling thread */
+static void replay(sim_trace *trace, double speed)
+{
+    /* calls are recorded as their requests close, so they are put back in the order they started */
+    qsort(trace->calls, trace->call_count, sizeof(sim_trace_call), by_start);
+
+    gg_publish_options policies[GG_QUEUE_FULL_POLICY_RESERVED_MAX] = { 0 };
+    for (int i = 0; i < GG_QUEUE_FULL_POLICY_RESERVED_MAX; i++) {
+        gg_publish_options_init(&policies[i]);
+        gg_publish_options_set_queue_full_policy(policies[i], (gg_queue_full_policy_options)i);
+    }
+
+    uint64_t start_ns = sim_trace_now_ns();
+    for (size_t i = 0; i < trace->call_count; i++) {
+        const sim_trace_call *call = &trace->calls[i];
+        uint64_t due_ns = start_ns;
+        if (speed > 0) {
+            due_ns += (uint64_t)(call->start_us * 1000.0 / speed);
+            sleep_until(due_ns);
+        }
+
+        uint64_t issued_ns = sim_trace_now_ns();
+        gg_request_result result;
+        gg_error err = issue(trace, call, policies, &result);
+        uint64_t done_ns = sim_trace_now_ns();
+
+        replay_stats *api = &stats[call->api];
+        sim_histogram_record(&api->replayed, done_ns - issued_ns);
+        sim_histogram_record(&api->recorded, call->duration_ns);
+        api->errors += err != GGE_SUCCESS;
+        uint8_t status = err == GGE_SUCCESS ? (uint8_t)result.request_status : SIM_TRACE_NONE;
+        api->mismatches += (uint8_t)err != call->err || status != call->request_status;
+        if (speed > 0) {
+            sim_histogram_record(&lag, issued_ns - due_ns);
+        }
+    }
+    uint64_t elapsed_ns = sim_trace_now_ns() - start_ns;
+
+    for (int i = 0; i < GG_QUEUE_FULL_POLICY_RESERVED_MAX; i++) {
+        gg_publish_options_free(policies[i]);
+    }
+
+    uint64_t recorded_us = trace->call_count
+        ? trace->calls[trace->call_count - 1].start_us
+        : 0;
+    printf("replayed %zu calls in %.3fs, recorded over %.3fs\n",
+           trace->call_count, elapsed_ns / 1e9, recorded_us / 1e6);
+    printf("%-14s %8s %7s %9s %10s %10s %10s %10s %10s %10s\n",
+           "api", "calls", "errors", "mismatch", "p50 us", "p90 us", "p99 us",
+           "max us", "rec p50", "rec p99");
+    for (int i = 0; i < SIM_TRACE_API_COUNT; i++) {
+        const replay_stats *api = &stats[i];
+        if (!api->replayed.count) {
+            continue;
+        }
+        printf("%-14s %8llu %7llu %9llu %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+               sim_trace_api_names[i],
+               (unsigned long long)api->replayed.count,
+               (unsigned long long)api->errors,
+               (unsigned long long)api->mismatches,
+               sim_histogram_percentile(&api->replayed, 50) / 1000.0,
+               sim_histogram_percentile(&api->replayed, 90) / 1000.0,
+               sim_histogram_percentile(&api->replayed, 99) / 1000.0,
+               api->replayed.max / 1000.0,
+               sim_histogram_percentile(&api->recorded, 50) / 1000.0,
+               sim_histogram_percentile(&api->recorded, 99) / 1000.0);
+    }
+    if (lag.count) {
+        printf("schedule lag p50 %.1fus p99 %.1fus max %.1fus\n",
+               sim_histogram_percentile(&lag, 50) / 1000.0,
+               sim_histogram_percentile(&lag, 99) / 1000.0,
+               lag.max / 1000.0);
+    }
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: gg-replay [-s speed] [-c config] trace\n"
+                    "  -s speed   1 replays at the recorded pace (default), 10 ten\n"
+                    "             times faster, 0 as fast as possible. Calls are\n"
+                    "             issued one at a time, even if they overlapped\n"
+                    "  -c config  simulator settings, as read by gg_sim_load_config\n");
+}
+
+int main(int argc, char **argv)
+{
+    double speed = 1.0;
+    const char *config = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "s:c:h")) != -1) {
+        char *end = NULL;
+        switch (opt) {
+        case 's':
+            errno = 0;
+            speed = strtod(optarg, &end);
+            if (errno || end == optarg || *end != '\0' || speed < 0) {
+                usage();
+                return 2;
+            }
+            break;
+        case 'c':
+            config = optarg;
+            break;
+        default:
+            usage();
+            return 2;
+        }
+    }
+    if (optind + 1 != argc) {
+        usage();
+        return 2;
+    }
+
+    sim_trace trace;
+    if (!sim_trace_read(argv[optind], &trace)) {
+        fprintf(stderr, "gg-replay: could not read the trace %s\n", argv[optind]);
+        return 1;
+    }
+
+    gg_error err = gg_global_init(0);
+    if (err == GGE_SUCCESS && config) {
+        err = gg_sim_load_config(config);
+    }
+    if (err == GGE_SUCCESS) {
+        err = gg_runtime_start(replay_handler, GG_RT_OPT_ASYNC);
+    }
+    if (err != GGE_SUCCESS) {
+        fprintf(stderr, "gg-replay: could not start the simulator (%d)\n", (int)err);
+        sim_trace_free(&trace);
+        return 1;
+    }
+
+    seed_simulator(&trace);
+    replay(&trace, speed);
+
+    sim_trace_free(&trace);
+    free(payload);
+    free(response);
+    return 0;
+}